@@ -1,4 +1,5 @@
 #include <cmath>
+#include <functional>
 #include <stdexcept>
 #include "astnode.h"
 #include "runtime_errors.h"
@@ -6,21 +7,110 @@
 
 using namespace std;
 
-/* ===== ASTNode ===== */
+static Opcode getOperatorOpcode(Builtin op) {
+	switch (op) {
+		case Builtin::Addition:
+		case Builtin::AdditionAssignment:
+			return Opcode::Add;
+		case Builtin::Subtraction:
+		case Builtin::SubtractionAssignment:
+			return Opcode::Subtract;
+		case Builtin::Multiplication:
+		case Builtin::MultiplicationAssignment:
+			return Opcode::Multiply;
+		case Builtin::Division:
+		case Builtin::DivisionAssignment:
+			return Opcode::Divide;
+		case Builtin::Modulus:
+		case Builtin::ModulusAssignment:
+			return Opcode::Modulus;
+		case Builtin::Exponent:
+		case Builtin::ExponentAssignment:
+			return Opcode::Exponent;
+		case Builtin::LessThan:
+			return Opcode::LessThan;
+		case Builtin::LessThanOrEqual:
+			return Opcode::LessThanOrEqual;
+		case Builtin::GreaterThan:
+			return Opcode::GreaterThan;
+		case Builtin::GreaterThanOrEqual:
+			return Opcode::GreaterThanOrEqual;
+		case Builtin::EqualTo:
+			return Opcode::EqualTo;
+		case Builtin::NotEqualTo:
+			return Opcode::NotEqualTo;
+		default:
+			throw InterpretorError("operator not implemented");
+	}
+}
 
-ASTNode::ASTNode(const TokenMetaData& meta, shared_ptr<Scope> scope)
-	: _meta(meta), _scope(scope) {
-		if (!_scope) {
-			throw invalid_argument("scope cannot be null");
-		}
+// the comparison fused with the jump after it, or Halt for operators that don't have one
+static Opcode getTestOpcode(Builtin op) {
+	switch (op) {
+		case Builtin::LessThan:
+			return Opcode::TestLessThan;
+		case Builtin::LessThanOrEqual:
+			return Opcode::TestLessThanOrEqual;
+		case Builtin::GreaterThan:
+			return Opcode::TestGreaterThan;
+		case Builtin::GreaterThanOrEqual:
+			return Opcode::TestGreaterThanOrEqual;
+		case Builtin::EqualTo:
+			return Opcode::TestEqualTo;
+		case Builtin::NotEqualTo:
+			return Opcode::TestNotEqualTo;
+		default:
+			return Opcode::Halt;
+	}
+}
+
+// object.member op= rhs, for AccessMemberNode and for SubscriptNode with a string literal index
+static void compileMemberAssignment(Compiler& compiler, Builtin op, int object, const string& member, const ASTNode& rhs) {
+	if (op == Builtin::Assignment) {
+		int value = rhs.compile(compiler, Compiler::any);
+		compiler.emit(Opcode::SetMember, object, compiler.member(member), value);
+	} else {
+		int current = compiler.temporary();
+		compiler.emit(Opcode::GetMember, current, object, compiler.member(member));
+
+		int value = rhs.compileOperand(compiler);
+		compiler.emit(getOperatorOpcode(op), current, current, value);
+		compiler.emit(Opcode::SetMember, object, compiler.member(member), current);
 	}
+}
 
-const TokenMetaData& ASTNode::meta() const {
-	return _meta;
+static Value toValue(double number) {
+	return Value::number(number);
 }
 
-shared_ptr<Scope> ASTNode::scope() const {
-	return _scope;
+static Value toValue(bool boolean) {
+	return Value::boolean(boolean);
+}
+
+struct Modulus {
+	double operator()(double x, double y) const {
+		return numberModulus(x, y);
+	}
+};
+
+struct Exponent {
+	double operator()(double x, double y) const {
+		return powl(x, y);
+	}
+};
+
+template <typename Op>
+static Value applyNumberOperator(const Value& lhs, const Value& rhs, Op op) {
+	return Value::number(op(toNumber(lhs), toNumber(rhs)));
+}
+
+/* ===== ASTNode ===== */
+
+ASTNode::ASTNode(uint32_t location)
+	: _location(location) {}
+
+uint32_t ASTNode::location() const {
+	return _location;
 }
 
 bool ASTNode::isLValue() const {
@@ -31,18 +121,62 @@ bool ASTNode::isConst(const std::shared_ptr<Scope>& scope) const {
 	return false;
 }
 
-shared_ptr<Value> ASTNode::evaluate() const {
+bool ASTNode::hasSideEffects() const {
+	return true;
+}
+
+void ASTNode::resolve(Resolver& resolver) {}
+
+// returns the node that should replace this one, or nullptr to keep it
+ASTNode* ASTNode::optimize(Optimizer& optimizer) {
+	return nullptr;
+}
+
+// the value of a number, boolean or null literal, or an empty value for anything else
+Value ASTNode::literalValue() const {
+	return Value();
+}
+
+Value ASTNode::evaluate(Frame& frame) const {
 	throw InterpretorError("evaluate not implemented");
 }
 
-void ASTNode::assign(shared_ptr<Value> rhs) const {
+// expressions used as statements always complete normally, and their value is dropped
+Completion ASTNode::execute(Frame& frame) const {
+	evaluate(frame);
+	return {};
+}
+
+void ASTNode::assign(Frame& frame, Value rhs) const {
+	throw InterpretorError("(not assignable)");
+}
+
+int ASTNode::compile(Compiler& compiler, int destination) const {
+	throw InterpretorError("compile not implemented");
+}
+
+// the value as an rk operand, for the instructions that can take a constant in place of a register
+int ASTNode::compileOperand(Compiler& compiler) const {
+	return compile(compiler, Compiler::any);
+}
+
+int ASTNode::compileAssignment(Compiler& compiler, Builtin op, const ASTNode& rhs, int destination) const {
 	throw InterpretorError("(not assignable)");
 }
 
+// emits a jump taken when the value is the given condition, and returns it for the caller to patch
+int ASTNode::compileJump(Compiler& compiler, bool condition) const {
+	auto mark = compiler.mark();
+	int reg = compile(compiler, Compiler::any);
+	compiler.release(mark);
+
+	return compiler.emitJump(condition ? Opcode::JumpIfTrue : Opcode::JumpIfFalse, reg);
+}
+
 /* ===== IdentifierNode ===== */
 
-IdentifierNode::IdentifierNode(const TokenMetaData& meta, shared_ptr<Scope> scope, string identifier)
-	: ASTNode(meta, move(scope)), _identifier(move(identifier)) {}
+IdentifierNode::IdentifierNode(uint32_t location, string identifier)
+	: ASTNode(location), _identifier(move(identifier)), _address({ -1, -1 }) {}
 
 bool IdentifierNode::isLValue() const {
 	return true;
@@ -52,16 +186,91 @@ bool IdentifierNode::isConst(const std::shared_ptr<Scope>& scope) const {
 	return scope->getInfo(_identifier)->is_const;
 }
 
+bool IdentifierNode::hasSideEffects() const {
+	return false;
+}
+
 void IdentifierNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << _identifier;
 }
 
-shared_ptr<Value> IdentifierNode::evaluate() const {
-	return scope()->getValue(_identifier);
+void IdentifierNode::resolve(Resolver& resolver) {
+	_address = resolver.lookup(_identifier);
+}
+
+ASTNode* IdentifierNode::optimize(Optimizer& optimizer) {
+	return optimizer.literal(*this, optimizer.constant(_address));
+}
+
+Value IdentifierNode::evaluate(Frame& frame) const {
+	if (!_address.isResolved()) {
+		throw UndefinedVariableError(_identifier);
+	}
+
+	return (*frame.ancestor(_address.depth))[_address.slot];
+}
+
+void IdentifierNode::assign(Frame& frame, Value rhs) const {
+	if (!_address.isResolved()) {
+		throw UndefinedVariableError(_identifier);
+	}
+
+	(*frame.ancestor(_address.depth))[_address.slot] = move(rhs);
+}
+
+int IdentifierNode::compile(Compiler& compiler, int destination) const {
+	if (!_address.isResolved()) {
+		throw UndefinedVariableError(_identifier);
+	}
+
+	if (destination == Compiler::discard) {
+		return destination;
+	}
+
+	// locals are registers already
+	if (_address.depth == 0) {
+		return compiler.move(destination, _address.slot);
+	}
+
+	int reg = compiler.target(destination);
+	compiler.emit(Opcode::GetOuter, reg, _address.depth, _address.slot);
+	return reg;
 }
 
-void IdentifierNode::assign(shared_ptr<Value> rhs) const {
-	scope()->setValue(str(), move(rhs));
+int IdentifierNode::compileAssignment(Compiler& compiler, Builtin op, const ASTNode& rhs, int destination) const {
+	if (!_address.isResolved()) {
+		throw UndefinedVariableError(_identifier);
+	}
+
+	auto mark = compiler.mark();
+	bool is_local = _address.depth == 0;
+
+	if (op == Builtin::Assignment) {
+		if (is_local) {
+			rhs.compile(compiler, _address.slot);
+		} else {
+			int value = rhs.compile(compiler, Compiler::any);
+			compiler.emit(Opcode::SetOuter, value, _address.depth, _address.slot);
+		}
+	} else {
+		int current = compile(compiler, Compiler::any);
+		if (rhs.hasSideEffects()) {
+			current = compiler.pin(current);
+		}
+
+		int value = rhs.compileOperand(compiler);
+
+		if (is_local) {
+			compiler.emit(getOperatorOpcode(op), _address.slot, current, value);
+		} else {
+			int result = compiler.temporary();
+			compiler.emit(getOperatorOpcode(op), result, current, value);
+			compiler.emit(Opcode::SetOuter, result, _address.depth, _address.slot);
+		}
+	}
+
+	compiler.release(mark);
+	return compiler.loadNull(destination);
 }
 
 const string& IdentifierNode::str() const {
@@ -70,60 +279,144 @@ const string& IdentifierNode::str() const {
 
 /* ===== NumberLiteralNode ===== */
 
-NumberLiteralNode::NumberLiteralNode(const TokenMetaData& meta, shared_ptr<Scope> scope, string number)
-	: ASTNode(meta, move(scope)), _number(stod(move(number))) {}
+NumberLiteralNode::NumberLiteralNode(uint32_t location, string number)
+	: ASTNode(location), _number(stod(move(number))) {}
+
+NumberLiteralNode::NumberLiteralNode(uint32_t location, double number)
+	: ASTNode(location), _number(number) {}
+
+bool NumberLiteralNode::hasSideEffects() const {
+	return false;
+}
 
 void NumberLiteralNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << _number;
 }
 
-shared_ptr<Value> NumberLiteralNode::evaluate() const {
-	return NumberValue::create(_number);
+Value NumberLiteralNode::literalValue() const {
+	return Value::number(_number);
+}
+
+Value NumberLiteralNode::evaluate(Frame& frame) const {
+	return Value::number(_number);
+}
+
+int NumberLiteralNode::compile(Compiler& compiler, int destination) const {
+	if (destination == Compiler::discard) {
+		return destination;
+	}
+
+	int reg = compiler.target(destination);
+	compiler.emit(Opcode::LoadConstant, reg, compiler.constant(_number));
+	return reg;
+}
+
+int NumberLiteralNode::compileOperand(Compiler& compiler) const {
+	return compiler.constantOperand(compiler.constant(_number));
 }
 
 /* ===== StringLiteralNode ===== */
 
-StringLiteralNode::StringLiteralNode(const TokenMetaData& meta, shared_ptr<Scope> scope, string str)
-	: ASTNode(meta, move(scope)), _str(move(str)) {}
+StringLiteralNode::StringLiteralNode(uint32_t location, string str)
+	: ASTNode(location), _str(move(str)), _value(StringValue::intern(_str)) {}
+
+bool StringLiteralNode::hasSideEffects() const {
+	return false;
+}
 
 void StringLiteralNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << "\"" << _str << "\"";
 }
 
-shared_ptr<Value> StringLiteralNode::evaluate() const {
-	return StringValue::create(_str);
+// strings are immutable, so every evaluation can share the one interned value
+Value StringLiteralNode::evaluate(Frame& frame) const {
+	return _value;
+}
+
+const Value& StringLiteralNode::value() const {
+	return _value;
+}
+
+int StringLiteralNode::compile(Compiler& compiler, int destination) const {
+	if (destination == Compiler::discard) {
+		return destination;
+	}
+
+	int reg = compiler.target(destination);
+	compiler.emit(Opcode::LoadConstant, reg, compiler.constant(_str));
+	return reg;
 }
 
 /* ===== BooleanLiteralNode ===== */
 
-BooleanLiteralNode::BooleanLiteralNode(const TokenMetaData& meta, shared_ptr<Scope> scope, bool boolean)
-	: ASTNode(meta, move(scope)), _boolean(boolean) {}
+BooleanLiteralNode::BooleanLiteralNode(uint32_t location, bool boolean)
+	: ASTNode(location), _boolean(boolean) {}
+
+bool BooleanLiteralNode::hasSideEffects() const {
+	return false;
+}
 
 void BooleanLiteralNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << (_boolean ? "true" : "false");
 }
 
-shared_ptr<Value> BooleanLiteralNode::evaluate() const {
-	return BooleanValue::create(_boolean);
+Value BooleanLiteralNode::literalValue() const {
+	return Value::boolean(_boolean);
+}
+
+Value BooleanLiteralNode::evaluate(Frame& frame) const {
+	return Value::boolean(_boolean);
+}
+
+int BooleanLiteralNode::compile(Compiler& compiler, int destination) const {
+	if (destination == Compiler::discard) {
+		return destination;
+	}
+
+	int reg = compiler.target(destination);
+	compiler.emit(Opcode::LoadBoolean, reg, _boolean ? 1 : 0);
+	return reg;
 }
 
 /* ===== NullLiteralNode ===== */
 
-NullLiteralNode::NullLiteralNode(const TokenMetaData& meta, shared_ptr<Scope> scope)
-	: ASTNode(meta, move(scope)) {}
+NullLiteralNode::NullLiteralNode(uint32_t location)
+	: ASTNode(location) {}
+
+bool NullLiteralNode::hasSideEffects() const {
+	return false;
+}
 
 void NullLiteralNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << "null";
 }
 
-shared_ptr<Value> NullLiteralNode::evaluate() const {
-	return NullValue::get();
+Value NullLiteralNode::literalValue() const {
+	return Value::null();
+}
+
+Value NullLiteralNode::evaluate(Frame& frame) const {
+	return Value::null();
+}
+
+int NullLiteralNode::compile(Compiler& compiler, int destination) const {
+	return compiler.loadNull(destination);
 }
 
 /* ===== ArrayLiteralNode ===== */
 
-ArrayLiteralNode::ArrayLiteralNode(const TokenMetaData& meta, shared_ptr<Scope> scope, vector<shared_ptr<ASTNode>> elements)
-	: ASTNode(meta, move(scope)), _elements(move(elements)) {}
+ArrayLiteralNode::ArrayLiteralNode(uint32_t location, vector<ASTNode*> elements)
+	: ASTNode(location), _elements(move(elements)) {}
+
+bool ArrayLiteralNode::hasSideEffects() const {
+	for (auto&& element : _elements) {
+		if (element->hasSideEffects()) {
+			return true;
+		}
+	}
+
+	return false;
+}
 
 void ArrayLiteralNode::output(ostream& out, int indent) const {
 	if (_elements.empty()) {
@@ -141,19 +434,67 @@ void ArrayLiteralNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << ")";
 }
 
-shared_ptr<Value> ArrayLiteralNode::evaluate() const {
-	vector<shared_ptr<Value>> elements;
+void ArrayLiteralNode::resolve(Resolver& resolver) {
+	for (auto&& element : _elements) {
+		element->resolve(resolver);
+	}
+}
+
+ASTNode* ArrayLiteralNode::optimize(Optimizer& optimizer) {
+	for (auto&& element : _elements) {
+		optimizer.visit(element);
+	}
+
+	return nullptr;
+}
+
+Value ArrayLiteralNode::evaluate(Frame& frame) const {
+	vector<Value> elements;
+	elements.reserve(_elements.size());
 
 	for (auto&& element_node : _elements) {
-		elements.push_back(element_node->evaluate());
+		elements.push_back(element_node->evaluate(frame));
 	}
 
-	return make_shared<ArrayValue>(move(elements));
+	return ArrayValue::create(move(elements));
+}
+
+int ArrayLiteralNode::compile(Compiler& compiler, int destination) const {
+	// the elements go in consecutive temporaries
+	auto mark = compiler.mark();
+
+	for (auto&& element : _elements) {
+		element->compile(compiler, compiler.temporary());
+	}
+
+	compiler.release(mark);
+
+	int reg = compiler.target(destination);
+	compiler.emit(Opcode::NewArray, reg, mark, _elements.size());
+	return reg;
 }
 
 /* ===== ObjectLiteralNode ===== */
-ObjectLiteralNode::ObjectLiteralNode(const TokenMetaData& meta, shared_ptr<Scope> scope, unordered_map<string, shared_ptr<ASTNode>> members)
-	: ASTNode(meta, move(scope)), _members(move(members)) {}
+ObjectLiteralNode::ObjectLiteralNode(uint32_t location, vector<pair<string, ASTNode*>> members)
+	: ASTNode(location), _members(move(members)), _shape(nullptr) {
+	// every object the literal makes has the same members in the same order, so they can share one shape
+	if (_members.size() <= Shape::max_shared_members) {
+		_shape = Shape::empty();
+		for (auto&& member : _members) {
+			_shape = _shape->withMember(StringValue::intern(member.first));
+		}
+	}
+}
+
+bool ObjectLiteralNode::hasSideEffects() const {
+	for (auto&& member : _members) {
+		if (member.second->hasSideEffects()) {
+			return true;
+		}
+	}
+
+	return false;
+}
 
 void ObjectLiteralNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << "(object";
@@ -165,20 +506,69 @@ void ObjectLiteralNode::output(ostream& out, int indent) const {
 	out << endl << io::indent(indent) << ")";
 }
 
-shared_ptr<Value> ObjectLiteralNode::evaluate() const {
-	unordered_map<string, shared_ptr<Value>> members;
+void ObjectLiteralNode::resolve(Resolver& resolver) {
+	for (auto&& member : _members) {
+		member.second->resolve(resolver);
+	}
+}
+
+ASTNode* ObjectLiteralNode::optimize(Optimizer& optimizer) {
+	for (auto&& member : _members) {
+		optimizer.visit(member.second);
+	}
+
+	return nullptr;
+}
+
+Value ObjectLiteralNode::evaluate(Frame& frame) const {
+	vector<Value> slots;
+	slots.reserve(_members.size());
+
+	for (auto&& member : _members) {
+		slots.push_back(member.second->evaluate(frame));
+	}
+
+	if (_shape) {
+		return ObjectValue::create(_shape, move(slots));
+	}
+
+	auto object = ObjectValue::create();
+	for (unsigned int i = 0; i < _members.size(); ++i) {
+		object.as<ObjectValue>()->setMember(_members[i].first, move(slots[i]));
+	}
+
+	return object;
+}
+
+int ObjectLiteralNode::compile(Compiler& compiler, int destination) const {
+	auto mark = compiler.mark();
+	int object = compiler.scratch(destination);
+	auto members_mark = compiler.mark();
+
+	compiler.emit(Opcode::NewObject, object);
 
 	for (auto&& member : _members) {
-		members.emplace(member.first, member.second->evaluate());
+		int value = member.second->compile(compiler, Compiler::any);
+		compiler.emit(Opcode::SetMember, object, compiler.member(member.first), value);
+		compiler.release(members_mark);
 	}
 
-	return make_shared<ObjectValue>(move(members));
+	if (destination == Compiler::any) {
+		return object;
+	}
+
+	compiler.release(mark);
+	return compiler.move(destination, object);
 }
 
 /* ===== SubscriptNode ===== */
 
-SubscriptNode::SubscriptNode(const TokenMetaData& meta, shared_ptr<Scope> scope, std::shared_ptr<ASTNode> lhs, std::shared_ptr<ASTNode> index)
-	: ASTNode(meta, move(scope)), _lhs(move(lhs)), _index(move(index)) {}
+SubscriptNode::SubscriptNode(uint32_t location, ASTNode* lhs, ASTNode* index)
+	: ASTNode(location), _lhs(move(lhs)), _index(move(index)), _evaluator(&SubscriptNode::evaluateUninitialized) {
+	if (auto key = dynamic_cast<StringLiteralNode*>(_index)) {
+		_member = key->value();
+	}
+}
 
 void SubscriptNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << "(subscript" << endl;
@@ -188,9 +578,63 @@ void SubscriptNode::output(ostream& out, int indent) const {
 	out << endl << io::indent(indent) << ")";
 }
 
-shared_ptr<Value> SubscriptNode::evaluate() const {
-	auto lhs = _lhs->evaluate();
-	return lhs->get(_index->evaluate());
+void SubscriptNode::resolve(Resolver& resolver) {
+	_lhs->resolve(resolver);
+	_index->resolve(resolver);
+}
+
+ASTNode* SubscriptNode::optimize(Optimizer& optimizer) {
+	optimizer.visit(_lhs);
+	optimizer.visit(_index);
+	return nullptr;
+}
+
+// specializes on the types it sees, like BinaryOperatorNode
+Value SubscriptNode::evaluate(Frame& frame) const {
+	return (this->*_evaluator)(frame);
+}
+
+Value SubscriptNode::evaluateUninitialized(Frame& frame) const {
+	auto lhs = _lhs->evaluate(frame);
+	auto index = _index->evaluate(frame);
+
+	if (lhs.type() == ValueType::Object && !_member.empty()) {
+		_evaluator = &SubscriptNode::evaluateObjectMember;
+	} else {
+		bool is_array_index = lhs.type() == ValueType::Array && index.isNumber();
+		_evaluator = is_array_index ? &SubscriptNode::evaluateArrayIndex : &SubscriptNode::evaluateGeneric;
+	}
+
+	return lhs.get(index);
+}
+
+Value SubscriptNode::evaluateArrayIndex(Frame& frame) const {
+	auto lhs = _lhs->evaluate(frame);
+	auto index = _index->evaluate(frame);
+
+	if (lhs.type() == ValueType::Array && index.isNumber()) {
+		return static_cast<const ArrayValue*>(lhs.heapValue())->getIndex(index.asNumber());
+	}
+
+	_evaluator = &SubscriptNode::evaluateGeneric;
+	return lhs.get(index);
+}
+
+// the index is a string literal, so there's nothing to evaluate
+Value SubscriptNode::evaluateObjectMember(Frame& frame) const {
+	auto lhs = _lhs->evaluate(frame);
+
+	if (lhs.type() == ValueType::Object) {
+		return static_cast<const ObjectValue*>(lhs.heapValue())->getMember(_member, _cache);
+	}
+
+	_evaluator = &SubscriptNode::evaluateGeneric;
+	return lhs.get(_member);
+}
+
+Value SubscriptNode::evaluateGeneric(Frame& frame) const {
+	auto lhs = _lhs->evaluate(frame);
+	return lhs.get(_index->evaluate(frame));
 }
 
 bool SubscriptNode::isLValue() const {
@@ -201,149 +645,530 @@ bool SubscriptNode::isConst(const std::shared_ptr<Scope>& scope) const {
 	return _lhs->isConst(scope);
 }
 
-void SubscriptNode::assign(shared_ptr<Value> rhs) const {
-	auto lhs = _lhs->evaluate();
-	lhs->set(_index->evaluate(), move(rhs));
+bool SubscriptNode::hasSideEffects() const {
+	return _lhs->hasSideEffects() || _index->hasSideEffects();
+}
+
+void SubscriptNode::assign(Frame& frame, Value rhs) const {
+	auto lhs = _lhs->evaluate(frame);
+	auto index = _index->evaluate(frame);
+
+	if (lhs.type() == ValueType::Array && index.isNumber()) {
+		static_cast<ArrayValue*>(lhs.heapValue())->setIndex(index.asNumber(), move(rhs));
+	} else if (lhs.type() == ValueType::Object && !_member.empty()) {
+		static_cast<ObjectValue*>(lhs.heapValue())->setMember(_member, move(rhs), _cache);
+	} else {
+		lhs.set(index, move(rhs));
+	}
+}
+
+// a string literal index compiles to the same member access as o.member
+int SubscriptNode::compile(Compiler& compiler, int destination) const {
+	auto mark = compiler.mark();
+
+	if (!_member.empty()) {
+		int object = _lhs->compile(compiler, Compiler::any);
+		compiler.release(mark);
+
+		int reg = compiler.target(destination);
+		compiler.emit(Opcode::GetMember, reg, object, compiler.member(toString(_member)));
+		return reg;
+	}
+
+	int container = _lhs->compile(compiler, Compiler::any);
+	if (_index->hasSideEffects()) {
+		container = compiler.pin(container);
+	}
+
+	int index = _index->compile(compiler, Compiler::any);
+	compiler.release(mark);
+
+	int reg = compiler.target(destination);
+	compiler.emit(Opcode::GetIndex, reg, container, index);
+	return reg;
+}
+
+int SubscriptNode::compileAssignment(Compiler& compiler, Builtin op, const ASTNode& rhs, int destination) const {
+	auto mark = compiler.mark();
+
+	int container = _lhs->compile(compiler, Compiler::any);
+	if (!_member.empty()) {
+		compileMemberAssignment(compiler, op, container, toString(_member), rhs);
+		compiler.release(mark);
+		return compiler.loadNull(destination);
+	}
+
+	int index = _index->compile(compiler, Compiler::any);
+
+	if (op == Builtin::Assignment) {
+		int value = rhs.compile(compiler, Compiler::any);
+		compiler.emit(Opcode::SetIndex, container, index, value);
+	} else {
+		int current = compiler.temporary();
+		compiler.emit(Opcode::GetIndex, current, container, index);
+
+		int value = rhs.compileOperand(compiler);
+		compiler.emit(getOperatorOpcode(op), current, current, value);
+		compiler.emit(Opcode::SetIndex, container, index, current);
+	}
+
+	compiler.release(mark);
+	return compiler.loadNull(destination);
 }
 
 /* ===== AccessMemberNode ===== */
 
-AccessMemberNode::AccessMemberNode(const TokenMetaData& meta, shared_ptr<Scope> scope, std::shared_ptr<ASTNode> lhs, std::string member)
-	: ASTNode(meta, move(scope)), _lhs(move(lhs)), _member(make_shared<StringValue>(move(member))) {}
+AccessMemberNode::AccessMemberNode(uint32_t location, ASTNode* lhs, std::string member)
+	: ASTNode(location), _lhs(move(lhs)), _member_name(member), _member(StringValue::intern(move(member))),
+	  _evaluator(&AccessMemberNode::evaluateUninitialized) {}
 
 bool AccessMemberNode::isLValue() const {
 	return _lhs->isLValue();
 }
 
-bool AccessMemberNode::isConst(const std::shared_ptr<Scope>& scope) const {
-	return _lhs->isConst(scope);
+bool AccessMemberNode::isConst(const std::shared_ptr<Scope>& scope) const {
+	return _lhs->isConst(scope);
+}
+
+bool AccessMemberNode::hasSideEffects() const {
+	return _lhs->hasSideEffects();
+}
+
+void AccessMemberNode::output(ostream& out, int indent) const {
+	out << io::indent(indent) << "(access" << endl;
+
+	_lhs->output(out, indent + 1);
+	out << endl << io::indent(indent + 1);
+	_member.output(out);
+	out << endl;
+
+	out << io::indent(indent) << ")";
+}
+
+void AccessMemberNode::resolve(Resolver& resolver) {
+	_lhs->resolve(resolver);
+}
+
+ASTNode* AccessMemberNode::optimize(Optimizer& optimizer) {
+	optimizer.visit(_lhs);
+	return nullptr;
+}
+
+// specializes on the types it sees, like BinaryOperatorNode. The specialized paths look the member up
+// by the name kept in the node, rather than copying it out of a string value each time, and objects
+// go through the node's inline cache
+Value AccessMemberNode::evaluate(Frame& frame) const {
+	return (this->*_evaluator)(frame);
+}
+
+Value AccessMemberNode::evaluateUninitialized(Frame& frame) const {
+	auto lhs = _lhs->evaluate(frame);
+
+	switch (lhs.type()) {
+		case ValueType::Object:
+			_evaluator = &AccessMemberNode::evaluateObjectMember;
+			break;
+		case ValueType::Array:
+			_evaluator = &AccessMemberNode::evaluateArrayMember;
+			break;
+		default:
+			_evaluator = &AccessMemberNode::evaluateGeneric;
+			break;
+	}
+
+	return lhs.get(_member);
+}
+
+Value AccessMemberNode::evaluateObjectMember(Frame& frame) const {
+	auto lhs = _lhs->evaluate(frame);
+
+	if (lhs.type() == ValueType::Object) {
+		return static_cast<const ObjectValue*>(lhs.heapValue())->getMember(_member, _cache);
+	}
+
+	_evaluator = &AccessMemberNode::evaluateGeneric;
+	return lhs.get(_member);
+}
+
+Value AccessMemberNode::evaluateArrayMember(Frame& frame) const {
+	auto lhs = _lhs->evaluate(frame);
+
+	if (lhs.type() == ValueType::Array) {
+		return static_cast<const ArrayValue*>(lhs.heapValue())->getMember(_member_name);
+	}
+
+	_evaluator = &AccessMemberNode::evaluateGeneric;
+	return lhs.get(_member);
+}
+
+Value AccessMemberNode::evaluateGeneric(Frame& frame) const {
+	auto lhs = _lhs->evaluate(frame);
+	return lhs.get(_member);
+}
+
+void AccessMemberNode::assign(Frame& frame, Value rhs) const {
+	auto lhs = _lhs->evaluate(frame);
+
+	if (lhs.type() == ValueType::Object) {
+		static_cast<ObjectValue*>(lhs.heapValue())->setMember(_member, move(rhs), _cache);
+	} else {
+		lhs.set(_member, move(rhs));
+	}
+}
+
+int AccessMemberNode::compile(Compiler& compiler, int destination) const {
+	auto mark = compiler.mark();
+	int object = _lhs->compile(compiler, Compiler::any);
+	compiler.release(mark);
+
+	int reg = compiler.target(destination);
+	compiler.emit(Opcode::GetMember, reg, object, compiler.member(toString(_member)));
+	return reg;
+}
+
+int AccessMemberNode::compileAssignment(Compiler& compiler, Builtin op, const ASTNode& rhs, int destination) const {
+	auto mark = compiler.mark();
+	int object = _lhs->compile(compiler, Compiler::any);
+	compileMemberAssignment(compiler, op, object, toString(_member), rhs);
+	compiler.release(mark);
+	return compiler.loadNull(destination);
+}
+
+/* ===== BinaryOperatorNode ===== */
+
+BinaryOperatorNode::BinaryOperatorNode(uint32_t location, Builtin op, ASTNode* left, ASTNode* right)
+	: ASTNode(location), _op(op), _left(move(left)), _right(move(right)), _evaluator(&BinaryOperatorNode::evaluateUninitialized),
+	  _right_number(0) {}
+
+bool BinaryOperatorNode::hasSideEffects() const {
+	if (isAssignmentOperator(getBuiltinInfo(_op))) {
+		return true;
+	}
+
+	return _left->hasSideEffects() || _right->hasSideEffects();
+}
+
+void BinaryOperatorNode::output(ostream& out, int indent) const {
+	out << io::indent(indent) << "(" << getBuiltinString(_op) << "\n";
+
+	_left->output(out, indent + 1);
+	out << "\n";
+	_right->output(out, indent + 1);
+	out << "\n";
+
+	out << io::indent(indent) << ")";
+}
+
+void BinaryOperatorNode::resolve(Resolver& resolver) {
+	_left->resolve(resolver);
+	_right->resolve(resolver);
+}
+
+ASTNode* BinaryOperatorNode::optimize(Optimizer& optimizer) {
+	optimizer.visit(_left);
+	optimizer.visit(_right);
+
+	if (isAssignmentOperator(getBuiltinInfo(_op))) {
+		return nullptr;
+	}
+
+	auto rhs = _right->literalValue();
+	if (!rhs.empty() && !_left->literalValue().empty()) {
+		return optimizer.fold(*this);
+	}
+
+	// squaring is a single multiply, instead of a call to powl
+	if (_op == Builtin::Exponent && rhs.isNumber() && rhs.asNumber() == 2 && !_left->hasSideEffects()) {
+		return optimizer.tree().make<BinaryOperatorNode>(_location, Builtin::Multiplication, _left, _left);
+	}
+
+	return nullptr;
+}
+
+// Operators specialize themselves on the operand types they see, the way self-specializing tree
+// interpreters do. The first run picks an evaluator for the types it got, and when a specialized
+// evaluator's guard fails the node falls back to the generic one for good, so it never flip-flops
+Value BinaryOperatorNode::evaluate(Frame& frame) const {
+	return (this->*_evaluator)(frame);
+}
+
+Value BinaryOperatorNode::evaluateUninitialized(Frame& frame) const {
+	if (_op == Builtin::LogicalAnd || _op == Builtin::LogicalOr) {
+		_evaluator = &BinaryOperatorNode::evaluateGeneric;
+		return evaluateGeneric(frame);
+	}
+
+	auto lhs = _left->evaluate(frame);
+	auto rhs = _right->evaluate(frame);
+
+	Evaluator specialized = nullptr;
+	if (lhs.isNumber() && rhs.isNumber()) {
+		specialized = numberEvaluator();
+	}
+
+	_evaluator = specialized ? specialized : &BinaryOperatorNode::evaluateGeneric;
+	return apply(frame, lhs, rhs);
+}
+
+Value BinaryOperatorNode::evaluateGeneric(Frame& frame) const {
+	// Short circuit evaluate logical operators
+	switch (_op) {
+		case Builtin::LogicalAnd:
+			if (toBoolean(_left->evaluate(frame))) {
+				return Value::boolean(toBoolean(_right->evaluate(frame)));
+			} else {
+				return Value::boolean(false);
+			}
+		case Builtin::LogicalOr:
+			if (toBoolean(_left->evaluate(frame))) {
+				return Value::boolean(true);
+			} else {
+				return Value::boolean(toBoolean(_right->evaluate(frame)));
+			}
+		default:
+			break;
+	}
+
+	auto lhs = _left->evaluate(frame);
+	auto rhs = _right->evaluate(frame);
+	return apply(frame, lhs, rhs);
 }
 
-void AccessMemberNode::output(ostream& out, int indent) const {
-	out << io::indent(indent) << "(access" << endl;
+template <typename Op, bool constant_rhs>
+Value BinaryOperatorNode::evaluateNumbers(Frame& frame) const {
+	auto lhs = _left->evaluate(frame);
+	auto rhs = constant_rhs ? Value::number(_right_number) : _right->evaluate(frame);
 
-	_lhs->output(out, indent + 1);
-	out << endl << io::indent(indent + 1) << _member << endl;
+	if (lhs.isNumber() && rhs.isNumber()) {
+		return toValue(Op()(lhs.asNumber(), rhs.asNumber()));
+	}
 
-	out << io::indent(indent) << ")";
+	_evaluator = &BinaryOperatorNode::evaluateGeneric;
+	return apply(frame, lhs, rhs);
 }
 
-shared_ptr<Value> AccessMemberNode::evaluate() const {
-	auto lhs = _lhs->evaluate();
-	return lhs->get(_member);
-}
+template <typename Op, bool constant_rhs>
+Value BinaryOperatorNode::evaluateNumberAssignment(Frame& frame) const {
+	auto lhs = _left->evaluate(frame);
+	auto rhs = constant_rhs ? Value::number(_right_number) : _right->evaluate(frame);
 
-void AccessMemberNode::assign(shared_ptr<Value> rhs) const {
-	auto lhs = _lhs->evaluate();
-	lhs->set(_member, move(rhs));
-}
+	if (lhs.isNumber() && rhs.isNumber()) {
+		_left->assign(frame, Value::number(Op()(lhs.asNumber(), rhs.asNumber())));
+		return Value::null();
+	}
 
-/* ===== BinaryOperatorNode ===== */
+	_evaluator = &BinaryOperatorNode::evaluateGeneric;
+	return apply(frame, lhs, rhs);
+}
 
-BinaryOperatorNode::BinaryOperatorNode(const TokenMetaData& meta, shared_ptr<Scope> scope, Builtin op, shared_ptr<ASTNode> left, shared_ptr<ASTNode> right)
-	: ASTNode(meta, move(scope)), _op(op), _left(move(left)), _right(move(right)) {}
+// a number literal on the right, as in i < n or i += 1, is read straight out of the node
+template <typename Op>
+BinaryOperatorNode::Evaluator BinaryOperatorNode::numberEvaluator(bool assignment) const {
+	auto rhs = _right->literalValue();
+	bool constant_rhs = rhs.isNumber();
 
-void BinaryOperatorNode::output(ostream& out, int indent) const {
-	out << io::indent(indent) << "(" << getBuiltinString(_op) << "\n";
+	if (constant_rhs) {
+		_right_number = rhs.asNumber();
+	}
 
-	_left->output(out, indent + 1);
-	out << "\n";
-	_right->output(out, indent + 1);
-	out << "\n";
+	if (assignment) {
+		return constant_rhs ? &BinaryOperatorNode::evaluateNumberAssignment<Op, true> : &BinaryOperatorNode::evaluateNumberAssignment<Op, false>;
+	}
 
-	out << io::indent(indent) << ")";
+	return constant_rhs ? &BinaryOperatorNode::evaluateNumbers<Op, true> : &BinaryOperatorNode::evaluateNumbers<Op, false>;
 }
 
-shared_ptr<Value> BinaryOperatorNode::evaluate() const {
-	// Short circuit evaluate logical operators
+// the specialized evaluator for numeric operands, or nullptr if the operator doesn't have one
+BinaryOperatorNode::Evaluator BinaryOperatorNode::numberEvaluator() const {
 	switch (_op) {
-		case Builtin::LogicalAnd:
-			if (toBoolean(_left->evaluate())) {
-				return BooleanValue::create(toBoolean(_right->evaluate()));
-			} else {
-				return BooleanValue::create(false);
-			}
-		case Builtin::LogicalOr:
-			if (toBoolean(_left->evaluate())) {
-				return BooleanValue::create(true);
-			} else {
-				return BooleanValue::create(toBoolean(_right->evaluate()));
-			}
+		case Builtin::AdditionAssignment:
+			return numberEvaluator<plus<double>>(true);
+		case Builtin::SubtractionAssignment:
+			return numberEvaluator<minus<double>>(true);
+		case Builtin::MultiplicationAssignment:
+			return numberEvaluator<multiplies<double>>(true);
+		case Builtin::DivisionAssignment:
+			return numberEvaluator<divides<double>>(true);
+		case Builtin::ModulusAssignment:
+			return numberEvaluator<Modulus>(true);
+		case Builtin::ExponentAssignment:
+			return numberEvaluator<Exponent>(true);
+
+		case Builtin::Addition:
+			return numberEvaluator<plus<double>>(false);
+		case Builtin::Subtraction:
+			return numberEvaluator<minus<double>>(false);
+		case Builtin::Multiplication:
+			return numberEvaluator<multiplies<double>>(false);
+		case Builtin::Division:
+			return numberEvaluator<divides<double>>(false);
+		case Builtin::Modulus:
+			return numberEvaluator<Modulus>(false);
+		case Builtin::Exponent:
+			return numberEvaluator<Exponent>(false);
+
+		case Builtin::LessThan:
+			return numberEvaluator<less<double>>(false);
+		case Builtin::LessThanOrEqual:
+			return numberEvaluator<less_equal<double>>(false);
+		case Builtin::GreaterThan:
+			return numberEvaluator<greater<double>>(false);
+		case Builtin::GreaterThanOrEqual:
+			return numberEvaluator<greater_equal<double>>(false);
+		case Builtin::EqualTo:
+			return numberEvaluator<equal_to<double>>(false);
+		case Builtin::NotEqualTo:
+			return numberEvaluator<not_equal_to<double>>(false);
+
 		default:
-			break;
+			return nullptr;
 	}
+}
 
-	auto add = [](double x, double y) { return x + y; };
+Value BinaryOperatorNode::apply(Frame& frame, const Value& lhs, const Value& rhs) const {
 	auto subtract = [](double x, double y) { return x - y; };
 	auto multiply = [](double x, double y) { return x * y; };
 	auto divide = [](double x, double y) { return x / y; };
 
-	auto lhs = _left->evaluate();
-	auto rhs = _right->evaluate();
-
 	switch (_op) {
 		// Assignments
 		case Builtin::Assignment:
-			_left->assign(move(rhs));
+			_left->assign(frame, rhs);
 			break;
 		case Builtin::AdditionAssignment:
-			_left->assign(NumberValue::applyOperator(lhs, rhs, add));
+			_left->assign(frame, addValues(lhs, rhs));
 			break;
 		case Builtin::SubtractionAssignment:
-			_left->assign(NumberValue::applyOperator(lhs, rhs, subtract));
+			_left->assign(frame, applyNumberOperator(lhs, rhs, subtract));
 			break;
 		case Builtin::MultiplicationAssignment:
-			_left->assign(NumberValue::applyOperator(lhs, rhs, multiply));
+			_left->assign(frame, applyNumberOperator(lhs, rhs, multiply));
 			break;
 		case Builtin::DivisionAssignment:
-			_left->assign(NumberValue::applyOperator(lhs, rhs, divide));
+			_left->assign(frame, applyNumberOperator(lhs, rhs, divide));
 			break;
 		case Builtin::ModulusAssignment:
-			_left->assign(NumberValue::applyOperator(lhs, rhs, fmodl));
+			_left->assign(frame, applyNumberOperator(lhs, rhs, numberModulus));
 			break;
 		case Builtin::ExponentAssignment:
-			_left->assign(NumberValue::applyOperator(lhs, rhs, powl));
+			_left->assign(frame, applyNumberOperator(lhs, rhs, powl));
 			break;
 
 		// Arithmetic
 		case Builtin::Addition:
-			return NumberValue::applyOperator(lhs, rhs, add);
+			return addValues(lhs, rhs);
 		case Builtin::Subtraction:
-			return NumberValue::applyOperator(lhs, rhs, subtract);
+			return applyNumberOperator(lhs, rhs, subtract);
 		case Builtin::Multiplication:
-			return NumberValue::applyOperator(lhs, rhs, multiply);
+			return applyNumberOperator(lhs, rhs, multiply);
 		case Builtin::Division:
-			return NumberValue::applyOperator(lhs, rhs, divide);
+			return applyNumberOperator(lhs, rhs, divide);
 		case Builtin::Modulus:
-			return NumberValue::applyOperator(lhs, rhs, fmodl);
+			return applyNumberOperator(lhs, rhs, numberModulus);
 		case Builtin::Exponent:
-			return NumberValue::applyOperator(lhs, rhs, powl);
+			return applyNumberOperator(lhs, rhs, powl);
 
 		// Comparisons
 		case Builtin::LessThan:
-			return BooleanValue::create(toNumber(lhs) < toNumber(rhs));
+			return Value::boolean(toNumber(lhs) < toNumber(rhs));
 		case Builtin::LessThanOrEqual:
-			return BooleanValue::create(toNumber(lhs) <= toNumber(rhs));
+			return Value::boolean(toNumber(lhs) <= toNumber(rhs));
 		case Builtin::GreaterThan:
-			return BooleanValue::create(toNumber(lhs) > toNumber(rhs));
+			return Value::boolean(toNumber(lhs) > toNumber(rhs));
 		case Builtin::GreaterThanOrEqual:
-			return BooleanValue::create(toNumber(lhs) >= toNumber(rhs));
+			return Value::boolean(toNumber(lhs) >= toNumber(rhs));
 		case Builtin::EqualTo:
-			return BooleanValue::create(toNumber(lhs) == toNumber(rhs));
+			return Value::boolean(toNumber(lhs) == toNumber(rhs));
 		case Builtin::NotEqualTo:
-			return BooleanValue::create(toNumber(lhs) != toNumber(rhs));
+			return Value::boolean(toNumber(lhs) != toNumber(rhs));
 
 		default:
 			throw InterpretorError("operator not implemented");
 	}
 
-	return NullValue::get();
+	return Value::null();
+}
+
+int BinaryOperatorNode::compile(Compiler& compiler, int destination) const {
+	switch (_op) {
+		case Builtin::LogicalAnd:
+		case Builtin::LogicalOr: {
+			// the result is built up in a temporary, so a variable being assigned to isn't written early
+			auto mark = compiler.mark();
+			int result = compiler.scratch(destination);
+
+			_left->compile(compiler, result);
+			compiler.emit(Opcode::ToBoolean, result, result);
+			auto short_circuit = compiler.emitJump(_op == Builtin::LogicalAnd ? Opcode::JumpIfFalse : Opcode::JumpIfTrue, result);
+
+			_right->compile(compiler, result);
+			compiler.emit(Opcode::ToBoolean, result, result);
+			compiler.patchJump(short_circuit);
+
+			if (destination == Compiler::any) {
+				return result;
+			}
+
+			compiler.release(mark);
+			return compiler.move(destination, result);
+		}
+		case Builtin::Assignment:
+		case Builtin::AdditionAssignment:
+		case Builtin::SubtractionAssignment:
+		case Builtin::MultiplicationAssignment:
+		case Builtin::DivisionAssignment:
+		case Builtin::ModulusAssignment:
+		case Builtin::ExponentAssignment:
+			return _left->compileAssignment(compiler, _op, *_right, destination);
+		default:
+			break;
+	}
+
+	auto op = getOperatorOpcode(_op);
+	auto mark = compiler.mark();
+
+	int lhs, rhs;
+	compileOperands(compiler, lhs, rhs);
+	compiler.release(mark);
+
+	int reg = compiler.target(destination);
+	compiler.emit(op, reg, lhs, rhs);
+	return reg;
+}
+
+int BinaryOperatorNode::compileJump(Compiler& compiler, bool condition) const {
+	auto op = getTestOpcode(_op);
+	if (op == Opcode::Halt) {
+		return ASTNode::compileJump(compiler, condition);
+	}
+
+	auto mark = compiler.mark();
+
+	int lhs, rhs;
+	compileOperands(compiler, lhs, rhs);
+	compiler.release(mark);
+
+	compiler.emit(op, condition, lhs, rhs);
+	return compiler.emitJump(Opcode::Jump);
+}
+
+void BinaryOperatorNode::compileOperands(Compiler& compiler, int& lhs, int& rhs) const {
+	lhs = _left->compileOperand(compiler);
+	if (_right->hasSideEffects()) {
+		lhs = compiler.pin(lhs);
+	}
+
+	rhs = _right->compileOperand(compiler);
 }
 
 /* ===== UnaryOperatorNode ===== */
 
-UnaryOperatorNode::UnaryOperatorNode(const TokenMetaData& meta, shared_ptr<Scope> scope, Builtin op, shared_ptr<ASTNode> expr)
-	: ASTNode(meta, move(scope)), _op(op), _expr(move(expr)) {}
+UnaryOperatorNode::UnaryOperatorNode(uint32_t location, Builtin op, ASTNode* expr)
+	: ASTNode(location), _op(op), _expr(move(expr)) {}
+
+bool UnaryOperatorNode::hasSideEffects() const {
+	return _expr->hasSideEffects();
+}
 
 void UnaryOperatorNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << "(" << getBuiltinString(_op) << "\n";
@@ -354,32 +1179,69 @@ void UnaryOperatorNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << ")";
 }
 
-shared_ptr<Value> UnaryOperatorNode::evaluate() const {
-	auto expr = _expr->evaluate();
+void UnaryOperatorNode::resolve(Resolver& resolver) {
+	_expr->resolve(resolver);
+}
+
+ASTNode* UnaryOperatorNode::optimize(Optimizer& optimizer) {
+	optimizer.visit(_expr);
+
+	if (!_expr->literalValue().empty()) {
+		return optimizer.fold(*this);
+	}
+
+	return nullptr;
+}
+
+Value UnaryOperatorNode::evaluate(Frame& frame) const {
+	auto expr = _expr->evaluate(frame);
 
 	switch (_op) {
 		// Arithmetic
 		case Builtin::Negation:
-			return NumberValue::create(-toNumber(expr));
+			return Value::number(-toNumber(expr));
 
 		// Logical
 		case Builtin::LogicalNot:
-			return BooleanValue::create(!toBoolean(expr));
+			return Value::boolean(!toBoolean(expr));
+
+		default:
+			throw InterpretorError("operator not implemented");
+	}
+}
 
+int UnaryOperatorNode::compile(Compiler& compiler, int destination) const {
+	Opcode op;
+
+	switch (_op) {
+		case Builtin::Negation:
+			op = Opcode::Negate;
+			break;
+		case Builtin::LogicalNot:
+			op = Opcode::Not;
+			break;
 		default:
 			throw InterpretorError("operator not implemented");
 	}
+
+	auto mark = compiler.mark();
+	int operand = _expr->compile(compiler, Compiler::any);
+	compiler.release(mark);
+
+	int reg = compiler.target(destination);
+	compiler.emit(op, reg, operand);
+	return reg;
 }
 
 /* ===== FunctionCallNode ===== */
 
-FunctionCallNode::FunctionCallNode(const TokenMetaData& meta, shared_ptr<Scope> scope, shared_ptr<ASTNode> caller, vector<shared_ptr<ASTNode>> arguments)
-	: ASTNode(meta, move(scope)), _caller(move(caller)), _arguments(move(arguments)) {}
+FunctionCallNode::FunctionCallNode(uint32_t location, ASTNode* caller, vector<ASTNode*> arguments)
+	: ASTNode(location), _caller(move(caller)), _arguments(move(arguments)) {}
 
 void FunctionCallNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << "(";
 
-	auto identifier = dynamic_pointer_cast<IdentifierNode>(_caller);
+	auto identifier = dynamic_cast<IdentifierNode*>(_caller);
 	if (identifier) {
 		identifier->output(out, 0);
 	} else {
@@ -397,26 +1259,61 @@ void FunctionCallNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << ")";
 }
 
-shared_ptr<Value> FunctionCallNode::evaluate() const {
-	auto caller = _caller->evaluate();
-	if (caller->type() != ValueType::Function) {
+void FunctionCallNode::resolve(Resolver& resolver) {
+	_caller->resolve(resolver);
+
+	for (auto&& argument : _arguments) {
+		argument->resolve(resolver);
+	}
+}
+
+ASTNode* FunctionCallNode::optimize(Optimizer& optimizer) {
+	optimizer.visit(_caller);
+
+	for (auto&& argument : _arguments) {
+		optimizer.visit(argument);
+	}
+
+	return nullptr;
+}
+
+Value FunctionCallNode::evaluate(Frame& frame) const {
+	auto caller = _caller->evaluate(frame);
+	if (caller.type() != ValueType::Function) {
 		throw TypeError("Expression is not of type Function");
 	}
 
-	auto func = static_pointer_cast<FunctionValue>(caller);
-	vector<shared_ptr<Value>> arguments;
+	auto func = caller.as<FunctionValue>();
+	vector<Value> arguments;
+	arguments.reserve(_arguments.size());
 
 	for (auto&& argument_node : _arguments) {
-		arguments.push_back(argument_node->evaluate());
+		arguments.push_back(argument_node->evaluate(frame));
 	}
 
 	return func->call(move(arguments));
 }
 
+int FunctionCallNode::compile(Compiler& compiler, int destination) const {
+	// the function and its arguments go in consecutive temporaries
+	auto mark = compiler.mark();
+	_caller->compile(compiler, compiler.temporary());
+
+	for (auto&& argument : _arguments) {
+		argument->compile(compiler, compiler.temporary());
+	}
+
+	compiler.release(mark);
+
+	int reg = compiler.target(destination);
+	compiler.emit(Opcode::Call, reg, mark, _arguments.size());
+	return reg;
+}
+
 /* ===== BlockNode ===== */
 
-BlockNode::BlockNode(const TokenMetaData& meta, shared_ptr<Scope> scope, bool is_new_scope, vector<shared_ptr<ASTNode>> statements)
-	: ASTNode(meta, move(scope)), _is_new_scope(is_new_scope), _statements(move(statements)) {}
+BlockNode::BlockNode(uint32_t location, bool is_new_scope, vector<ASTNode*> statements)
+	: ASTNode(location), _is_new_scope(is_new_scope), _statements(move(statements)) {}
 
 bool BlockNode::isNewScope() const {
 	return _is_new_scope;
@@ -439,27 +1336,48 @@ void BlockNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << ")";
 }
 
-shared_ptr<Value> BlockNode::evaluate() const {
-	shared_ptr<Value> return_value = nullptr;
+void BlockNode::resolve(Resolver& resolver) {
+	resolver.pushBlock();
+
+	for (auto&& statement : _statements) {
+		statement->resolve(resolver);
+	}
+
+	resolver.popBlock();
+}
+
+ASTNode* BlockNode::optimize(Optimizer& optimizer) {
+	for (auto&& statement : _statements) {
+		optimizer.visit(statement);
+	}
+
+	return nullptr;
+}
 
+Completion BlockNode::execute(Frame& frame) const {
 	for (auto&& statement : _statements) {
-		auto val = statement->evaluate();
+		auto completion = statement->execute(frame);
 
-		if (val && val->type() == ValueType::Sentinel) {
-			return_value = val;
-			break;
+		if (!completion.isNormal()) {
+			return completion;
 		}
 	}
 
-	scope()->clearValues();
+	return {};
+}
+
+int BlockNode::compile(Compiler& compiler, int destination) const {
+	for (auto&& statement : _statements) {
+		statement->compile(compiler, Compiler::discard);
+	}
 
-	return return_value;
+	return compiler.loadNull(destination);
 }
 
 /* ===== IfStatementNode ===== */
 
-IfStatementNode::IfStatementNode(const TokenMetaData& meta, shared_ptr<Scope> scope, shared_ptr<ASTNode> condition, shared_ptr<ASTNode> then_statement, shared_ptr<ASTNode> else_statement)
-	: ASTNode(meta, move(scope)), _condition(move(condition)), _then(move(then_statement)), _else(move(else_statement)) {}
+IfStatementNode::IfStatementNode(uint32_t location, ASTNode* condition, ASTNode* then_statement, ASTNode* else_statement)
+	: ASTNode(location), _condition(move(condition)), _then(move(then_statement)), _else(move(else_statement)) {}
 
 void IfStatementNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << "(if" << endl;
@@ -488,30 +1406,76 @@ void IfStatementNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << ")";
 }
 
-shared_ptr<Value> IfStatementNode::evaluate() const {
-	auto condition = _condition->evaluate();
-	if (!condition) {
+void IfStatementNode::resolve(Resolver& resolver) {
+	_condition->resolve(resolver);
+	_then->resolve(resolver);
+
+	if (_else) {
+		_else->resolve(resolver);
+	}
+}
+
+ASTNode* IfStatementNode::optimize(Optimizer& optimizer) {
+	optimizer.visit(_condition);
+	optimizer.visit(_then);
+	optimizer.visit(_else);
+
+	// a condition that isn't a Boolean is left for the program to report when it runs
+	auto condition = _condition->literalValue();
+	if (!condition.isBoolean()) {
+		return nullptr;
+	}
+
+	if (condition.asBoolean()) {
+		return _then;
+	}
+
+	if (_else) {
+		return _else;
+	}
+
+	return optimizer.tree().make<BlockNode>(_location, true, vector<ASTNode*>());
+}
+
+Completion IfStatementNode::execute(Frame& frame) const {
+	auto condition = _condition->evaluate(frame);
+	if (condition.empty()) {
 		throw InterpretorError("condition is null");
 	}
 
-	if (condition->type() != ValueType::Boolean) {
+	if (!condition.isBoolean()) {
 		throw TypeError("Condition is not of type Boolean");
 	}
 
-	bool condition_value = static_pointer_cast<BooleanValue>(condition)->valueOf();
-	if (condition_value) {
-		return _then->evaluate();
+	if (condition.asBoolean()) {
+		return _then->execute(frame);
 	} else if (_else) {
-		return _else->evaluate();
+		return _else->execute(frame);
 	}
 
-	return nullptr;
+	return {};
+}
+
+int IfStatementNode::compile(Compiler& compiler, int destination) const {
+	auto skip_then = _condition->compileJump(compiler, false);
+	_then->compile(compiler, Compiler::discard);
+
+	if (_else) {
+		auto skip_else = compiler.emitJump(Opcode::Jump);
+		compiler.patchJump(skip_then);
+		_else->compile(compiler, Compiler::discard);
+		compiler.patchJump(skip_else);
+	} else {
+		compiler.patchJump(skip_then);
+	}
+
+	return compiler.loadNull(destination);
 }
 
 /* ===== WhileStatementNode ===== */
 
-WhileStatementNode::WhileStatementNode(const TokenMetaData& meta, shared_ptr<Scope> scope, std::shared_ptr<ASTNode> condition, std::shared_ptr<ASTNode> loop)
-	: ASTNode(meta, move(scope)), _condition(move(condition)), _loop(move(loop)) {}
+WhileStatementNode::WhileStatementNode(uint32_t location, ASTNode* condition, ASTNode* loop)
+	: ASTNode(location), _condition(move(condition)), _loop(move(loop)) {}
 
 void WhileStatementNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << "(while" << endl;
@@ -533,44 +1497,73 @@ void WhileStatementNode::output(ostream& out, int indent) const {
 	out << endl << io::indent(indent) << ")";
 }
 
-shared_ptr<Value> WhileStatementNode::evaluate() const {
+void WhileStatementNode::resolve(Resolver& resolver) {
+	_condition->resolve(resolver);
+	_loop->resolve(resolver);
+}
+
+ASTNode* WhileStatementNode::optimize(Optimizer& optimizer) {
+	optimizer.visit(_condition);
+	optimizer.visit(_loop);
+
+	auto condition = _condition->literalValue();
+	if (condition.isBoolean() && !condition.asBoolean()) {
+		return optimizer.tree().make<BlockNode>(_location, true, vector<ASTNode*>());
+	}
+
+	return nullptr;
+}
+
+Completion WhileStatementNode::execute(Frame& frame) const {
 	while (true) {
-		auto condition = _condition->evaluate();
+		auto condition = _condition->evaluate(frame);
 
-		if (!condition) {
+		if (condition.empty()) {
 			throw InterpretorError("condition is null");
 		}
 
-		if (condition->type() != ValueType::Boolean) {
+		if (!condition.isBoolean()) {
 			throw TypeError("Condition is not of type Boolean");
 		}
 
-		bool condition_value = static_pointer_cast<BooleanValue>(condition)->valueOf();
-		if (!condition_value) {
+		if (!condition.asBoolean()) {
 			break;
 		}
 
-		auto val = _loop->evaluate();
+		auto completion = _loop->execute(frame);
 
-		if (val && val->type() == ValueType::Sentinel) {
-			auto sentinel = static_pointer_cast<SentinelValue>(val);
-			if (sentinel->isBreak()) {
-				break;
-			} else if (sentinel->isContinue()) {
-				continue;
-			} else if (sentinel->isReturn()) {
-				return sentinel;
-			}
+		if (completion.type == CompletionType::Break) {
+			break;
+		} else if (completion.type == CompletionType::Return) {
+			return completion;
 		}
 	}
 
-	return NullValue::get();
+	return {};
+}
+
+int WhileStatementNode::compile(Compiler& compiler, int destination) const {
+	// the condition is tested at the bottom of the loop, so each iteration takes a single jump
+	auto enter = compiler.emitJump(Opcode::Jump);
+	int body = compiler.here();
+
+	compiler.pushLoop();
+	_loop->compile(compiler, Compiler::discard);
+
+	int test = compiler.here();
+	compiler.patchJump(enter);
+
+	auto repeat = _condition->compileJump(compiler, true);
+	compiler.patchJump(repeat, body);
+	compiler.popLoop(test);
+
+	return compiler.loadNull(destination);
 }
 
 /* ===== ForStatementNode ===== */
 
-ForStatementNode::ForStatementNode(const TokenMetaData& meta, shared_ptr<Scope> scope, bool is_const, string iterator_name, shared_ptr<ASTNode> array_expr, std::shared_ptr<ASTNode> loop_block)
-	: ASTNode(meta, move(scope)), _is_const(is_const), _iterator_name(move(iterator_name)),
+ForStatementNode::ForStatementNode(uint32_t location, bool is_const, string iterator_name, ASTNode* array_expr, ASTNode* loop_block)
+	: ASTNode(location), _is_const(is_const), _iterator_name(move(iterator_name)), _iterator_slot(-1),
 	  _array(move(array_expr)), _loop(move(loop_block)) {}
 
 void ForStatementNode::output(ostream& out, int indent) const {
@@ -583,44 +1576,107 @@ void ForStatementNode::output(ostream& out, int indent) const {
 	out << endl << io::indent(indent) << ")";
 }
 
-shared_ptr<Value> ForStatementNode::evaluate() const {
-	auto expr = _array->evaluate();
-	if (expr->type() != ValueType::Array) {
+void ForStatementNode::resolve(Resolver& resolver) {
+	// the parser declares the iterator in the enclosing block, before the array expression
+	_iterator_slot = resolver.declare(_iterator_name);
+	_array->resolve(resolver);
+	_loop->resolve(resolver);
+}
+
+ASTNode* ForStatementNode::optimize(Optimizer& optimizer) {
+	optimizer.visit(_array);
+	optimizer.visit(_loop);
+	return nullptr;
+}
+
+Completion ForStatementNode::execute(Frame& frame) const {
+	auto expr = _array->evaluate(frame);
+	if (expr.type() == ValueType::Lines) {
+		return executeLines(frame, *expr.as<LinesValue>());
+	}
+
+	// a buffer goes through its bytes
+	const ArrayValue* array_expr = nullptr;
+	string_view bytes;
+	size_t length;
+
+	if (expr.type() == ValueType::Array) {
+		array_expr = expr.as<ArrayValue>();
+		length = array_expr->length();
+	} else if (expr.type() == ValueType::Buffer) {
+		bytes = expr.as<BufferValue>()->text();
+		length = bytes.size();
+	} else {
 		throw TypeError("Expression not of type Array");
 	}
 
-	auto scope = this->scope();
-	auto array_expr = static_pointer_cast<ArrayValue>(expr);
-	auto length = array_expr->length();
+	for (size_t i = 0; i < length; ++i) {
+		if (array_expr) {
+			frame[_iterator_slot] = array_expr->get(static_cast<unsigned int>(i));
+		} else {
+			frame[_iterator_slot] = Value::number(static_cast<unsigned char>(bytes[i]));
+		}
+
+		auto completion = _loop->execute(frame);
 
-	for (unsigned int i = 0; i < length; ++i) {
-		auto iter_expr = array_expr->get(i);
-		if (!iter_expr->isReferenceType()) {
-			iter_expr = iter_expr->copy();
+		if (completion.type == CompletionType::Break) {
+			break;
+		} else if (completion.type == CompletionType::Return) {
+			return completion;
 		}
+	}
 
-		scope->setValue(_iterator_name, move(iter_expr));
+	return {};
+}
 
-		auto loop_value = _loop->evaluate();
-		if (loop_value && loop_value->type() == ValueType::Sentinel) {
-			auto sentinel = static_pointer_cast<SentinelValue>(loop_value);
-			if (sentinel->isBreak()) {
-				break;
-			}
+Completion ForStatementNode::executeLines(Frame& frame, const LinesValue& lines) const {
+	auto size = lines.buffer().text().size();
 
-			if (sentinel->isReturn()) {
-				return sentinel;
-			}
+	for (size_t position = 0; position < size; ) {
+		frame[_iterator_slot] = lines.line(position);
+
+		auto completion = _loop->execute(frame);
+
+		if (completion.type == CompletionType::Break) {
+			break;
+		} else if (completion.type == CompletionType::Return) {
+			return completion;
 		}
 	}
 
-	return NullValue::get();
+	return {};
+}
+
+int ForStatementNode::compile(Compiler& compiler, int destination) const {
+	// the array, the index and the length are kept in three consecutive temporaries
+	auto mark = compiler.mark();
+	int array = compiler.temporary();
+	compiler.temporary();
+	compiler.temporary();
+
+	_array->compile(compiler, array);
+	compiler.emit(Opcode::ForPrepare, array);
+
+	// like while loops, the next element is fetched at the bottom of the loop, along with the jump back
+	auto enter = compiler.emitJump(Opcode::Jump);
+	int body = compiler.here();
+
+	compiler.pushLoop();
+	_loop->compile(compiler, Compiler::discard);
+
+	int next = compiler.emit(Opcode::ForNext, array, _iterator_slot);
+	compiler.patchJump(enter, next);
+	compiler.patchJump(compiler.emitJump(Opcode::Jump), body);
+	compiler.popLoop(next);
+
+	compiler.release(mark);
+	return compiler.loadNull(destination);
 }
 
 /* ===== DeclarationNode ===== */
 
-DeclarationNode::DeclarationNode(const TokenMetaData& meta, shared_ptr<Scope> scope, bool is_const, string identifier, shared_ptr<ASTNode> expr)
-	: ASTNode(meta, move(scope)), _is_const(is_const), _identifier(move(identifier)), _expr(move(expr)) {}
+DeclarationNode::DeclarationNode(uint32_t location, bool is_const, string identifier, ASTNode* expr)
+	: ASTNode(location), _is_const(is_const), _identifier(move(identifier)), _slot(-1), _expr(move(expr)) {}
 
 void DeclarationNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << "(decl ";
@@ -637,18 +1693,48 @@ void DeclarationNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << ")";
 }
 
-shared_ptr<Value> DeclarationNode::evaluate() const {
+void DeclarationNode::resolve(Resolver& resolver) {
+	// declared before the initializer is resolved, so functions can refer to themselves
+	_slot = resolver.declare(_identifier);
+
 	if (_expr) {
-		scope()->setValue(_identifier, _expr->evaluate());
+		_expr->resolve(resolver);
 	}
+}
 
+ASTNode* DeclarationNode::optimize(Optimizer& optimizer) {
+	optimizer.visit(_expr);
 	return nullptr;
 }
 
+Value DeclarationNode::evaluate(Frame& frame) const {
+	if (_expr) {
+		frame[_slot] = _expr->evaluate(frame);
+	} else {
+		frame[_slot] = Value::null();
+	}
+
+	return Value();
+}
+
+int DeclarationNode::compile(Compiler& compiler, int destination) const {
+	if (_expr) {
+		_expr->compile(compiler, _slot);
+	} else {
+		compiler.loadNull(_slot);
+	}
+
+	return compiler.loadNull(destination);
+}
+
 /* ===== FunctionDeclarationNode ===== */
 
-FunctionDeclarationNode::FunctionDeclarationNode(const TokenMetaData& meta, shared_ptr<Scope> scope, string identifier, vector<string> argument_names, shared_ptr<ASTNode> body)
-	: ASTNode(meta, move(scope)), _identifier(move(identifier)), _argument_names(move(argument_names)), _body(move(body)) {}
+FunctionDeclarationNode::FunctionDeclarationNode(uint32_t location, string identifier, vector<string> argument_names, ASTNode* body)
+	: ASTNode(location), _identifier(move(identifier)), _argument_names(move(argument_names)), _body(move(body)) {}
+
+bool FunctionDeclarationNode::hasSideEffects() const {
+	return false;
+}
 
 void FunctionDeclarationNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << "(decl func";
@@ -677,14 +1763,43 @@ void FunctionDeclarationNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << ")";
 }
 
-shared_ptr<Value> FunctionDeclarationNode::evaluate() const {
-	return UserDefinedFunctionValue::create(_identifier, _argument_names, _body);
+void FunctionDeclarationNode::resolve(Resolver& resolver) {
+	resolver.pushFunction(_argument_names);
+	_body->resolve(resolver);
+	_frame_size = resolver.popFunction();
+}
+
+ASTNode* FunctionDeclarationNode::optimize(Optimizer& optimizer) {
+	optimizer.pushFunction();
+	optimizer.visit(_body);
+	optimizer.popFunction();
+	return nullptr;
+}
+
+Value FunctionDeclarationNode::evaluate(Frame& frame) const {
+	// the function closes over the frame it's declared in, which lives as long as the function does
+	return UserDefinedFunctionValue::create(_identifier, _argument_names, _body, _frame_size, FramePtr(&frame));
+}
+
+int FunctionDeclarationNode::compile(Compiler& compiler, int destination) const {
+	if (destination == Compiler::discard) {
+		return destination;
+	}
+
+	compiler.pushFunction(_identifier, _argument_names.size(), _frame_size);
+	_body->compile(compiler, Compiler::discard);
+	compiler.emit(Opcode::ReturnNull);
+
+	int function = compiler.function(compiler.popFunction());
+	int reg = compiler.target(destination);
+	compiler.emit(Opcode::Closure, reg, function);
+	return reg;
 }
 
 /* ===== ReturnNode ===== */
 
-ReturnNode::ReturnNode(const TokenMetaData& meta, shared_ptr<Scope> scope, shared_ptr<ASTNode> expr)
-	: ASTNode(meta, move(scope)), _expr(move(expr)) {}
+ReturnNode::ReturnNode(uint32_t location, ASTNode* expr)
+	: ASTNode(location), _expr(move(expr)), _in_function(false) {}
 
 void ReturnNode::output(ostream& out, int indent) const {
 	if (!_expr) {
@@ -700,46 +1815,89 @@ void ReturnNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << ")";
 }
 
-shared_ptr<Value> ReturnNode::evaluate() const {
+void ReturnNode::resolve(Resolver& resolver) {
+	_in_function = resolver.inFunction();
+
 	if (_expr) {
-		auto val = _expr->evaluate();
+		_expr->resolve(resolver);
+	}
+}
 
-		if (!val) {
-			throw InterpretorError("No value to return");
-		}
+ASTNode* ReturnNode::optimize(Optimizer& optimizer) {
+	optimizer.visit(_expr);
+	return nullptr;
+}
 
-		if (val->type() == ValueType::Sentinel) {
-			throw InterpretorError("Returning sentinel value");
+Completion ReturnNode::execute(Frame& frame) const {
+	if (!_expr) {
+		return { CompletionType::Return };
+	}
+
+	auto val = _expr->evaluate(frame);
+
+	if (val.empty()) {
+		throw InterpretorError("No value to return");
+	}
+
+	if (!_in_function) {
+		throw UndefinedVariableError(return_value_alias);
+	}
+
+	return { CompletionType::Return, move(val) };
+}
+
+int ReturnNode::compile(Compiler& compiler, int destination) const {
+	if (_expr) {
+		auto mark = compiler.mark();
+		int value = _expr->compile(compiler, Compiler::any);
+
+		// like the tree walker, the value is worked out before it fails for having nowhere to go
+		if (_in_function) {
+			compiler.emit(Opcode::Return, value);
+		} else {
+			compiler.emit(Opcode::ThrowUndefined, compiler.constant(return_value_alias));
 		}
 
-		scope()->setValue(return_value_alias, move(val));
+		compiler.release(mark);
+	} else {
+		compiler.emit(compiler.inFunction() ? Opcode::ReturnNull : Opcode::Halt);
 	}
 
-	return SentinelValue::Return;
+	return compiler.loadNull(destination);
 }
 
 /* ===== BreakNode ===== */
 
-BreakNode::BreakNode(const TokenMetaData& meta, shared_ptr<Scope> scope)
-	: ASTNode(meta, move(scope)) {}
+BreakNode::BreakNode(uint32_t location)
+	: ASTNode(location) {}
 
 void BreakNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << "(break)";
 }
 
-shared_ptr<Value> BreakNode::evaluate() const {
-	return SentinelValue::Break;
+Completion BreakNode::execute(Frame& frame) const {
+	return { CompletionType::Break };
+}
+
+int BreakNode::compile(Compiler& compiler, int destination) const {
+	compiler.emitBreak();
+	return compiler.loadNull(destination);
 }
 
 /* ===== ContinueNode ===== */
 
-ContinueNode::ContinueNode(const TokenMetaData& meta, shared_ptr<Scope> scope)
-	: ASTNode(meta, move(scope)) {}
+ContinueNode::ContinueNode(uint32_t location)
+	: ASTNode(location) {}
 
 void ContinueNode::output(ostream& out, int indent) const {
 	out << io::indent(indent) << "(continue)";
 }
 
-shared_ptr<Value> ContinueNode::evaluate() const {
-	return SentinelValue::Continue;
+Completion ContinueNode::execute(Frame& frame) const {
+	return { CompletionType::Continue };
+}
+
+int ContinueNode::compile(Compiler& compiler, int destination) const {
+	compiler.emitContinue();
+	return compiler.loadNull(destination);
 }
@@ -9,233 +9,368 @@
 #include "constants.h"
 #include "token.h"
 #include "value.h"
+#include "shape.h"
 #include "scope.h"
+#include "frame.h"
+#include "resolver.h"
+#include "optimizer.h"
+#include "compiler.h"
+#include "completion.h"
+#include "syntax_tree.h"
 
+// Nodes are built by, and live as long as, the SyntaxTree they're parsed into. location() is their index
+// in its table of source locations.
 class ASTNode {
 public:
-	ASTNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope);
+	ASTNode(uint32_t location);
 	virtual ~ASTNode() {}
-	const TokenMetaData& meta() const;
-	std::shared_ptr<Scope> scope() const;
+	uint32_t location() const;
 	virtual bool isLValue() const;
 	virtual bool isConst(const std::shared_ptr<Scope>& scope) const;
+	virtual bool hasSideEffects() const;
 	virtual void output(std::ostream& out, int indent = 0) const = 0;
-	virtual std::shared_ptr<Value> evaluate() const;
-	virtual void assign(std::shared_ptr<Value> rhs) const;
+	virtual void resolve(Resolver& resolver);
+	virtual ASTNode* optimize(Optimizer& optimizer);
+	virtual Value literalValue() const;
+	virtual Value evaluate(Frame& frame) const;
+	virtual Completion execute(Frame& frame) const;
+	virtual void assign(Frame& frame, Value rhs) const;
+	virtual int compile(Compiler& compiler, int destination) const;
+	virtual int compileOperand(Compiler& compiler) const;
+	virtual int compileAssignment(Compiler& compiler, Builtin op, const ASTNode& rhs, int destination) const;
+	virtual int compileJump(Compiler& compiler, bool condition) const;
 protected:
-	TokenMetaData _meta;
-	std::shared_ptr<Scope> _scope;
+	uint32_t _location;
 };
 
 class IdentifierNode : public ASTNode {
 public:
-	IdentifierNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, std::string identifier);
+	IdentifierNode(uint32_t location, std::string identifier);
 	virtual bool isLValue() const override;
 	virtual bool isConst(const std::shared_ptr<Scope>& scope) const override;
+	virtual bool hasSideEffects() const override;
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
-	virtual void assign(std::shared_ptr<Value> rhs) const override;
+	virtual void resolve(Resolver& resolver) override;
+	virtual ASTNode* optimize(Optimizer& optimizer) override;
+	virtual Value evaluate(Frame& frame) const override;
+	virtual void assign(Frame& frame, Value rhs) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
+	virtual int compileAssignment(Compiler& compiler, Builtin op, const ASTNode& rhs, int destination) const override;
 	const std::string& str() const;
 private:
 	std::string _identifier;
+	SlotAddress _address;
 };
 
 class NumberLiteralNode : public ASTNode {
 public:
-	NumberLiteralNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, std::string number);
+	NumberLiteralNode(uint32_t location, std::string number);
+	NumberLiteralNode(uint32_t location, double number);
+	virtual bool hasSideEffects() const override;
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual Value literalValue() const override;
+	virtual Value evaluate(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
+	virtual int compileOperand(Compiler& compiler) const override;
 private:
 	double _number;
 };
 
 class StringLiteralNode : public ASTNode {
 public:
-	StringLiteralNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, std::string str);
+	StringLiteralNode(uint32_t location, std::string str);
+	virtual bool hasSideEffects() const override;
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual Value evaluate(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
+	const Value& value() const;
 private:
 	std::string _str;
+	Value _value;
 };
 
 class BooleanLiteralNode : public ASTNode {
 public:
-	BooleanLiteralNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, bool boolean);
+	BooleanLiteralNode(uint32_t location, bool boolean);
+	virtual bool hasSideEffects() const override;
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual Value literalValue() const override;
+	virtual Value evaluate(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
 private:
 	bool _boolean;
 };
 
 class NullLiteralNode : public ASTNode {
 public:
-	NullLiteralNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope);
+	NullLiteralNode(uint32_t location);
+	virtual bool hasSideEffects() const override;
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual Value literalValue() const override;
+	virtual Value evaluate(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
 };
 
 class ArrayLiteralNode : public ASTNode {
 public:
-	ArrayLiteralNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, std::vector<std::shared_ptr<ASTNode>> elements);
+	ArrayLiteralNode(uint32_t location, std::vector<ASTNode*> elements);
+	virtual bool hasSideEffects() const override;
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual void resolve(Resolver& resolver) override;
+	virtual ASTNode* optimize(Optimizer& optimizer) override;
+	virtual Value evaluate(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
 private:
-	std::vector<std::shared_ptr<ASTNode>> _elements;
+	std::vector<ASTNode*> _elements;
 };
 
 class ObjectLiteralNode : public ASTNode {
 public:
-	ObjectLiteralNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, std::unordered_map<std::string, std::shared_ptr<ASTNode>> members);
+	ObjectLiteralNode(uint32_t location, std::vector<std::pair<std::string, ASTNode*>> members);
+	virtual bool hasSideEffects() const override;
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual void resolve(Resolver& resolver) override;
+	virtual ASTNode* optimize(Optimizer& optimizer) override;
+	virtual Value evaluate(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
 private:
-	std::unordered_map<std::string, std::shared_ptr<ASTNode>> _members;
+	std::vector<std::pair<std::string, ASTNode*>> _members;
+	const Shape* _shape;
 };
 
 class SubscriptNode : public ASTNode {
 public:
-	SubscriptNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, std::shared_ptr<ASTNode> lhs, std::shared_ptr<ASTNode> index);
+	SubscriptNode(uint32_t location, ASTNode* lhs, ASTNode* index);
 	virtual bool isLValue() const override;
 	virtual bool isConst(const std::shared_ptr<Scope>& scope) const override;
+	virtual bool hasSideEffects() const override;
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
-	virtual void assign(std::shared_ptr<Value> rhs) const override;
+	virtual void resolve(Resolver& resolver) override;
+	virtual ASTNode* optimize(Optimizer& optimizer) override;
+	virtual Value evaluate(Frame& frame) const override;
+	virtual void assign(Frame& frame, Value rhs) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
+	virtual int compileAssignment(Compiler& compiler, Builtin op, const ASTNode& rhs, int destination) const override;
 private:
-	std::shared_ptr<ASTNode> _lhs;
-	std::shared_ptr<ASTNode> _index;
+	typedef Value (SubscriptNode::*Evaluator)(Frame& frame) const;
+
+	Value evaluateUninitialized(Frame& frame) const;
+	Value evaluateArrayIndex(Frame& frame) const;
+	Value evaluateObjectMember(Frame& frame) const;
+	Value evaluateGeneric(Frame& frame) const;
+
+	ASTNode* _lhs;
+	ASTNode* _index;
+	// a string literal index names a member, like o.member does, and gets an inline cache the same way
+	Value _member;
+	mutable Evaluator _evaluator;
+	mutable InlineCache _cache;
 };
 
 class AccessMemberNode : public ASTNode {
 public:
-	AccessMemberNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, std::shared_ptr<ASTNode> lhs, std::string member);
+	AccessMemberNode(uint32_t location, ASTNode* lhs, std::string member);
 	virtual bool isLValue() const override;
 	virtual bool isConst(const std::shared_ptr<Scope>& scope) const override;
+	virtual bool hasSideEffects() const override;
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
-	virtual void assign(std::shared_ptr<Value> rhs) const override;
+	virtual void resolve(Resolver& resolver) override;
+	virtual ASTNode* optimize(Optimizer& optimizer) override;
+	virtual Value evaluate(Frame& frame) const override;
+	virtual void assign(Frame& frame, Value rhs) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
+	virtual int compileAssignment(Compiler& compiler, Builtin op, const ASTNode& rhs, int destination) const override;
 private:
-	std::shared_ptr<ASTNode> _lhs;
-	std::shared_ptr<Value> _member;
+	typedef Value (AccessMemberNode::*Evaluator)(Frame& frame) const;
+
+	Value evaluateUninitialized(Frame& frame) const;
+	Value evaluateObjectMember(Frame& frame) const;
+	Value evaluateArrayMember(Frame& frame) const;
+	Value evaluateGeneric(Frame& frame) const;
+
+	ASTNode* _lhs;
+	std::string _member_name;
+	Value _member;
+	mutable Evaluator _evaluator;
+	mutable InlineCache _cache;
 };
 
 class BinaryOperatorNode : public ASTNode {
 public:
-	BinaryOperatorNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, Builtin op, std::shared_ptr<ASTNode> left, std::shared_ptr<ASTNode> right);
+	BinaryOperatorNode(uint32_t location, Builtin op, ASTNode* left, ASTNode* right);
+	virtual bool hasSideEffects() const override;
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual void resolve(Resolver& resolver) override;
+	virtual ASTNode* optimize(Optimizer& optimizer) override;
+	virtual Value evaluate(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
+	virtual int compileJump(Compiler& compiler, bool condition) const override;
 private:
+	typedef Value (BinaryOperatorNode::*Evaluator)(Frame& frame) const;
+
+	Value evaluateUninitialized(Frame& frame) const;
+	Value evaluateGeneric(Frame& frame) const;
+	template <typename Op, bool constant_rhs>
+	Value evaluateNumbers(Frame& frame) const;
+	template <typename Op, bool constant_rhs>
+	Value evaluateNumberAssignment(Frame& frame) const;
+	Value apply(Frame& frame, const Value& lhs, const Value& rhs) const;
+	Evaluator numberEvaluator() const;
+	template <typename Op>
+	Evaluator numberEvaluator(bool assignment) const;
+	void compileOperands(Compiler& compiler, int& lhs, int& rhs) const;
+
 	Builtin _op;
-	std::shared_ptr<ASTNode> _left;
-	std::shared_ptr<ASTNode> _right;
+	ASTNode* _left;
+	ASTNode* _right;
+	mutable Evaluator _evaluator;
+	mutable double _right_number;
 };
 
 class UnaryOperatorNode : public ASTNode {
 public:
-	UnaryOperatorNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, Builtin op, std::shared_ptr<ASTNode> expr);
+	UnaryOperatorNode(uint32_t location, Builtin op, ASTNode* expr);
+	virtual bool hasSideEffects() const override;
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual void resolve(Resolver& resolver) override;
+	virtual ASTNode* optimize(Optimizer& optimizer) override;
+	virtual Value evaluate(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
 private:
 	Builtin _op;
-	std::shared_ptr<ASTNode> _expr;
+	ASTNode* _expr;
 };
 
 class FunctionCallNode : public ASTNode {
 public:
-	FunctionCallNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, std::shared_ptr<ASTNode> caller, std::vector<std::shared_ptr<ASTNode>> arguments);
+	FunctionCallNode(uint32_t location, ASTNode* caller, std::vector<ASTNode*> arguments);
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual void resolve(Resolver& resolver) override;
+	virtual ASTNode* optimize(Optimizer& optimizer) override;
+	virtual Value evaluate(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
 private:
-	std::shared_ptr<ASTNode> _caller;
-	std::vector<std::shared_ptr<ASTNode>> _arguments;
+	ASTNode* _caller;
+	std::vector<ASTNode*> _arguments;
 };
 
 class BlockNode : public ASTNode {
 public:
-	BlockNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, bool is_new_scope, std::vector<std::shared_ptr<ASTNode>> statements);
+	BlockNode(uint32_t location, bool is_new_scope, std::vector<ASTNode*> statements);
 	bool isNewScope() const;
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual void resolve(Resolver& resolver) override;
+	virtual ASTNode* optimize(Optimizer& optimizer) override;
+	virtual Completion execute(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
 private:
 	bool _is_new_scope;
-	std::vector<std::shared_ptr<ASTNode>> _statements;
+	std::vector<ASTNode*> _statements;
 };
 
 class IfStatementNode : public ASTNode {
 public:
-	IfStatementNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, std::shared_ptr<ASTNode> condition, std::shared_ptr<ASTNode> if_block, std::shared_ptr<ASTNode> else_block);
+	IfStatementNode(uint32_t location, ASTNode* condition, ASTNode* if_block, ASTNode* else_block);
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual void resolve(Resolver& resolver) override;
+	virtual ASTNode* optimize(Optimizer& optimizer) override;
+	virtual Completion execute(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
 private:
-	std::shared_ptr<ASTNode> _condition;
-	std::shared_ptr<ASTNode> _then;
-	std::shared_ptr<ASTNode> _else;
+	ASTNode* _condition;
+	ASTNode* _then;
+	ASTNode* _else;
 };
 
 class WhileStatementNode : public ASTNode {
 public:
-	WhileStatementNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, std::shared_ptr<ASTNode> condition, std::shared_ptr<ASTNode> loop_block);
+	WhileStatementNode(uint32_t location, ASTNode* condition, ASTNode* loop_block);
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual void resolve(Resolver& resolver) override;
+	virtual ASTNode* optimize(Optimizer& optimizer) override;
+	virtual Completion execute(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
 private:
-	std::shared_ptr<ASTNode> _condition;
-	std::shared_ptr<ASTNode> _loop;
+	ASTNode* _condition;
+	ASTNode* _loop;
 };
 
 class ForStatementNode : public ASTNode {
 public:
-	ForStatementNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, bool is_const, std::string iterator_name, std::shared_ptr<ASTNode> array_expr, std::shared_ptr<ASTNode> loop_block);
+	ForStatementNode(uint32_t location, bool is_const, std::string iterator_name, ASTNode* array_expr, ASTNode* loop_block);
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual void resolve(Resolver& resolver) override;
+	virtual ASTNode* optimize(Optimizer& optimizer) override;
+	virtual Completion execute(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
 private:
+	Completion executeLines(Frame& frame, const LinesValue& lines) const;
+
 	bool _is_const;
 	std::string _iterator_name;
-	std::shared_ptr<ASTNode> _array;
-	std::shared_ptr<ASTNode> _loop;
+	int _iterator_slot;
+	ASTNode* _array;
+	ASTNode* _loop;
 };
 
 class DeclarationNode : public ASTNode {
 public:
-	DeclarationNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, bool is_const, std::string identifier, std::shared_ptr<ASTNode> expr);
+	DeclarationNode(uint32_t location, bool is_const, std::string identifier, ASTNode* expr);
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual void resolve(Resolver& resolver) override;
+	virtual ASTNode* optimize(Optimizer& optimizer) override;
+	virtual Value evaluate(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
 private:
 	bool _is_const;
 	std::string _identifier;
-	std::shared_ptr<ASTNode> _expr;
+	int _slot;
+	ASTNode* _expr;
 };
 
 class FunctionDeclarationNode : public ASTNode {
 public:
-	FunctionDeclarationNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, std::string identifier, std::vector<std::string> argument_names, std::shared_ptr<ASTNode> body);
+	FunctionDeclarationNode(uint32_t location, std::string identifier, std::vector<std::string> argument_names, ASTNode* body);
+	virtual bool hasSideEffects() const override;
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual void resolve(Resolver& resolver) override;
+	virtual ASTNode* optimize(Optimizer& optimizer) override;
+	virtual Value evaluate(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
 private:
 	std::string _identifier;
 	std::vector<std::string> _argument_names;
-	std::shared_ptr<ASTNode> _body;
+	ASTNode* _body;
+	unsigned int _frame_size;
 };
 
 class ReturnNode : public ASTNode {
 public:
-	ReturnNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope, std::shared_ptr<ASTNode> expr);
+	ReturnNode(uint32_t location, ASTNode* expr);
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual void resolve(Resolver& resolver) override;
+	virtual ASTNode* optimize(Optimizer& optimizer) override;
+	virtual Completion execute(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
 private:
-	std::shared_ptr<ASTNode> _expr;
+	ASTNode* _expr;
+	bool _in_function;
 };
 
 class BreakNode : public ASTNode {
 public:
-	BreakNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope);
+	BreakNode(uint32_t location);
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual Completion execute(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
 };
 
 class ContinueNode : public ASTNode {
 public:
-	ContinueNode(const TokenMetaData& meta, std::shared_ptr<Scope> scope);
+	ContinueNode(uint32_t location);
 	virtual void output(std::ostream& out, int indent = 0) const override;
-	virtual std::shared_ptr<Value> evaluate() const override;
+	virtual Completion execute(Frame& frame) const override;
+	virtual int compile(Compiler& compiler, int destination) const override;
 };
 
 #endif
@@ -0,0 +1,136 @@
+#include "chunk.h"
+#include "iohelpers.h"
+
+using namespace std;
+
+static const char* opcode_strings[] = {
+	"move",
+	"load-constant",
+	"load-null",
+	"load-boolean",
+	"get-outer",
+	"set-outer",
+
+	"add",
+	"subtract",
+	"multiply",
+	"divide",
+	"modulus",
+	"exponent",
+	"less-than",
+	"less-than-or-equal",
+	"greater-than",
+	"greater-than-or-equal",
+	"equal-to",
+	"not-equal-to",
+	"negate",
+	"not",
+	"to-boolean",
+
+	"jump",
+	"jump-if-false",
+	"jump-if-true",
+	"test-less-than",
+	"test-less-than-or-equal",
+	"test-greater-than",
+	"test-greater-than-or-equal",
+	"test-equal-to",
+	"test-not-equal-to",
+
+	"new-array",
+	"new-object",
+	"get-index",
+	"set-index",
+	"get-member",
+	"set-member",
+
+	"call",
+	"closure",
+	"for-prepare",
+	"for-next",
+	"throw-undefined",
+	"return",
+	"return-null",
+	"halt"
+};
+
+static_assert(sizeof(opcode_strings) / sizeof(*opcode_strings) == opcode_count, "every opcode needs a string");
+
+string getOpcodeString(Opcode op) {
+	return opcode_strings[static_cast<unsigned int>(op)];
+}
+
+static void outputOperand(ostream& out, uint16_t operand) {
+	if (operand & Instruction::constant_flag) {
+		out << "k" << (operand & ~Instruction::constant_flag);
+	} else {
+		out << operand;
+	}
+}
+
+/* ===== Chunk ===== */
+
+void Chunk::output(ostream& out, int indent) const {
+	out << io::indent(indent) << "(function " << (identifier.empty() ? "(anonymous)" : identifier)
+		<< " (arity " << arity << ") (frame " << frame_size << ")" << endl;
+
+	for (unsigned int i = 0; i < code.size(); ++i) {
+		auto& instruction = code[i];
+		out << io::indent(indent + 1) << i << ": " << getOpcodeString(instruction.op);
+
+		switch (instruction.op) {
+			case Opcode::Jump:
+				out << " -> " << instruction.target();
+				break;
+			case Opcode::JumpIfFalse:
+			case Opcode::JumpIfTrue:
+				out << " " << instruction.a << " -> " << instruction.target();
+				break;
+			case Opcode::Add:
+			case Opcode::Subtract:
+			case Opcode::Multiply:
+			case Opcode::Divide:
+			case Opcode::Modulus:
+			case Opcode::Exponent:
+			case Opcode::LessThan:
+			case Opcode::LessThanOrEqual:
+			case Opcode::GreaterThan:
+			case Opcode::GreaterThanOrEqual:
+			case Opcode::EqualTo:
+			case Opcode::NotEqualTo:
+			case Opcode::TestLessThan:
+			case Opcode::TestLessThanOrEqual:
+			case Opcode::TestGreaterThan:
+			case Opcode::TestGreaterThanOrEqual:
+			case Opcode::TestEqualTo:
+			case Opcode::TestNotEqualTo:
+				out << " " << instruction.a << " ";
+				outputOperand(out, instruction.b);
+				out << " ";
+				outputOperand(out, instruction.c);
+				break;
+			default:
+				out << " " << instruction.a << " " << instruction.b << " " << instruction.c;
+				break;
+		}
+
+		out << endl;
+	}
+
+	for (unsigned int i = 0; i < constants.size(); ++i) {
+		out << io::indent(indent + 1) << "(constant " << i << " ";
+		constants[i].output(out);
+		out << ")" << endl;
+	}
+
+	for (unsigned int i = 0; i < members.size(); ++i) {
+		out << io::indent(indent + 1) << "(member " << i << " k" << members[i].name << ")" << endl;
+	}
+
+	for (auto&& function : functions) {
+		function->output(out, indent + 1);
+		out << endl;
+	}
+
+	out << io::indent(indent) << ")";
+}
@@ -0,0 +1,119 @@
+#ifndef _CHUNK_H_
+#define _CHUNK_H_
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "value.h"
+#include "shape.h"
+
+// Registers are slots of the running function's frame. The resolver's variables come first, followed
+// by the temporaries the compiler allocates, so reading a local variable never needs a load. Operands
+// written rk below are either a register, or a constant with Instruction::constant_flag set, and
+// member(i) is the member named by constants[members[i].name].
+enum class Opcode : uint16_t {
+	Move,               // a = b
+	LoadConstant,       // a = constants[b]
+	LoadNull,           // a = null
+	LoadBoolean,        // a = (b != 0)
+	GetOuter,           // a = ancestor(b)[c]
+	SetOuter,           // ancestor(b)[c] = a
+
+	Add,                // a = rk(b) + rk(c)
+	Subtract,           // a = rk(b) - rk(c)
+	Multiply,           // a = rk(b) * rk(c)
+	Divide,             // a = rk(b) / rk(c)
+	Modulus,            // a = rk(b) % rk(c)
+	Exponent,           // a = rk(b) ^ rk(c)
+	LessThan,           // a = rk(b) < rk(c)
+	LessThanOrEqual,    // a = rk(b) <= rk(c)
+	GreaterThan,        // a = rk(b) > rk(c)
+	GreaterThanOrEqual, // a = rk(b) >= rk(c)
+	EqualTo,            // a = rk(b) == rk(c)
+	NotEqualTo,         // a = rk(b) != rk(c)
+	Negate,             // a = -b
+	Not,                // a = !b
+	ToBoolean,          // a = b, which must be a Boolean
+
+	Jump,               // pc = target
+	JumpIfFalse,        // if !a: pc = target
+	JumpIfTrue,         // if a: pc = target
+
+	// Fused comparisons and branches, always followed by a Jump whose target they take
+	TestLessThan,           // if (rk(b) < rk(c)) == a: take the next jump, otherwise skip it
+	TestLessThanOrEqual,    // if (rk(b) <= rk(c)) == a: take the next jump, otherwise skip it
+	TestGreaterThan,        // if (rk(b) > rk(c)) == a: take the next jump, otherwise skip it
+	TestGreaterThanOrEqual, // if (rk(b) >= rk(c)) == a: take the next jump, otherwise skip it
+	TestEqualTo,            // if (rk(b) == rk(c)) == a: take the next jump, otherwise skip it
+	TestNotEqualTo,         // if (rk(b) != rk(c)) == a: take the next jump, otherwise skip it
+
+	NewArray,           // a = [b, ..., b + c - 1]
+	NewObject,          // a = {}
+	GetIndex,           // a = b[c]
+	SetIndex,           // a[b] = c
+	GetMember,          // a = b.member(c)
+	SetMember,          // a.member(b) = c
+
+	Call,               // a = b(b + 1, ..., b + c)
+	Closure,            // a = functions[b], closing over the current frame
+	ForPrepare,         // check that a is an Array, a Buffer or Lines, a + 1 = 0, a + 2 = length of a (in bytes for the others)
+	ForNext,            // if a + 1 < a + 2: b = a[a + 1], ++(a + 1) and take the next jump, otherwise skip it
+	                    // (for Lines, b = the line at a + 1, and a + 1 moves past it)
+	ThrowUndefined,     // raise an UndefinedVariableError for the name constants[a]
+	Return,             // return a
+	ReturnNull,         // return null
+	Halt                // stop running the program
+};
+
+const unsigned int opcode_count = static_cast<unsigned int>(Opcode::Halt) + 1;
+
+struct Instruction {
+	static const uint16_t constant_flag = 0x8000;
+
+	Opcode op;
+	uint16_t a;
+	uint16_t b;
+	uint16_t c;
+
+	// jumps keep their 32 bit target in b and c
+	uint32_t target() const;
+	void setTarget(uint32_t target);
+};
+
+// A member read or written by a GetMember or SetMember instruction, with the cache of the slots it
+// had in the shapes that instruction has seen. Every such instruction has its own.
+struct MemberAccess {
+	uint16_t name;
+	InlineCache cache;
+};
+
+// The compiled code of one function, or of the program itself.
+struct Chunk {
+	std::string identifier;
+	unsigned int arity;
+	unsigned int frame_size;
+	std::vector<Instruction> code;
+	std::vector<Value> constants;
+	std::vector<std::shared_ptr<const Chunk>> functions;
+	mutable std::vector<MemberAccess> members;
+
+	void output(std::ostream& out, int indent = 0) const;
+};
+
+std::string getOpcodeString(Opcode op);
+
+/* ===== Instruction (inline) ===== */
+
+inline uint32_t Instruction::target() const {
+	return static_cast<uint32_t>(b) | (static_cast<uint32_t>(c) << 16);
+}
+
+inline void Instruction::setTarget(uint32_t target) {
+	b = static_cast<uint16_t>(target);
+	c = static_cast<uint16_t>(target >> 16);
+}
+
+#endif
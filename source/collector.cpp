@@ -0,0 +1,149 @@
+#include <vector>
+#include <chrono>
+
+#include "collector.h"
+
+using namespace std;
+
+/* ===== Collectable ===== */
+
+Collectable::Collectable()
+	: _is_tracked(false), _previous_tracked(nullptr), _next_tracked(nullptr), _collector_references(0) {}
+
+Collectable::~Collectable() {
+	untrack();
+}
+
+void Collectable::track() {
+	if (_is_tracked) {
+		return;
+	}
+
+	_is_tracked = true;
+	_previous_tracked = nullptr;
+	_next_tracked = Collector::_tracked;
+
+	if (_next_tracked) {
+		_next_tracked->_previous_tracked = this;
+	}
+
+	Collector::_tracked = this;
+	++Collector::_tracked_count;
+}
+
+void Collectable::untrack() {
+	if (!_is_tracked) {
+		return;
+	}
+
+	if (_previous_tracked) {
+		_previous_tracked->_next_tracked = _next_tracked;
+	} else {
+		Collector::_tracked = _next_tracked;
+	}
+
+	if (_next_tracked) {
+		_next_tracked->_previous_tracked = _previous_tracked;
+	}
+
+	_is_tracked = false;
+	_previous_tracked = nullptr;
+	_next_tracked = nullptr;
+	--Collector::_tracked_count;
+}
+
+/* ===== Collector ===== */
+
+const unsigned int Collector::min_threshold;
+
+Collectable* Collector::_tracked = nullptr;
+unsigned int Collector::_tracked_count = 0;
+unsigned int Collector::_allocations = 0;
+unsigned int Collector::_threshold = Collector::min_threshold;
+
+unsigned int Collector::_collections = 0;
+unsigned long Collector::_freed = 0;
+double Collector::_seconds = 0;
+
+void Collector::collect() {
+	auto start = chrono::steady_clock::now();
+	const long reachable = -1;
+
+	vector<Collectable*> objects;
+	objects.reserve(_tracked_count);
+
+	// nothing refers to pooled frames, which are already empty
+	for (auto object = _tracked; object; object = object->_next_tracked) {
+		object->_collector_references = object->referenceCount();
+		if (object->_collector_references > 0) {
+			objects.push_back(object);
+		}
+	}
+
+	for (auto object : objects) {
+		object->traverse([](Collectable* referenced) {
+			if (referenced->_is_tracked) {
+				--referenced->_collector_references;
+			}
+		});
+	}
+
+	// objects with references left over are held from outside the heap, and everything they reach is live
+	vector<Collectable*> live;
+
+	for (auto object : objects) {
+		if (object->_collector_references > 0) {
+			object->_collector_references = reachable;
+			live.push_back(object);
+		}
+	}
+
+	while (!live.empty()) {
+		auto object = live.back();
+		live.pop_back();
+
+		object->traverse([&live](Collectable* referenced) {
+			if (referenced->_is_tracked && referenced->_collector_references != reachable) {
+				referenced->_collector_references = reachable;
+				live.push_back(referenced);
+			}
+		});
+	}
+
+	vector<Collectable*> garbage;
+
+	for (auto object : objects) {
+		if (object->_collector_references != reachable) {
+			garbage.push_back(object);
+		}
+	}
+
+	// clearing one object can free another, so they're all pinned until every cycle is broken
+	for (auto object : garbage) {
+		object->pin();
+	}
+
+	for (auto object : garbage) {
+		object->clear();
+	}
+
+	for (auto object : garbage) {
+		object->unpin();
+	}
+
+	// the next collection waits until about as many objects have been allocated as survived this one,
+	// so a large live heap isn't walked over and over
+	_allocations = 0;
+	_threshold = max(min_threshold, _tracked_count);
+
+	++_collections;
+	_freed += garbage.size();
+	_seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void Collector::outputStats(ostream& out) {
+	out << "gc: " << _collections << (_collections == 1 ? " collection, " : " collections, ")
+		<< _freed << " objects freed, "
+		<< _seconds * 1000 << "ms, "
+		<< _tracked_count << " objects tracked" << endl;
+}
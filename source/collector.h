@@ -0,0 +1,88 @@
+#ifndef _COLLECTOR_H_
+#define _COLLECTOR_H_
+
+#include <iostream>
+#include <functional>
+
+// Base of anything that can hold counted references to other collectables: arrays, objects, closures
+// and frames. Reference counting frees all of them, except for cycles, like a closure stored in the
+// frame it closed over. Containers track themselves with the Collector, which finds those cycles.
+// Strings never hold references to collectables, so they're never tracked, and builtins are only
+// tracked when they capture script values, like the functions bind and compose return.
+class Collectable {
+public:
+	typedef std::function<void(Collectable*)> Visitor;
+
+	Collectable(const Collectable&) = delete;
+	Collectable& operator=(const Collectable&) = delete;
+	virtual ~Collectable();
+
+	bool isTracked() const;
+protected:
+	Collectable();
+	void track();
+	void untrack();
+
+	virtual unsigned int referenceCount() const = 0;
+	// calls visit once for each counted reference held, including ones to untracked objects
+	virtual void traverse(const Visitor& visit) const = 0;
+	// drops every reference traverse reports, breaking the cycles of an unreachable object
+	virtual void clear() = 0;
+	// keep the object alive while the collector clears it, then release it as any other reference would
+	virtual void pin() = 0;
+	virtual void unpin() = 0;
+private:
+	friend class Collector;
+
+	bool _is_tracked;
+	Collectable* _previous_tracked;
+	Collectable* _next_tracked;
+	long _collector_references;
+};
+
+// Finds cycles of tracked objects that nothing outside them refers to, and breaks them. An object's
+// references from other tracked objects are subtracted from its reference count, so whatever is left
+// came from the interpreter itself: the global frame, the VM's call stack, or a value held in C++.
+// Everything reachable from those is live, and the rest is garbage. Collections run from the create
+// functions of arrays, objects and closures once enough of them have been allocated; a cycle always
+// has one of those in it, so frames don't count.
+class Collector {
+public:
+	static const unsigned int min_threshold = 10000;
+
+	static void allocated();
+	static void collect();
+	static unsigned int trackedCount();
+	static void outputStats(std::ostream& out);
+private:
+	friend class Collectable;
+
+	static Collectable* _tracked;
+	static unsigned int _tracked_count;
+	static unsigned int _allocations;
+	static unsigned int _threshold;
+
+	static unsigned int _collections;
+	static unsigned long _freed;
+	static double _seconds;
+};
+
+/* ===== Collectable (inline) ===== */
+
+inline bool Collectable::isTracked() const {
+	return _is_tracked;
+}
+
+/* ===== Collector (inline) ===== */
+
+inline unsigned int Collector::trackedCount() {
+	return _tracked_count;
+}
+
+inline void Collector::allocated() {
+	if (++_allocations >= _threshold) {
+		collect();
+	}
+}
+
+#endif
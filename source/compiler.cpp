@@ -0,0 +1,259 @@
+#include <limits>
+#include <cstring>
+#include "compiler.h"
+#include "astnode.h"
+#include "scope.h"
+#include "runtime_errors.h"
+
+using namespace std;
+
+shared_ptr<const Chunk> Compiler::compile(const ASTNode* root) {
+	_functions.clear();
+
+	// the program runs in the global frame, whose variables the resolver has already laid out
+	auto& global_frame = Scope::getGlobalFrame();
+	pushFunction("", 0, global_frame.size());
+	root->compile(*this, discard);
+	emit(Opcode::Halt);
+
+	auto chunk = popFunction();
+	if (global_frame.size() < chunk->frame_size) {
+		global_frame.resize(chunk->frame_size);
+	}
+
+	return chunk;
+}
+
+void Compiler::pushFunction(string identifier, unsigned int arity, unsigned int locals_count) {
+	auto chunk = make_shared<Chunk>();
+	chunk->identifier = std::move(identifier);
+	chunk->arity = arity;
+	chunk->frame_size = locals_count;
+
+	_functions.push_back({ std::move(chunk), static_cast<int>(locals_count), static_cast<int>(locals_count), {}, {}, {} });
+}
+
+shared_ptr<const Chunk> Compiler::popFunction() {
+	auto chunk = std::move(_functions.back().chunk);
+	_functions.pop_back();
+	return chunk;
+}
+
+bool Compiler::inFunction() const {
+	return _functions.size() > 1;
+}
+
+int Compiler::emit(Opcode op, int a, int b, int c) {
+	auto& code = _functions.back().chunk->code;
+	code.push_back({ op, static_cast<uint16_t>(checkOperand(a)), static_cast<uint16_t>(checkOperand(b)), static_cast<uint16_t>(checkOperand(c)) });
+	return code.size() - 1;
+}
+
+// the target is filled in later by patchJump
+int Compiler::emitJump(Opcode op, int a) {
+	return emit(op, a);
+}
+
+void Compiler::emitJumpTo(int target) {
+	patchJump(emit(Opcode::Jump), target);
+}
+
+void Compiler::patchJump(int jump) {
+	patchJump(jump, here());
+}
+
+void Compiler::patchJump(int jump, int target) {
+	_functions.back().chunk->code[jump].setTarget(target);
+}
+
+int Compiler::here() const {
+	return _functions.back().chunk->code.size();
+}
+
+int Compiler::constant(double number) {
+	uint64_t bits;
+	memcpy(&bits, &number, sizeof(bits));
+
+	auto& function = _functions.back();
+	auto it = function.numbers.find(bits);
+	if (it != end(function.numbers)) {
+		return it->second;
+	}
+
+	auto& constants = function.chunk->constants;
+	constants.push_back(Value::number(number));
+
+	int index = checkIndex(constants.size() - 1);
+	function.numbers.emplace(bits, index);
+	return index;
+}
+
+int Compiler::constant(const string& str) {
+	auto& function = _functions.back();
+	auto it = function.strings.find(str);
+	if (it != end(function.strings)) {
+		return it->second;
+	}
+
+	auto& constants = function.chunk->constants;
+	constants.push_back(StringValue::intern(str));
+
+	int index = checkIndex(constants.size() - 1);
+	function.strings.emplace(str, index);
+	return index;
+}
+
+int Compiler::function(shared_ptr<const Chunk> chunk) {
+	auto& functions = _functions.back().chunk->functions;
+	functions.push_back(std::move(chunk));
+	return checkOperand(functions.size() - 1);
+}
+
+// instructions that take a register or constant operand tell them apart by the constant flag
+int Compiler::constantOperand(int constant) const {
+	return constant | Instruction::constant_flag;
+}
+
+int Compiler::member(const string& name) {
+	auto& members = _functions.back().chunk->members;
+	members.push_back({ static_cast<uint16_t>(constant(name)), {} });
+	return checkOperand(members.size() - 1);
+}
+
+/* ===== Registers ===== */
+
+int Compiler::mark() const {
+	return _functions.back().next_temporary;
+}
+
+void Compiler::release(int mark) {
+	_functions.back().next_temporary = mark;
+}
+
+int Compiler::temporary() {
+	auto& function = _functions.back();
+	int reg = checkIndex(function.next_temporary++);
+
+	if (function.chunk->frame_size < static_cast<unsigned int>(function.next_temporary)) {
+		function.chunk->frame_size = function.next_temporary;
+	}
+
+	return reg;
+}
+
+bool Compiler::isTemporary(int reg) const {
+	return reg >= _functions.back().locals_count;
+}
+
+// the register a node should leave its value in, once its operands have been computed
+int Compiler::target(int destination) {
+	if (destination >= 0) {
+		return destination;
+	}
+
+	int reg = temporary();
+
+	// a discarded value is written but never read, so its register is free again straight away
+	if (destination == discard) {
+		release(reg);
+	}
+
+	return reg;
+}
+
+// a temporary a node can build its value up in before writing the destination
+int Compiler::scratch(int destination) {
+	if (destination >= 0 && isTemporary(destination)) {
+		return destination;
+	}
+
+	return temporary();
+}
+
+// copies a variable's value into a temporary, so later operands can't change it before it's used
+int Compiler::pin(int reg) {
+	if (isTemporary(reg)) {
+		return reg;
+	}
+
+	int pinned = temporary();
+	emit(Opcode::Move, pinned, reg);
+	return pinned;
+}
+
+int Compiler::move(int destination, int source) {
+	if (destination < 0) {
+		return source;
+	}
+
+	if (destination != source) {
+		emit(Opcode::Move, destination, source);
+	}
+
+	return destination;
+}
+
+int Compiler::loadNull(int destination) {
+	if (destination == discard) {
+		return discard;
+	}
+
+	int reg = target(destination);
+	emit(Opcode::LoadNull, reg);
+	return reg;
+}
+
+/* ===== Loops ===== */
+
+void Compiler::pushLoop() {
+	_functions.back().loops.push_back({});
+}
+
+// breaks jump to the current position, which should be just past the loop
+void Compiler::popLoop(int continue_target) {
+	auto& loops = _functions.back().loops;
+	for (auto&& jump : loops.back().breaks) {
+		patchJump(jump);
+	}
+
+	for (auto&& jump : loops.back().continues) {
+		patchJump(jump, continue_target);
+	}
+
+	loops.pop_back();
+}
+
+void Compiler::emitBreak() {
+	auto& loops = _functions.back().loops;
+	if (loops.empty()) {
+		throw InterpretorError("break outside of a loop");
+	}
+
+	loops.back().breaks.push_back(emitJump(Opcode::Jump));
+}
+
+void Compiler::emitContinue() {
+	auto& loops = _functions.back().loops;
+	if (loops.empty()) {
+		throw InterpretorError("continue outside of a loop");
+	}
+
+	loops.back().continues.push_back(emitJump(Opcode::Jump));
+}
+
+int Compiler::checkOperand(int operand) const {
+	if (operand < 0 || operand > numeric_limits<uint16_t>::max()) {
+		throw FunctionTooLargeError();
+	}
+
+	return operand;
+}
+
+// registers and constants share an operand with the constant flag, so both have to stay below it
+int Compiler::checkIndex(int index) const {
+	if (index < 0 || index >= Instruction::constant_flag) {
+		throw FunctionTooLargeError();
+	}
+
+	return index;
+}
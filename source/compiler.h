@@ -0,0 +1,83 @@
+#ifndef _COMPILER_H_
+#define _COMPILER_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chunk.h"
+
+class ASTNode;
+
+// Runs after the Resolver and turns the tree into register bytecode. Each node compiles itself through
+// ASTNode::compile, using the methods here to allocate temporaries and emit instructions.
+//
+// compile(compiler, destination) puts the node's value in `destination` and returns it. When the
+// destination is `any` the node returns whichever register holds its value, which may be a local
+// variable, or a temporary that is then the topmost allocated one. When it's `discard` the value is
+// dropped. A node must only write a variable's register as its last step, since the variable may be
+// read while the node's operands are computed.
+class Compiler {
+public:
+	static const int any = -1;
+	static const int discard = -2;
+
+	std::shared_ptr<const Chunk> compile(const ASTNode* root);
+
+	void pushFunction(std::string identifier, unsigned int arity, unsigned int locals_count);
+	std::shared_ptr<const Chunk> popFunction();
+	bool inFunction() const;
+
+	int emit(Opcode op, int a = 0, int b = 0, int c = 0);
+	int emitJump(Opcode op, int a = 0);
+	void emitJumpTo(int target);
+	void patchJump(int jump);
+	void patchJump(int jump, int target);
+	int here() const;
+
+	int constant(double number);
+	int constant(const std::string& str);
+	int constantOperand(int constant) const;
+	// a new MemberAccess for one GetMember or SetMember instruction
+	int member(const std::string& name);
+	int function(std::shared_ptr<const Chunk> chunk);
+
+	int mark() const;
+	void release(int mark);
+	int temporary();
+	bool isTemporary(int reg) const;
+	int target(int destination);
+	int scratch(int destination);
+	int pin(int reg);
+	int move(int destination, int source);
+	int loadNull(int destination);
+
+	void pushLoop();
+	void popLoop(int continue_target);
+	void emitBreak();
+	void emitContinue();
+private:
+	struct _Loop {
+		std::vector<int> breaks;
+		std::vector<int> continues;
+	};
+
+	struct _FunctionState {
+		std::shared_ptr<Chunk> chunk;
+		int locals_count;
+		int next_temporary;
+		// keyed by their bits, since NaN doesn't order and -0 equals 0
+		std::map<uint64_t, int> numbers;
+		std::map<std::string, int> strings;
+		std::vector<_Loop> loops;
+	};
+
+	int checkOperand(int operand) const;
+	int checkIndex(int index) const;
+
+	std::vector<_FunctionState> _functions;
+};
+
+#endif
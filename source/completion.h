@@ -0,0 +1,33 @@
+#ifndef _COMPLETION_H_
+#define _COMPLETION_H_
+
+#include <cstdint>
+#include "value.h"
+
+enum class CompletionType : uint8_t {
+	Normal,
+	Break,
+	Continue,
+	Return
+};
+
+// How a statement finished running. Blocks stop at the first statement that doesn't complete normally,
+// loops handle breaks and continues, and function calls take the value out of a return.
+struct Completion {
+	CompletionType type;
+	Value value;
+
+	Completion(CompletionType type = CompletionType::Normal, Value value = Value());
+	bool isNormal() const;
+};
+
+/* ===== Completion (inline) ===== */
+
+inline Completion::Completion(CompletionType type, Value value)
+	: type(type), value(std::move(value)) {}
+
+inline bool Completion::isNormal() const {
+	return type == CompletionType::Normal;
+}
+
+#endif
@@ -1,8 +1,39 @@
+#include <array>
+#include <cstdint>
+
 #include "constants.h"
 
 using namespace std;
 
-const map<Builtin, string> builtins = {
+namespace {
+	struct BuiltinText {
+		Builtin builtin;
+		string_view text;
+	};
+
+	struct BuiltinOperator {
+		Builtin builtin;
+		BuiltinInfo info;
+	};
+
+	// a spelling in the lookup table, with everything it can mean
+	struct BuiltinEntry {
+		string_view text;
+		BuiltinLookup lookup;
+	};
+}
+
+constexpr size_t builtin_count = static_cast<size_t>(Builtin::KeyValueSeperator) + 1;
+
+constexpr size_t index(Builtin builtin) {
+	return static_cast<size_t>(builtin);
+}
+
+constexpr bool isLetter(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+constexpr BuiltinText builtin_texts[] = {
 	{ Builtin::Assignment, "=" },
 	{ Builtin::AccessMember, "." },
 	{ Builtin::StatementDelimiter, ";" },
@@ -89,6 +120,21 @@ const map<Builtin, string> builtins = {
 	{ Builtin::KeyValueSeperator, ":" }
 };
 
+// reserved for later, so they can't be used as identifiers
+constexpr string_view reserved_words[] = {
+	"class", "new", "super", "this",
+	"public", "protected", "private",
+	"as", "typeof", "instanceof",
+	"import", "export", "module", "from",
+	"for", "switch", "case", "default",
+	"throw", "try", "catch", "finally",
+	"in", "delete",
+	"thread", "when", "always", "request",
+	"all", "any", "exists", "matches", "then",
+	"stdin", "stdout", "stderr", "stdwarn",
+	"do", "block", "with", "using"
+};
+
 const int assignment_level = 0;
 const int logical_or_level = assignment_level + 1;
 const int logical_and_level = logical_or_level + 1;
@@ -103,7 +149,7 @@ const int existential_level = logical_not_level + 1;
 const int incremental_level = existential_level + 1;
 const int member_access_level = incremental_level + 1;
 
-const map<Builtin, BuiltinInfo> builtin_info = {
+constexpr BuiltinOperator builtin_operators[] = {
 	// { Builtin, BuiltinInfo { is_operator, is_binary, precedence, binding_direction } }
 	{ Builtin::Assignment, { true, true, assignment_level, BindingDirection::RightAssociative } },
 	{ Builtin::AdditionAssignment, { true, true, assignment_level, BindingDirection::RightAssociative } },
@@ -146,64 +192,182 @@ const map<Builtin, BuiltinInfo> builtin_info = {
 	{ Builtin::AccessMember, { true, true, member_access_level, BindingDirection::LeftAssociative } },
 };
 
-bool isBuiltin(const string& builtin_text) {
-	for (auto&& builtin_pair : builtins) {
-		if (builtin_pair.second == builtin_text) {
-			return true;
-		}
+
+/* ===== Tables ===== */
+
+constexpr auto builtin_strings = ([]() {
+	array<string_view, builtin_count> strings {};
+
+	for (auto&& builtin_text : builtin_texts) {
+		strings[index(builtin_text.builtin)] = builtin_text.text;
 	}
 
-	return false;
-}
+	return strings;
+})();
 
-bool isBuiltin(const string& op, Builtin builtin) {
-	auto it = builtins.find(builtin);
-	if (it != end(builtins)) {
-		return it->second == op;
+constexpr auto builtin_info = ([]() {
+	array<BuiltinInfo, builtin_count> info {};
+
+	for (auto& builtin : info) {
+		builtin = { false, false, -1, BindingDirection::None };
 	}
 
-	return false;
-}
+	for (auto&& builtin_operator : builtin_operators) {
+		info[index(builtin_operator.builtin)] = builtin_operator.info;
+	}
+
+	return info;
+})();
 
-Builtin getBinaryBuiltin(const string& builtin_text) {
-	for (auto&& builtin_pair : builtins) {
-		if (builtin_pair.second == builtin_text) {
-			if (isBinaryOperator(builtin_pair.first)) {
-				return builtin_pair.first;
+// every distinct spelling of a builtin or a reserved word, each appearing once
+constexpr size_t max_entries = size(builtin_texts) + size(reserved_words);
+
+constexpr auto builtin_entries = ([]() {
+	struct Entries {
+		array<BuiltinEntry, max_entries> entries {};
+		size_t count = 0;
+
+		constexpr BuiltinEntry& entry(string_view text) {
+			for (size_t i = 0; i < count; ++i) {
+				if (entries[i].text == text) {
+					return entries[i];
+				}
 			}
+
+			entries[count] = { text, { Builtin::Invalid, Builtin::Invalid, false } };
+			return entries[count++];
 		}
+	} entries;
+
+	// in the order of the enum, so a spelling's first binary and first unary builtins are the ones it means
+	for (size_t i = 0; i < builtin_count; ++i) {
+		auto text = builtin_strings[i];
+		if (text.empty()) {
+			continue;
+		}
+
+		auto& lookup = entries.entry(text).lookup;
+		auto builtin = static_cast<Builtin>(i);
+		auto& interpretation = builtin_info[i].is_binary ? lookup.binary : lookup.unary;
+
+		if (interpretation == Builtin::Invalid) {
+			interpretation = builtin;
+		}
+
+		lookup.is_keyword = isLetter(text[0]);
+	}
+
+	for (auto&& word : reserved_words) {
+		entries.entry(word).lookup.is_keyword = true;
 	}
 
-	return Builtin::Invalid;
+	return entries;
+})();
+
+/* ===== Perfect hash ===== */
+
+// slots hold an index into builtin_entries plus one, or zero when empty
+constexpr size_t slot_bits = 9;
+constexpr size_t slot_count = size_t(1) << slot_bits;
+
+// FNV-1a, with the seed mixed in at the end so each seed spreads the spellings differently
+constexpr uint32_t hashBuiltin(string_view text, uint32_t seed) {
+	uint32_t hash = 2166136261u;
+
+	for (char c : text) {
+		hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+	}
+
+	return ((hash ^ seed) * 0x9e3779b1u) >> (32 - slot_bits);
 }
 
-Builtin getUnaryBuiltin(const string& builtin_text) {
-	for (auto&& builtin_pair : builtins) {
-		if (builtin_pair.second == builtin_text) {
-			if (!isBinaryOperator(builtin_pair.first)) {
-				return builtin_pair.first;
+// the first seed that gives every spelling a slot of its own
+constexpr uint32_t builtin_seed = ([]() {
+	for (uint32_t seed = 0; ; ++seed) {
+		array<bool, slot_count> taken {};
+		bool collided = false;
+
+		for (size_t i = 0; i < builtin_entries.count && !collided; ++i) {
+			auto slot = hashBuiltin(builtin_entries.entries[i].text, seed);
+			collided = taken[slot];
+			taken[slot] = true;
+		}
+
+		if (!collided) {
+			return seed;
+		}
+	}
+})();
+
+constexpr auto builtin_slots = ([]() {
+	static_assert(max_entries < 256, "builtin slots hold entry indices in a byte");
+	array<unsigned char, slot_count> slots {};
+
+	for (size_t i = 0; i < builtin_entries.count; ++i) {
+		slots[hashBuiltin(builtin_entries.entries[i].text, builtin_seed)] = static_cast<unsigned char>(i + 1);
+	}
+
+	return slots;
+})();
+
+constexpr auto symbol_chars = ([]() {
+	array<bool, 256> symbols {};
+
+	for (auto&& builtin_text : builtin_texts) {
+		auto text = builtin_text.text;
+		if (!text.empty() && !isLetter(text[0])) {
+			for (char c : text) {
+				symbols[static_cast<unsigned char>(c)] = true;
 			}
 		}
 	}
 
-	return Builtin::Invalid;
+	return symbols;
+})();
+
+/* ===== Lookups ===== */
+
+BuiltinLookup lookupBuiltin(string_view text) {
+	auto slot = builtin_slots[hashBuiltin(text, builtin_seed)];
+
+	if (slot != 0) {
+		auto& entry = builtin_entries.entries[slot - 1];
+		if (entry.text == text) {
+			return entry.lookup;
+		}
+	}
+
+	return { Builtin::Invalid, Builtin::Invalid, false };
 }
 
-string getBuiltinString(Builtin builtin) {
-	auto it = builtins.find(builtin);
+bool isBuiltin(string_view builtin_text) {
+	auto lookup = lookupBuiltin(builtin_text);
+	return lookup.binary != Builtin::Invalid || lookup.unary != Builtin::Invalid;
+}
 
-	if (it != end(builtins)) {
-		return it->second;
+bool isBuiltin(string_view op, Builtin builtin) {
+	return builtin != Builtin::Invalid && builtin_strings[index(builtin)] == op;
+}
+
+Builtin getBinaryBuiltin(string_view builtin_text) {
+	return lookupBuiltin(builtin_text).binary;
+}
+
+Builtin getUnaryBuiltin(string_view builtin_text) {
+	return lookupBuiltin(builtin_text).unary;
+}
+
+string getBuiltinString(Builtin builtin) {
+	if (builtin != Builtin::Invalid && !builtin_strings[index(builtin)].empty()) {
+		return string(builtin_strings[index(builtin)]);
 	}
 
 	return "(unknown operator)";
 }
 
 BuiltinInfo getBuiltinInfo(Builtin builtin) {
-	auto it = builtin_info.find(builtin);
-
-	if (it != end(builtin_info)) {
-		return it->second;
+	if (builtin != Builtin::Invalid) {
+		return builtin_info[index(builtin)];
 	}
 
 	return { false, false, -1, BindingDirection::None };
@@ -217,50 +381,10 @@ bool isAssignmentOperator(BuiltinInfo builtin_info) {
 	return builtin_info.precedence == assignment_level;
 }
 
-const auto symbol_chars = ([]() -> set<char> {
-	set<char> symbols;
-
-	for (const auto& builtin_pair : builtins) {
-		const auto& builtin_text = builtin_pair.second;
-		if (!builtin_text.empty() && !isalpha(builtin_text[0])) {
-			symbols.insert(begin(builtin_text), end(builtin_text));
-		}
-	}
-
-	return symbols;
-})();
-
 bool isSymbol(char c) {
-	return symbol_chars.count(c) > 0;
+	return symbol_chars[static_cast<unsigned char>(c)];
 }
 
-const auto keywords = ([]() -> set<string> {
-	set<string> keywords;
-
-	for (const auto& builtin_pair : builtins) {
-		const auto& builtin_text = builtin_pair.second;
-		if (!builtin_text.empty() && isalpha(builtin_text[0])) {
-			keywords.insert(builtin_text);
-		}
-	}
-
-	keywords.insert({
-		"class", "new", "super", "this",
-		"public", "protected", "private",
-		"as", "typeof", "instanceof",
-		"import", "export", "module", "from",
-		"for", "switch", "case", "default",
-		"throw", "try", "catch", "finally",
-		"in", "delete",
-		"thread", "when", "always", "request",
-		"all", "any", "exists", "matches", "then",
-		"stdin", "stdout", "stderr", "stdwarn",
-		"do", "block", "with", "using"
-	});
-
-	return keywords;
-})();
-
-bool isKeyword(const string& text) {
-	return keywords.count(text) > 0;
+bool isKeyword(string_view text) {
+	return lookupBuiltin(text).is_keyword;
 }
@@ -1,9 +1,8 @@
 #ifndef _CONSTANTS_H_
 #define _CONSTANTS_H_
 
-#include <set>
-#include <map>
 #include <string>
+#include <string_view>
 #include "token.h"
 
 const static std::string return_value_alias = "<return-value>";
@@ -113,13 +112,21 @@ struct BuiltinInfo {
 	BindingDirection binding_direction;
 };
 
-extern const std::map<Builtin, BuiltinInfo> builtin_info;
+// everything a spelling can mean: a binary operator, a unary operator or other builtin, and whether
+// it's reserved, so can't be an identifier. Found in one probe of a perfect hash built at compile time.
+struct BuiltinLookup {
+	Builtin binary;
+	Builtin unary;
+	bool is_keyword;
+};
+
+BuiltinLookup lookupBuiltin(std::string_view text);
 
-bool isBuiltin(const std::string& op);
-bool isBuiltin(const std::string& op, Builtin builtin);
+bool isBuiltin(std::string_view op);
+bool isBuiltin(std::string_view op, Builtin builtin);
 
-Builtin getBinaryBuiltin(const std::string& op);
-Builtin getUnaryBuiltin(const std::string& op);
+Builtin getBinaryBuiltin(std::string_view op);
+Builtin getUnaryBuiltin(std::string_view op);
 std::string getBuiltinString(Builtin builtin);
 
 BuiltinInfo getBuiltinInfo(Builtin builtin);
@@ -128,6 +135,6 @@ bool isBinaryOperator(Builtin builtin);
 bool isAssignmentOperator(BuiltinInfo builtin_info);
 
 bool isSymbol(char c);
-bool isKeyword(const std::string& text);
+bool isKeyword(std::string_view text);
 
 #endif
@@ -0,0 +1,98 @@
+#include "frame.h"
+
+using namespace std;
+
+namespace {
+	// frames beyond this many are freed instead of pooled, so one deep recursion doesn't pin memory
+	const unsigned int max_pooled_frames = 1024;
+
+	Frame* free_frames = nullptr;
+	unsigned int free_frames_count = 0;
+}
+
+// frames stay tracked while they're pooled, which the collector tells apart by their zero reference count
+Frame::Frame()
+	: _ref_count(0), _next_free(nullptr) {
+	track();
+}
+
+unsigned int Frame::size() const {
+	return _slots.size();
+}
+
+void Frame::resize(unsigned int size) {
+	_slots.resize(size, Value::null());
+}
+
+void Frame::release() {
+	if (--_ref_count > 0) {
+		return;
+	}
+
+	// dropping the slots and parent can release closures, and through them other frames, so the frame
+	// is only put on the free list after it's been emptied. Slots are left null, ready for reuse
+	for (auto&& slot : _slots) {
+		slot = Value::null();
+	}
+
+	_parent = nullptr;
+
+	if (free_frames_count >= max_pooled_frames) {
+		delete this;
+		return;
+	}
+
+	_next_free = free_frames;
+	free_frames = this;
+	++free_frames_count;
+}
+
+FramePtr Frame::create(FramePtr parent, unsigned int size) {
+	Frame* frame;
+
+	if (free_frames) {
+		frame = free_frames;
+		free_frames = frame->_next_free;
+		--free_frames_count;
+	} else {
+		frame = new Frame();
+	}
+
+	frame->_parent = move(parent);
+
+	if (frame->_slots.size() != size) {
+		frame->_slots.resize(size, Value::null());
+	}
+
+	return FramePtr(frame);
+}
+
+unsigned int Frame::referenceCount() const {
+	return _ref_count;
+}
+
+void Frame::traverse(const Visitor& visit) const {
+	if (_parent) {
+		visit(_parent.get());
+	}
+
+	for (auto&& slot : _slots) {
+		slot.traverse(visit);
+	}
+}
+
+void Frame::clear() {
+	for (auto&& slot : _slots) {
+		slot = Value::null();
+	}
+
+	_parent = nullptr;
+}
+
+void Frame::pin() {
+	retain();
+}
+
+void Frame::unpin() {
+	release();
+}
@@ -0,0 +1,119 @@
+#ifndef _FRAME_H_
+#define _FRAME_H_
+
+#include <utility>
+#include <vector>
+#include "value.h"
+#include "frame_ptr.h"
+
+// A flat, indexed block of variable slots. The resolver assigns every variable a slot in the frame of
+// its enclosing function, so a variable access is a walk of `depth` parent links and an array index.
+// Every call of a user defined function gets its own frame. Frames whose last reference is dropped go
+// back to a pool and keep their slot storage, so calls don't allocate once the pool is warm. Closures
+// stored in the frames they close over make cycles, so frames are tracked by the Collector.
+class Frame : public Collectable {
+public:
+	Frame(const Frame&) = delete;
+	Frame& operator=(const Frame&) = delete;
+
+	Frame* parent() const;
+	Frame* ancestor(unsigned int depth);
+	Value& operator[](unsigned int slot);
+	Value* data();
+	unsigned int size() const;
+	void resize(unsigned int size);
+
+	void retain();
+	void release();
+
+	static FramePtr create(FramePtr parent, unsigned int size);
+protected:
+	virtual unsigned int referenceCount() const override;
+	virtual void traverse(const Visitor& visit) const override;
+	virtual void clear() override;
+	virtual void pin() override;
+	virtual void unpin() override;
+private:
+	Frame();
+
+	FramePtr _parent;
+	std::vector<Value> _slots;
+	unsigned int _ref_count;
+	Frame* _next_free;
+};
+
+/* ===== FramePtr (inline) ===== */
+
+inline FramePtr::FramePtr()
+	: _frame(nullptr) {}
+
+inline FramePtr::FramePtr(Frame* frame)
+	: _frame(frame) {
+	if (_frame) {
+		_frame->retain();
+	}
+}
+
+inline FramePtr::FramePtr(const FramePtr& other)
+	: FramePtr(other._frame) {}
+
+inline FramePtr::FramePtr(FramePtr&& other) noexcept
+	: _frame(other._frame) {
+	other._frame = nullptr;
+}
+
+inline FramePtr::~FramePtr() {
+	if (_frame) {
+		_frame->release();
+	}
+}
+
+inline FramePtr& FramePtr::operator=(FramePtr other) {
+	std::swap(_frame, other._frame);
+	return *this;
+}
+
+inline Frame* FramePtr::get() const {
+	return _frame;
+}
+
+inline Frame* FramePtr::operator->() const {
+	return _frame;
+}
+
+inline Frame& FramePtr::operator*() const {
+	return *_frame;
+}
+
+inline FramePtr::operator bool() const {
+	return _frame != nullptr;
+}
+
+/* ===== Frame (inline) ===== */
+
+inline Frame* Frame::parent() const {
+	return _parent.get();
+}
+
+inline Frame* Frame::ancestor(unsigned int depth) {
+	Frame* frame = this;
+	for (; depth > 0; --depth) {
+		frame = frame->_parent.get();
+	}
+
+	return frame;
+}
+
+inline Value& Frame::operator[](unsigned int slot) {
+	return _slots[slot];
+}
+
+inline Value* Frame::data() {
+	return _slots.data();
+}
+
+inline void Frame::retain() {
+	++_ref_count;
+}
+
+#endif
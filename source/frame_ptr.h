@@ -0,0 +1,26 @@
+#ifndef _FRAME_PTR_H_
+#define _FRAME_PTR_H_
+
+class Frame;
+
+// Intrusive handle to a Frame. Closures keep the frame they were created in alive through one of
+// these, and a frame keeps its lexically enclosing frame alive through its parent link. Declared apart
+// from Frame so values can hold one; the inline definitions live in frame.h.
+class FramePtr {
+public:
+	FramePtr();
+	FramePtr(Frame* frame);
+	FramePtr(const FramePtr& other);
+	FramePtr(FramePtr&& other) noexcept;
+	~FramePtr();
+	FramePtr& operator=(FramePtr other);
+
+	Frame* get() const;
+	Frame* operator->() const;
+	Frame& operator*() const;
+	explicit operator bool() const;
+private:
+	Frame* _frame;
+};
+
+#endif
@@ -1,19 +1,30 @@
 #include <sstream>
 #include <functional>
 #include <cmath>
+#include <limits>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "global_scope.h"
 #include "value.h"
+#include "shape.h"
 #include "scope.h"
 #include "astnode.h"
 #include "utility.h"
+#include "output.h"
+#include "serializer.h"
+#include "number_format.h"
+#include "scanner.h"
 
 using namespace std;
 
 /* ==== GlobalVars ====*/
 
-typedef shared_ptr<Value> ValuePtr;
-typedef vector<shared_ptr<Value>> Arguments;
+typedef vector<Value> Arguments;
 
 template <typename Func>
 void addFunctionToGlobalScope(const string& identifier, Func&& func) {
@@ -23,128 +34,326 @@ void addFunctionToGlobalScope(const string& identifier, Func&& func) {
 
 template <typename Func>
 void addUnaryMathFunctionToGlobalScope(const string& identifier, Func&& func) {
-	addFunctionToGlobalScope(identifier, [&func, identifier](const Arguments& arguments) -> ValuePtr {
+	addFunctionToGlobalScope(identifier, [&func, identifier](const Arguments& arguments) -> Value {
 		 if (arguments.size() != 1) {
 			 throw InvalidArgumentsCountError(identifier, 1, arguments.size());
 		 }
 
-		 if (arguments[0]->type() != ValueType::Number) {
+		 if (!arguments[0].isNumber()) {
 			 throw TypeError("Argument is not of type Number");
 		 }
 
 		 auto number = toNumber(arguments[0]);
-		 return NumberValue::create(func(number));
+		 return Value::number(func(number));
 	});
 }
 
 template <typename Func>
 void addBinaryMathFunctionToGlobalScope(const string& identifier, Func&& func) {
-	addFunctionToGlobalScope(identifier, [&func, identifier](const Arguments& arguments) -> ValuePtr {
+	addFunctionToGlobalScope(identifier, [&func, identifier](const Arguments& arguments) -> Value {
 		 if (arguments.size() != 2) {
 			 throw InvalidArgumentsCountError(identifier, 2, arguments.size());
 		 }
 
-		 if (arguments[0]->type() != ValueType::Number) {
+		 if (!arguments[0].isNumber()) {
 			 throw TypeError("First argument is not of type Number");
 		 }
 
-		 if (arguments[1]->type() != ValueType::Number) {
+		 if (!arguments[1].isNumber()) {
 			 throw TypeError("Second argument is not of type Number");
 		 }
 
 		 auto number1 = toNumber(arguments[0]);
 		 auto number2 = toNumber(arguments[1]);
-		 return NumberValue::create(func(number1, number2));
+		 return Value::number(func(number1, number2));
 	});
 }
 
 void setupMetaModule() {
-	addFunctionToGlobalScope("reference_equals", [](const Arguments& arguments) -> ValuePtr {
+	addFunctionToGlobalScope("reference_equals", [](const Arguments& arguments) -> Value {
 		if (arguments.size() != 2) {
 			throw InvalidArgumentsCountError("reference_equals", 2, arguments.size());
 		}
 
-		return BooleanValue::create(arguments[0] == arguments[1]);
+		return Value::boolean(arguments[0].referenceEquals(arguments[1]));
+	});
+
+	// tracked_objects() is how many arrays, objects and closures the cycle collector is watching: the
+	// live ones, and any garbage cycles it hasn't collected yet
+	addFunctionToGlobalScope("tracked_objects", [](const Arguments& arguments) -> Value {
+		if (!arguments.empty()) {
+			throw InvalidArgumentsCountError("tracked_objects", 0, arguments.size());
+		}
+
+		return Value::number(Collector::trackedCount());
+	});
+
+	// shared_shapes() is how many shapes objects have been laid out by, which are never freed
+	addFunctionToGlobalScope("shared_shapes", [](const Arguments& arguments) -> Value {
+		if (!arguments.empty()) {
+			throw InvalidArgumentsCountError("shared_shapes", 0, arguments.size());
+		}
+
+		return Value::number(Shape::sharedCount());
 	});
 }
 
 void setupDataStructuresModule() {
-	addFunctionToGlobalScope("keys", [](const Arguments& arguments) -> ValuePtr {
+	addFunctionToGlobalScope("keys", [](const Arguments& arguments) -> Value {
 		if (arguments.size() != 1) {
 			throw InvalidArgumentsCountError("keys", 1, arguments.size());
 		}
 
 		auto&& argument = arguments[0];
-		if (argument->type() != ValueType::Object) {
+		if (argument.type() != ValueType::Object) {
 			throw TypeError("Argument is not of type Object");
 		}
 
-		auto object = static_pointer_cast<ObjectValue>(argument);
-		auto keys = object->keys();
-
-		return make_shared<ArrayValue>(util::map<ValuePtr>(keys, [](const string& key) {
-			return StringValue::create(key);
-		}));
+		// the keys are the object's interned member names, so they're shared rather than copied
+		auto object = argument.as<ObjectValue>();
+		return ArrayValue::create(object->keys());
 	});
 
-	addFunctionToGlobalScope("length", [](const Arguments& arguments) -> ValuePtr {
+	addFunctionToGlobalScope("length", [](const Arguments& arguments) -> Value {
 		if (arguments.size() != 1) {
 			throw InvalidArgumentsCountError("length", 1, arguments.size());
 		}
 
 		auto&& argument = arguments[0];
-		if (argument->type() != ValueType::Array) {
+		if (argument.type() != ValueType::Array) {
 			throw TypeError("Argument is not of type Array");
 		}
 
-		auto arr = static_pointer_cast<ArrayValue>(argument);
-		return NumberValue::create(arr->length());
+		auto arr = argument.as<ArrayValue>();
+		return Value::number(arr->length());
 	});
 }
 
-void setupIOModule() {
-	addFunctionToGlobalScope("print", [](const Arguments& arguments) -> ValuePtr {
-		auto arguments_count = arguments.size();
+// strings are copied into the output buffer as they are, everything else is formatted into text first
+void printArguments(const Arguments& arguments) {
+	static string text;
+	auto arguments_count = arguments.size();
+
+	for (Arguments::size_type i = 0; i < arguments_count; ++i) {
+		auto&& argument = arguments[i];
+
+		if (argument.type() == ValueType::String) {
+			output::write(argument.as<StringValue>()->view());
+		} else if (argument.type() == ValueType::Buffer) {
+			output::write(argument.as<BufferValue>()->text());
+		} else {
+			// big arrays and objects go out in chunks as they're written
+			text.clear();
+			Serializer(text, [](string_view chunk) { output::write(chunk); }).write(argument);
+			output::write(text);
+		}
+
+		if (i + 1 < arguments_count) {
+			output::write(' ');
+		}
+	}
+}
 
-		for (Arguments::size_type i = 0; i < arguments_count; ++i) {
-			arguments[i]->output(cout);
+// everything left on stdin, read in large blocks through cin's own buffer so it carries on after read and readln
+string readRemainingInput() {
+	output::flush();
 
-			if (i + 1 < arguments_count) {
-				cout << " ";
-			}
+	// a file redirected to stdin can be read in one go, rather than by doubling the buffer until it fits
+	size_t capacity = 64 * 1024;
+	struct stat info;
+	if (fstat(STDIN_FILENO, &info) == 0 && S_ISREG(info.st_mode)) {
+		capacity = max(capacity, static_cast<size_t>(info.st_size) + 1);
+	}
+
+	auto input = cin.rdbuf();
+	string text(capacity, '\0');
+	size_t size = 0;
+
+	while (true) {
+		size += input->sgetn(&text[size], text.size() - size);
+
+		if (size < text.size()) {
+			break;
 		}
 
-		cout << flush;
-		return nullptr;
+		text.resize(text.size() * 2);
+	}
+
+	text.resize(size);
+	cin.setstate(ios::eofbit);
+	return text;
+}
+
+void setupIOModule() {
+	addFunctionToGlobalScope("print", [](const Arguments& arguments) -> Value {
+		printArguments(arguments);
+		return Value::null();
 	});
 
-	addFunctionToGlobalScope("println", [](const Arguments& arguments) -> ValuePtr {
-		auto scope = Scope::getGlobalScope();
-		auto print = static_pointer_cast<FunctionValue>(scope->getValue("print"));
-		print->call(arguments);
-		cout << endl;
-		return nullptr;
+	addFunctionToGlobalScope("println", [](const Arguments& arguments) -> Value {
+		printArguments(arguments);
+		output::write('\n');
+		return Value::null();
 	});
 
-	addFunctionToGlobalScope("read", [](const Arguments& arguments) -> ValuePtr {
+	addFunctionToGlobalScope("read", [](const Arguments& arguments) -> Value {
+		output::flush();
+
 		string str;
 		cin >> str;
 		return StringValue::create(move(str));
 	});
 
-	addFunctionToGlobalScope("readln", [](const Arguments& arguments) -> ValuePtr {
+	addFunctionToGlobalScope("readln", [](const Arguments& arguments) -> Value {
+		output::flush();
+
 		string str;
 		getline(cin, str);
 		return StringValue::create(move(str));
 	});
+
+	addFunctionToGlobalScope("read_all", [](const Arguments& arguments) -> Value {
+		if (!arguments.empty()) {
+			throw InvalidArgumentsCountError("read_all", 0, arguments.size());
+		}
+
+		return StringValue::create(readRemainingInput());
+	});
+
+	// without their line endings, and without an empty line after a final newline
+	addFunctionToGlobalScope("read_lines", [](const Arguments& arguments) -> Value {
+		if (!arguments.empty()) {
+			throw InvalidArgumentsCountError("read_lines", 0, arguments.size());
+		}
+
+		auto input = readRemainingInput();
+		string_view text = input;
+		vector<Value> lines;
+		lines.reserve(scan::countNewlines(text, 0, text.size()) + 1);
+
+		for (size_t start = 0; start < text.size(); ) {
+			auto end = scan::find(text, start, '\n', '\n', '\n');
+			auto line = text.substr(start, end - start);
+
+			if (!line.empty() && line.back() == '\r') {
+				line.remove_suffix(1);
+			}
+
+			lines.push_back(StringValue::create(string(line)));
+			start = end + 1;
+		}
+
+		return ArrayValue::create(move(lines));
+	});
+
+	// every number on the rest of stdin, separated by any whitespace
+	addFunctionToGlobalScope("read_numbers", [](const Arguments& arguments) -> Value {
+		if (!arguments.empty()) {
+			throw InvalidArgumentsCountError("read_numbers", 0, arguments.size());
+		}
+
+		auto input = readRemainingInput();
+		string_view text = input;
+		vector<double> numbers;
+
+		for (size_t start = scan::spaces(text, 0); start < text.size(); start = scan::spaces(text, start)) {
+			auto end = start;
+			while (end < text.size() && !scan::isSpace(text[end])) {
+				++end;
+			}
+
+			double number;
+			auto word = text.substr(start, end - start);
+			if (!number_format::parse(word, number)) {
+				throw TypeError("Invalid number in input: " + string(word));
+			}
+
+			numbers.push_back(number);
+			start = end;
+		}
+
+		return ArrayValue::create(move(numbers));
+	});
+}
+
+void setupFilesModule() {
+	// open_mapped(path) maps the file at path into memory as a buffer, which print writes out whole
+	addFunctionToGlobalScope("open_mapped", [](const Arguments& arguments) -> Value {
+		if (arguments.size() != 1) {
+			throw InvalidArgumentsCountError("open_mapped", 1, arguments.size());
+		}
+
+		if (arguments[0].type() != ValueType::String) {
+			throw TypeError("Argument is not of type String");
+		}
+
+		return BufferValue::map(arguments[0].as<StringValue>()->valueOf());
+	});
+
+	// for (let line in lines(buffer)) reads a buffer a line at a time, each line a view into it
+	addFunctionToGlobalScope("lines", [](const Arguments& arguments) -> Value {
+		if (arguments.size() != 1) {
+			throw InvalidArgumentsCountError("lines", 1, arguments.size());
+		}
+
+		if (arguments[0].type() != ValueType::Buffer) {
+			throw TypeError("Argument is not of type Buffer");
+		}
+
+		return LinesValue::create(arguments[0]);
+	});
+
+	// write_file(path, str) replaces the file at path with str, in one write where the system allows it
+	addFunctionToGlobalScope("write_file", [](const Arguments& arguments) -> Value {
+		if (arguments.size() != 2) {
+			throw InvalidArgumentsCountError("write_file", 2, arguments.size());
+		}
+
+		if (arguments[0].type() != ValueType::String) {
+			throw TypeError("First argument is not of type String");
+		}
+
+		if (arguments[1].type() != ValueType::String) {
+			throw TypeError("Second argument is not of type String");
+		}
+
+		auto& path = arguments[0].as<StringValue>()->valueOf();
+		auto text = arguments[1].as<StringValue>()->view();
+
+		int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			throw FileError("open", path);
+		}
+
+		while (!text.empty()) {
+			auto written = write(fd, text.data(), text.size());
+
+			if (written < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+
+				close(fd);
+				throw FileError("write", path);
+			}
+
+			text.remove_prefix(written);
+		}
+
+		if (close(fd) != 0) {
+			throw FileError("write", path);
+		}
+
+		return Value::null();
+	});
 }
 
 void setupMathModule() {
 	// (note: these are using the long double versions of functions to avoid needing to cast)
 
 	// constants
-	Scope::addToGlobalScope("PI", { true }, NumberValue::create(M_PI));
-	Scope::addToGlobalScope("E", { true }, NumberValue::create(M_E));
+	Scope::addToGlobalScope("PI", { true }, Value::number(M_PI));
+	Scope::addToGlobalScope("E", { true }, Value::number(M_E));
 
 	// general
 	addUnaryMathFunctionToGlobalScope("abs", fabsl);
@@ -188,12 +397,12 @@ void setupMathModule() {
 }
 
 void setupFunctionalModule() {
-	addFunctionToGlobalScope("bind", [](const Arguments& arguments) -> ValuePtr {
+	addFunctionToGlobalScope("bind", [](const Arguments& arguments) -> Value {
 		if (arguments.empty()) {
 			throw InvalidArgumentsCountError("bind", 1, 0);
 		}
 
-		if (arguments[0]->type() != ValueType::Function) {
+		if (arguments[0].type() != ValueType::Function) {
 			throw TypeError("First argument is not of type Function");
 		}
 
@@ -205,19 +414,18 @@ void setupFunctionalModule() {
 		name_stream << "bind_";
 
 		for (auto&& argument : arguments) {
-			argument->output(name_stream);
+			argument.output(name_stream);
 			name_stream << "_";
 		}
 
-		auto func = static_pointer_cast<FunctionValue>(arguments[0]);
-		return BuiltinFunctionValue::create(name_stream.str(), [arguments, func](const Arguments& following_arguments) -> ValuePtr {
+		return BuiltinFunctionValue::create(name_stream.str(), arguments, [](const Arguments& arguments, const Arguments& following_arguments) -> Value {
 			Arguments new_arguments (next(begin(arguments)), end(arguments));
 			new_arguments.insert(end(new_arguments), begin(following_arguments), end(following_arguments));
-			return func->call(new_arguments);
+			return arguments[0].as<FunctionValue>()->call(new_arguments);
 		});
 	});
 
-	addFunctionToGlobalScope("constant", [](const Arguments& arguments) -> ValuePtr {
+	addFunctionToGlobalScope("constant", [](const Arguments& arguments) -> Value {
 		if (arguments.empty()) {
 			throw InvalidArgumentsCountError("constant", 1, 0);
 		}
@@ -225,42 +433,41 @@ void setupFunctionalModule() {
 		const auto& constant_value = arguments[0];
 		ostringstream name_stream;
 		name_stream << "constant_";
-		constant_value->output(name_stream);
+		constant_value.output(name_stream);
 
-		return BuiltinFunctionValue::create(name_stream.str(), [constant_value](const Arguments& arguments) -> ValuePtr {
-			return constant_value;
+		return BuiltinFunctionValue::create(name_stream.str(), { constant_value }, [](const Arguments& captured, const Arguments& arguments) -> Value {
+			return captured[0];
 		});
 	});
 
-	addFunctionToGlobalScope("compose", [](const Arguments& arguments) -> ValuePtr {
+	addFunctionToGlobalScope("compose", [](const Arguments& arguments) -> Value {
 		if (arguments.empty()) {
 			throw InvalidArgumentsCountError("compose", 1, 0);
 		}
 
-		vector<shared_ptr<FunctionValue>> functions;
+		Arguments functions;
 		ostringstream name_stream;
 		name_stream << "compose_";
 
 		for (auto&& argument : arguments) {
-			if (argument->type() != ValueType::Function) {
+			if (argument.type() != ValueType::Function) {
 				throw TypeError("Argument is not of type Function");
 			}
 
-			auto func = static_pointer_cast<FunctionValue>(argument);
-			func->output(name_stream);
+			argument.output(name_stream);
 			name_stream << "_";
 
-			functions.push_back(move(func));
+			functions.push_back(argument);
 		}
 
-		return BuiltinFunctionValue::create(name_stream.str(), [functions](const Arguments& arguments) -> ValuePtr {
-			vector<shared_ptr<Value>> new_arguments = arguments;
-			shared_ptr<Value> returned_value = NullValue::get();
+		return BuiltinFunctionValue::create(name_stream.str(), move(functions), [](const Arguments& functions, const Arguments& arguments) -> Value {
+			Arguments new_arguments = arguments;
+			Value returned_value = Value::null();
 
 			auto end_it = functions.rend();
 			for (auto it = functions.rbegin(); it != end_it; ++it) {
 				auto&& func = *it;
-				returned_value = func->call(new_arguments);
+				returned_value = func.as<FunctionValue>()->call(new_arguments);
 				new_arguments.assign({returned_value});
 			}
 
@@ -268,7 +475,7 @@ void setupFunctionalModule() {
 		});
 	});
 
-	addFunctionToGlobalScope("id", [](const Arguments& arguments) -> ValuePtr {
+	addFunctionToGlobalScope("id", [](const Arguments& arguments) -> Value {
 		if (arguments.size() != 1) {
 			throw InvalidArgumentsCountError("id", 1, arguments.size());
 		}
@@ -277,10 +484,107 @@ void setupFunctionalModule() {
 	});
 }
 
+void setupStringsModule() {
+	// parse_number(str) gives the number str holds, ignoring whitespace around it, or null if it isn't one
+	addFunctionToGlobalScope("parse_number", [](const Arguments& arguments) -> Value {
+		if (arguments.size() != 1) {
+			throw InvalidArgumentsCountError("parse_number", 1, arguments.size());
+		}
+
+		if (arguments[0].type() != ValueType::String) {
+			throw TypeError("Argument is not of type String");
+		}
+
+		auto text = arguments[0].as<StringValue>()->view();
+		auto start = scan::spaces(text, 0);
+		auto end = text.size();
+		while (end > start && scan::isSpace(text[end - 1])) {
+			--end;
+		}
+
+		double number;
+		if (!number_format::parse(text.substr(start, end - start), number)) {
+			return Value::null();
+		}
+
+		return Value::number(number);
+	});
+
+	// to_string(value) gives the text print would show for value. to_string(value, depth) writes arrays
+	// and objects nested more than depth deep as [...] or {...}
+	addFunctionToGlobalScope("to_string", [](const Arguments& arguments) -> Value {
+		if (arguments.size() != 1 && arguments.size() != 2) {
+			throw InvalidArgumentsCountError("to_string", arguments.empty() ? 1 : 2, arguments.size());
+		}
+
+		auto max_depth = Serializer::unlimited_depth;
+		if (arguments.size() == 2) {
+			if (!arguments[1].isNumber()) {
+				throw TypeError("Second argument is not of type Number");
+			}
+
+			auto depth = arguments[1].asNumber();
+			if (!isfinite(depth) || depth < 1) {
+				throw TypeError("Depth has to be a number of at least 1");
+			}
+
+			// nothing nests anywhere near this deep, so it may as well be unlimited
+			if (depth < numeric_limits<uint32_t>::max()) {
+				max_depth = static_cast<size_t>(depth);
+			}
+		}
+
+		if (arguments[0].type() == ValueType::String) {
+			return arguments[0];
+		}
+
+		string text;
+		Serializer(text, nullptr, max_depth).write(arguments[0]);
+		return StringValue::create(move(text));
+	});
+
+	// string_builder() gives an object with append(...), length() and to_string(). Appending goes
+	// onto one growing buffer, so building a string piece by piece is linear
+	addFunctionToGlobalScope("string_builder", [](const Arguments& arguments) -> Value {
+		if (!arguments.empty()) {
+			throw InvalidArgumentsCountError("string_builder", 0, arguments.size());
+		}
+
+		// the methods share the buffer rather than holding the object, so they don't make a cycle with it
+		auto buffer = make_shared<string>();
+		auto builder = ObjectValue::create();
+		auto object = builder.as<ObjectValue>();
+
+		object->setMember("append", BuiltinFunctionValue::create("append", [buffer](const Arguments& arguments) -> Value {
+			for (auto&& argument : arguments) {
+				if (argument.type() == ValueType::String) {
+					buffer->append(argument.as<StringValue>()->valueOf());
+				} else {
+					buffer->append(toDisplayString(argument));
+				}
+			}
+
+			return Value::null();
+		}));
+
+		object->setMember("length", BuiltinFunctionValue::create("length", [buffer](const Arguments& arguments) -> Value {
+			return Value::number(buffer->size());
+		}));
+
+		object->setMember("to_string", BuiltinFunctionValue::create("to_string", [buffer](const Arguments& arguments) -> Value {
+			return StringValue::create(*buffer);
+		}));
+
+		return builder;
+	});
+}
+
 void setupGlobalScope() {
 	setupMetaModule();
 	setupDataStructuresModule();
+	setupStringsModule();
 	setupIOModule();
+	setupFilesModule();
 	setupMathModule();
 	setupFunctionalModule();
 }
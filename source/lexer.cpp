@@ -1,256 +1,237 @@
 #include <string>
-#include <set>
-#include <cctype>
-#include <ios>
+#include <string_view>
 
 #include "lexer.h"
 #include "constants.h"
 #include "errors.h"
+#include "scanner.h"
 
 using namespace std;
 
-// TODO: move these helpers somewhere else
+Lexer::Lexer(SourceBuffer& source, bool report_errors)
+	: _source(source), _input(source.text()), _filename(source.name()), _report_errors(report_errors),
+	  _error_count(0), _position(0), _token_start(0), _line(0), _column(0), _starting_line(0), _starting_column(0) {}
 
-static bool isIdentifier(char c, bool allow_digits = false) {
-	return (isalpha(c) || c == '_') || (allow_digits && isdigit(c));
-}
-
-static string to_string(char c) {
-	return string(1, c);
-}
-
-pair<vector<Token>, int> Lexer::tokenize(istream& input, const string& filename) {
+pair<vector<Token>, int> Lexer::tokenize() {
 	vector<Token> tokens;
-	int error_count = 0;
+	Token token;
 
-	int line = 0;
-	int starting_column = 0;
-	int current_column = 0;
-
-	auto push_token = [&](TokenType type, string text) {
-		TokenMetaData meta = { filename, line, starting_column };
-		tokens.emplace_back(type, meta, text);
-	};
-
-	auto invalid_token = [&](string error) {
-		++error_count;
-		TokenMetaData meta = { filename, line, starting_column };
-		this->error(meta, move(error));
-	};
+	while (next(token)) {
+		tokens.push_back(token);
+	}
 
-	auto peek = [&] {
-		return input.peek();
-	};
+	return { move(tokens), _error_count };
+}
 
-	auto eat_char = [&]() -> char {
-		char c;
-		input >> c;
+int Lexer::errorCount() const {
+	return _error_count;
+}
 
-		if (!input) {
-			return 0;
-		}
+// moves past everything up to end at once, which is found by one of the scans
+void Lexer::skipTo(size_t end) {
+	auto newlines = scan::countNewlines(_input, _position, end);
 
-		if (c == '\n') {
-			current_column = 0;
-			++line;
-		} else {
-			++current_column;
-		}
+	if (newlines == 0) {
+		_column += end - _position;
+	} else {
+		_line += newlines;
+		_column = end - _input.rfind('\n', end - 1) - 1;
+	}
 
-		return c;
-	};
+	_position = end;
+}
 
-	auto has_input = [&] {
-		return bool(input) && !input.eof();
-	};
+Token Lexer::makeToken(TokenType type, string_view text) const {
+	TokenMetaData meta = { _filename, _starting_line, _starting_column };
+	return { type, meta, text };
+}
 
-	input >> noskipws;
+void Lexer::invalidToken(string error) {
+	++_error_count;
+	TokenMetaData meta = { _filename, _line, _starting_column };
+	this->error(meta, move(error));
+}
 
+bool Lexer::next(Token& token) {
 	char current_char;
-	while (has_input()) {
-		starting_column = current_column;
-		current_char = eat_char();
+	while (hasInput()) {
+		_token_start = _position;
+		_starting_line = _line;
+		_starting_column = _column;
+		current_char = eatChar();
 
 		// End of file
 		if (current_char == 0) {
+			_position = _input.size();
 			break;
 
 		// Whitespace
-		} else if (isspace(current_char)) {
-			while (has_input() && isspace(peek())) {
-				eat_char();
-			}
+		} else if (scan::isSpace(current_char)) {
+			skipTo(scan::spaces(_input, _position));
 
 		// Identifiers
-		} else if (isIdentifier(current_char)) {
-			string identifier = to_string(current_char);
-			while (has_input() && isIdentifier(peek(), true)) {
-				current_char = eat_char();
-				identifier += current_char;
-			}
+		} else if (scan::isIdentifierStart(current_char)) {
+			skipTo(scan::identifier(_input, _position));
 
+			auto identifier = tokenText();
 			TokenType type = TokenType::Identifier;
 
 			if (isKeyword(identifier)) {
 				type = TokenType::Builtin;
 			}
 
-			push_token(type, identifier);
+			token = makeToken(type, identifier);
+			return true;
 
 		// Number literals
-		} else if (isdigit(current_char)) {
-			string number_literal = to_string(current_char);
+		} else if (scan::isDigit(current_char)) {
 			bool missing_fractional_part = false;
+			skipTo(scan::digits(_input, _position));
 
-			while (has_input() && isdigit(peek())) {
-				current_char = eat_char();
-				number_literal += current_char;
+			if (peek() == '.') {
+				eatChar();
+				missing_fractional_part = !scan::isDigit(peek());
+				skipTo(scan::digits(_input, _position));
 			}
 
-			if (has_input() && peek() == '.') {
-				eat_char();
-				number_literal += '.';
-				missing_fractional_part = true;
-
-				while (has_input() && isdigit(peek())) {
-					missing_fractional_part = false;
-					current_char = eat_char();
-					number_literal += current_char;
-				}
+			if (!missing_fractional_part) {
+				token = makeToken(TokenType::NumberLiteral, tokenText());
+				return true;
 			}
 
-			if (missing_fractional_part) {
-				invalid_token("missing fractional part of number literal");
-			} else {
-				push_token(TokenType::NumberLiteral, number_literal);
-			}
+			invalidToken("missing fractional part of number literal");
 
 		// String Literals
 		} else if (current_char == '\"' || current_char == '\'') {
-			string string_literal = "";
-			bool is_double_quoted = current_char == '\"';
-			bool last_char_is_slash = false;
+			char quote = current_char;
+
+			// a literal without escapes is its source text, and is only copied once it has one
+			size_t literal_start = _position;
+			bool has_escapes = false;
+			string unescaped;
 
-			while (has_input()) {
-				current_char = eat_char();
+			while (true) {
+				auto end = scan::find(_input, _position, quote, '\\', '\n');
+				if (has_escapes) {
+					unescaped.append(_input.substr(_position, end - _position));
+				}
 
-				if (current_char == '\\') {
-					last_char_is_slash = true;
-					continue;
+				skipTo(end);
+				if (!hasInput()) {
+					break;
 				}
 
-				if (last_char_is_slash) {
-					switch (current_char) {
+				current_char = eatChar();
+
+				if (current_char == quote) {
+					if (has_escapes) {
+						token = makeToken(TokenType::StringLiteral, _source.store(move(unescaped)));
+					} else {
+						token = makeToken(TokenType::StringLiteral, _input.substr(literal_start, _position - 1 - literal_start));
+					}
+
+					return true;
+				} else if (current_char == '\\') {
+					if (!has_escapes) {
+						has_escapes = true;
+						unescaped = string(_input.substr(literal_start, _position - 1 - literal_start));
+					}
+
+					if (!hasInput()) {
+						break;
+					}
+
+					switch (eatChar()) {
 						case '\\':
-							string_literal += '\\';
+							unescaped += '\\';
 							break;
 						case 'n':
-							string_literal += '\n';
+							unescaped += '\n';
 							break;
 						case 't':
-							string_literal += '\t';
+							unescaped += '\t';
 							break;
 						case '\'':
-							string_literal += '\'';
+							unescaped += '\'';
 							break;
 						case '\"':
-							string_literal += '\"';
+							unescaped += '\"';
 							break;
 					}
-
-					last_char_is_slash = false;
 				} else {
-					if (is_double_quoted && current_char == '\"') {
-						push_token(TokenType::StringLiteral, string_literal);
-						break;
-					} else if (!is_double_quoted && current_char == '\'') {
-						push_token(TokenType::StringLiteral, string_literal);
-						break;
-					} else if (current_char == '\n' || !has_input()) {
-						if (is_double_quoted) {
-							invalid_token(errors::expected_close_double_quote);
-						} else {
-							invalid_token(errors::expected_close_single_quote);
-						}
-					}
+					// the literal carries on past the newline, so the rest of it isn't lexed as code
+					invalidToken(quote == '\"' ? errors::expected_close_double_quote : errors::expected_close_single_quote);
 
-					string_literal += current_char;
+					if (has_escapes) {
+						unescaped += current_char;
+					}
 				}
 			}
 
+			invalidToken(quote == '\"' ? errors::expected_close_double_quote : errors::expected_close_single_quote);
+
 		// Comments
 		} else if (current_char == '#') {
-			string comment = "#";
-
-			bool is_block_comment = false;
 			if (peek() == '-') {
-				is_block_comment = true;
-			}
+				// block comments run up to the first "-#", including the hyphen they opened with
+				size_t end = _input.size();
 
-			while (has_input()) {
-				current_char = eat_char();
-
-				if (is_block_comment) {
-					bool last_char_was_hyphen = comment.back() == '-';
-					comment += current_char;
-
-					if ((last_char_was_hyphen && current_char == '#') || !has_input()) {
-						push_token(TokenType::Comment, "BLOCK COMMENT " + comment);
+				for (auto hash = _input.find('#', _position + 1); hash != string_view::npos; hash = _input.find('#', hash + 1)) {
+					if (_input[hash - 1] == '-') {
+						end = hash + 1;
 						break;
 					}
-				} else {
-					if (current_char == '\n' || !has_input()) {
-						push_token(TokenType::Comment, "LINE COMMENT " + comment);
-						break;
-					}
-
-					comment += current_char;
 				}
+
+				skipTo(end);
+			} else {
+				skipTo(scan::find(_input, _position, '\n', '\n', '\n'));
 			}
 
+			token = makeToken(TokenType::Comment, tokenText());
+			return true;
+
 		// Operators
 		} else if (isSymbol(current_char)) {
-			string op = to_string(current_char);
-			bool operator_was_matched = isBuiltin(op);
+			bool operator_was_matched = isBuiltin(tokenText());
 
-			while (has_input()) {
+			while (true) {
 				char peeked = peek();
 
 				if (isSymbol(peeked)) {
-					if (operator_was_matched && !isBuiltin(op + peeked)) {
-						push_token(TokenType::Builtin, op);
-						break;
+					if (operator_was_matched && !isBuiltin(_input.substr(_token_start, _position + 1 - _token_start))) {
+						token = makeToken(TokenType::Builtin, tokenText());
+						return true;
 					}
 
-					current_char = eat_char();
-					op += current_char;
-					operator_was_matched = isBuiltin(op);
+					eatChar();
+					operator_was_matched = isBuiltin(tokenText());
 				} else {
 					if (operator_was_matched) {
-						push_token(TokenType::Builtin, op);
-					} else {
-						invalid_token("unknown operator: " + op);
+						token = makeToken(TokenType::Builtin, tokenText());
+						return true;
 					}
+
+					invalidToken("unknown operator: " + string(tokenText()));
 					break;
 				}
 			}
 
 		// Invalid text
 		} else {
-			string invalid_text = to_string(current_char);
-
-			while (has_input() && !isspace(peek())) {
-				current_char = eat_char();
-				invalid_text += current_char;
+			while (hasInput() && !scan::isSpace(peek())) {
+				eatChar();
 			}
 
-			invalid_token("invalid text: " + invalid_text);
+			invalidToken("invalid text: " + string(tokenText()));
 		}
 	}
 
-	return { tokens, error_count };
+	return false;
 }
 
 void Lexer::error(const TokenMetaData& meta, string error) {
-	printError(meta, move(error));
+	if (_report_errors) {
+		printError(meta, move(error));
+	}
 }
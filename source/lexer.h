@@ -3,15 +3,78 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <stdexcept>
 #include <utility>
 #include "token.h"
+#include "source_buffer.h"
 
+// Lexes one token at a time, so the parser can pull tokens as it needs them rather than the whole
+// source being lexed up front. Tokens are views into source, which stores any string literals that
+// had to be unescaped, so it has to outlive them.
 class Lexer {
 public:
-	// pass stream and filename seperately so main can also use std::cin as input stream
-	std::pair<std::vector<Token>, int> tokenize(std::istream& input, const std::string& filename = "(unknown input)");
+	Lexer(SourceBuffer& source, bool report_errors = true);
+
+	// lexes the next token into token, returning false once the source runs out
+	bool next(Token& token);
+
+	// every token left in the source
+	std::pair<std::vector<Token>, int> tokenize();
+
+	int errorCount() const;
 	void error(const TokenMetaData& meta, std::string error);
+private:
+	bool hasInput() const;
+	char peek() const;
+	char eatChar();
+	void skipTo(std::size_t end);
+	std::string_view tokenText() const;
+
+	Token makeToken(TokenType type, std::string_view text) const;
+	void invalidToken(std::string error);
+
+	SourceBuffer& _source;
+	std::string_view _input;
+	std::string_view _filename;
+	bool _report_errors;
+	int _error_count;
+
+	std::size_t _position;
+	std::size_t _token_start;
+
+	int _line;
+	int _column;
+	int _starting_line;
+	int _starting_column;
 };
 
+/* ===== Lexer (inline) ===== */
+
+inline bool Lexer::hasInput() const {
+	return _position < _input.size();
+}
+
+inline char Lexer::peek() const {
+	return hasInput() ? _input[_position] : '\0';
+}
+
+inline char Lexer::eatChar() {
+	char c = _input[_position++];
+
+	if (c == '\n') {
+		_column = 0;
+		++_line;
+	} else {
+		++_column;
+	}
+
+	return c;
+}
+
+// everything eaten since the token started
+inline std::string_view Lexer::tokenText() const {
+	return _input.substr(_token_start, _position - _token_start);
+}
+
 #endif
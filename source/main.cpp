@@ -1,20 +1,29 @@
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <memory>
 #include <map>
 #include <vector>
 #include <utility>
+#include <chrono>
 
 #include "token.h"
+#include "source_buffer.h"
 #include "lexer.h"
 #include "parser.h"
 #include "astnode.h"
+#include "resolver.h"
+#include "optimizer.h"
+#include "compiler.h"
+#include "virtual_machine.h"
 #include "global_scope.h"
+#include "collector.h"
+#include "scanner.h"
+#include "script_cache.h"
+#include "output.h"
+#include "runtime_errors.h"
 
 using namespace std;
 
-void print_tokens(const vector<Token>& tokens);
+void printTokens(const vector<Token>& tokens);
 
 map<string, vector<string>> getParams(int argc, const char** argv) {
 	--argc;
@@ -29,6 +38,24 @@ map<string, vector<string>> getParams(int argc, const char** argv) {
 			params["print-tokens"].push_back("true");
 		} else if (param == "-pa" || param == "--print-ast") {
 		 	params["print-ast"].push_back("true");
+		} else if (param == "-pb" || param == "--print-bytecode") {
+			params["print-bytecode"].push_back("true");
+		} else if (param == "-t" || param == "--tree-walk") {
+			params["tree-walk"].push_back("true");
+		} else if (param == "-O0" || param == "-O1") {
+			params["optimize"].push_back(param.substr(2));
+		} else if (param == "--lex-only") {
+			params["lex-only"].push_back("true");
+		} else if (param == "--compile-only") {
+			params["compile-only"].push_back("true");
+		} else if (param == "--no-cache") {
+			params["no-cache"].push_back("true");
+		} else if (param == "--time") {
+			params["time"].push_back("true");
+		} else if (param.compare(0, 8, "--flush=") == 0) {
+			params["flush"].push_back(param.substr(8));
+		} else if (param == "--gc-stats") {
+			params["gc-stats"].push_back("true");
 		} else if (param == "--ignore-errors" || param == "-E") {
 			params["ignore-errors"].push_back("true");
 		} else if (param == "-r") {
@@ -66,77 +93,205 @@ void printParams(const map<string, vector<string>>& params) {
 }
 
 int main(int argc, const char** argv) {
+	auto started = chrono::steady_clock::now();
+
+	// nothing uses C stdio, so the streams can keep buffers of their own
+	ios::sync_with_stdio(false);
+
 	auto params = getParams(argc, argv);
 
 	auto exit_with_errors = [](int error_count) {
 		cout << "Exiting with " << error_count << (error_count == 1 ? " error" : " errors") << endl;
 	};
 
-	Lexer lexer;
-	vector<Token> tokens;
 	int error_count = 0;
+	bool ignore_errors = paramIsSet(params, "ignore-errors");
+	bool time = paramIsSet(params, "time");
+
+	auto flush_policy = output::defaultFlushPolicy();
+	if (paramIsSet(params, "flush") && !output::parseFlushPolicy(params["flush"].back(), flush_policy)) {
+		cerr << "ERROR: unknown flush policy " << params["flush"].back() << ", expected line, block or none" << endl;
+		return -1;
+	}
+
+	output::setup(flush_policy);
+
+	// tokens, and the metadata of everything parsed from them, point into the source for the whole run
+	unique_ptr<SourceBuffer> source;
 
 	if (paramIsSet(params, "evaluate")) {
-		auto str = params["evaluate"][0];
-		istringstream stream {str};
-		tie(tokens, error_count) = lexer.tokenize(stream, "(command line)");
+		source = SourceBuffer::fromString(params["evaluate"][0], "(command line)");
 	} else if (paramIsSet(params, "files")) {
 		auto filename = params["files"][0];
-		ifstream file {filename};
+		source = SourceBuffer::fromFile(filename);
 
-		if (file.is_open()) {
-			tie(tokens, error_count) = lexer.tokenize(file, filename);
-		} else {
+		if (!source) {
 			++error_count;
 			cerr << "ERROR: " << filename << " not found" << endl;
 		}
 	} else {
-		tie(tokens, error_count) = lexer.tokenize(cin, "(stdin)");
+		source = SourceBuffer::fromStream(cin, "(stdin)");
 	}
 
-	bool ignore_errors = paramIsSet(params, "ignore-errors");
+	if (!source) {
+		if (!ignore_errors) {
+			exit_with_errors(error_count);
+			return -1;
+		}
 
-	if (!ignore_errors && error_count > 0) {
-		exit_with_errors(error_count);
-		return -1;
+		return 0;
 	}
 
-	if (tokens.empty()) {
-		return 0;
+	// the tokens are only all lexed up front to be timed or printed, since the parser pulls them as it goes
+	bool print_tokens = paramIsSet(params, "print-tokens");
+
+	if (print_tokens || paramIsSet(params, "lex-only")) {
+		Lexer lexer {*source};
+		vector<Token> tokens;
+
+		auto start = chrono::steady_clock::now();
+		tie(tokens, error_count) = lexer.tokenize();
+		chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+		if (time) {
+			auto bytes = source->text().size();
+			cerr << "lexed " << bytes << " bytes into " << tokens.size() << " tokens in "
+				 << elapsed.count() << "s (" << (elapsed.count() > 0 ? bytes / elapsed.count() / 1e6 : 0) << " MB/s, "
+				 << scan::implementation() << " scanner)" << endl;
+		}
+
+		if (paramIsSet(params, "lex-only")) {
+			return error_count > 0 ? -1 : 0;
+		}
+
+		if (!ignore_errors && error_count > 0) {
+			exit_with_errors(error_count);
+			return -1;
+		}
+
+		if (print_tokens) {
+			printTokens(tokens);
+		}
 	}
 
-	if (paramIsSet(params, "print-tokens")) {
-		print_tokens(tokens);
+	setupGlobalScope();
+
+	bool print_ast = paramIsSet(params, "print-ast");
+	bool tree_walk = paramIsSet(params, "tree-walk");
+	bool compile_only = paramIsSet(params, "compile-only");
+
+	// optimizing is on unless -O0 was the last level given
+	bool optimize = !paramIsSet(params, "optimize") || params["optimize"].back() != "0";
+
+	// scripts in files that haven't changed since they were last compiled run straight from the cache
+	unique_ptr<ScriptCache> cache;
+	shared_ptr<const Chunk> chunk;
+
+	auto cache_directory = ScriptCache::defaultDirectory();
+	if (paramIsSet(params, "files") && !paramIsSet(params, "no-cache") && !cache_directory.empty()
+		&& !print_tokens && !print_ast && !tree_walk) {
+		cache = make_unique<ScriptCache>(cache_directory, source->text(), optimize ? "-O1" : "-O0");
+
+		if (!compile_only) {
+			chunk = cache->load();
+		}
+
+		if (chunk) {
+			auto& global_frame = Scope::getGlobalFrame();
+			if (global_frame.size() < chunk->frame_size) {
+				global_frame.resize(chunk->frame_size);
+			}
+		}
 	}
 
-	TokenStream token_stream {begin(tokens), end(tokens), true};
-	Parser parser;
-	shared_ptr<ASTNode> tree;
+	// the tree walker runs the nodes themselves, so the tree has to outlive running the program
+	SyntaxTree tree;
+	ASTNode* root = nullptr;
 
-	setupGlobalScope();
-	tie(tree, error_count) = parser.parse(token_stream);
+	if (!chunk) {
+		// errors were already reported if the tokens were lexed up front
+		Lexer lexer {*source, !print_tokens};
+		TokenStream token_stream {lexer, true};
+		Parser parser;
 
-	if (!ignore_errors && error_count > 0) {
-		exit_with_errors(error_count);
-		return -1;
+		auto start = chrono::steady_clock::now();
+		tie(root, error_count) = parser.parse(token_stream, tree);
+		chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+		error_count += lexer.errorCount();
+
+		if (time) {
+			cerr << "lexed and parsed " << source->text().size() << " bytes into " << tree.nodeCount() << " nodes ("
+				 << tree.bytesAllocated() << " bytes) in " << elapsed.count() << "s" << endl;
+		}
+
+		if (!ignore_errors && error_count > 0) {
+			exit_with_errors(error_count);
+			return -1;
+		}
+
+		if (root) {
+			Resolver resolver;
+			resolver.resolve(root);
+
+			if (optimize) {
+				Optimizer optimizer {tree};
+				optimizer.optimize(root);
+			}
+		}
 	}
 
-	bool print_ast = paramIsSet(params, "print-ast");
-	if (tree) {
+	if (root || chunk) {
 		if (print_ast) {
 			cout << "\nOutput: " << endl;
-			tree->output(cout, 0);
+			root->output(cout, 0);
 			cout << endl;
 		}
 
-		if (print_ast || ignore_errors) {
+		if ((print_ast || ignore_errors) && !compile_only) {
 			cout << "\nEvaluate: " << endl;
 		}
 
 		try {
-			auto eval = tree->evaluate();
-			if (eval) {
-				eval->output(cout);
+			Value eval;
+
+			// a program too big for the bytecode's operands still runs, on the tree walker
+			if (!tree_walk && !chunk) {
+				try {
+					Compiler compiler;
+					chunk = compiler.compile(root);
+				} catch (const FunctionTooLargeError&) {
+					tree_walk = true;
+				}
+
+				// a program with errors in it is only run because of -E, and is never cached
+				if (chunk && cache && error_count == 0) {
+					cache->store(*chunk);
+				}
+			}
+
+			if (!tree_walk && paramIsSet(params, "print-bytecode")) {
+				cout << "\nBytecode: " << endl;
+				chunk->output(cout, 0);
+				cout << endl << endl;
+			}
+
+			if (compile_only) {
+				return 0;
+			}
+
+			if (tree_walk) {
+				eval = root->execute(Scope::getGlobalFrame()).value;
+			} else {
+				if (time) {
+					chrono::duration<double> elapsed = chrono::steady_clock::now() - started;
+					cerr << "started running after " << elapsed.count() << "s" << (root ? "" : " (cached)") << endl;
+				}
+
+				eval = VirtualMachine::execute(*chunk, &Scope::getGlobalFrame());
+			}
+
+			if (!eval.empty()) {
+				eval.output(cout);
 			}
 		} catch (const exception& ex) {
 			++error_count;
@@ -148,16 +303,20 @@ int main(int argc, const char** argv) {
 		cout << "No parse tree produced" << endl;
 	}
 
+	if (paramIsSet(params, "gc-stats")) {
+		Collector::outputStats(cerr);
+	}
+
 	return 0;
 }
 
-void print_tokens(const vector<Token>& tokens) {
+void printTokens(const vector<Token>& tokens) {
 	if (tokens.empty()) {
 		cout << "no tokens" << endl;
 		return;
 	}
 
-	for (auto token : tokens) {
+	for (auto&& token : tokens) {
 		cout << token.type()
 			 << ":\t\"" << token.text() << "\""
 			 << "\t\t" << token.meta()
@@ -0,0 +1,31 @@
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+
+#include "number_format.h"
+
+using namespace std;
+
+namespace number_format {
+	char* format(double number, char* buffer) {
+		// every whole number this small is exact, and integers format much faster than doubles do
+		const double max_exact = 9007199254740992.0;
+
+		if (number == trunc(number) && fabs(number) <= max_exact && (number != 0 || !signbit(number))) {
+			return to_chars(buffer, buffer + max_length, static_cast<int64_t>(number)).ptr;
+		}
+
+		return to_chars(buffer, buffer + max_length, number).ptr;
+	}
+
+	void append(string& out, double number) {
+		char buffer[max_length];
+		out.append(buffer, format(number, buffer));
+	}
+
+	bool parse(string_view text, double& number) {
+		auto end = text.data() + text.size();
+		auto result = from_chars(text.data(), end, number);
+		return result.ec == errc() && result.ptr == end;
+	}
+}
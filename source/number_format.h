@@ -0,0 +1,23 @@
+#ifndef _NUMBER_FORMAT_H_
+#define _NUMBER_FORMAT_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Numbers as they're printed: whole numbers as integers, everything else as the shortest text that
+// reads back as the same double, switching to an exponent when that's shorter, like 1e+21. Neither
+// formatting nor parsing depends on the locale or goes through a stream.
+namespace number_format {
+	// enough for any double, like -2.2250738585072014e-308
+	const std::size_t max_length = 32;
+
+	// writes number at buffer, which has to have max_length bytes free, returning the end
+	char* format(double number, char* buffer);
+	void append(std::string& out, double number);
+
+	// false unless all of text is one number, like 12, -0.5 or 1e+21
+	bool parse(std::string_view text, double& number);
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include "optimizer.h"
+#include "astnode.h"
+#include "scope.h"
+
+using namespace std;
+
+Optimizer::Optimizer(SyntaxTree& tree)
+	: _tree(tree) {}
+
+void Optimizer::optimize(ASTNode*& root) {
+	_constants.clear();
+	_depth = 0;
+
+	// builtins declared const, like PI and E, can never change, so their values can be used directly
+	auto& global_frame = Scope::getGlobalFrame();
+	Scope::getGlobalScope()->forEach([this, &global_frame](const string&, const IdentifierInfo& info, unsigned int slot) {
+		auto& value = global_frame[slot];
+		if (info.is_const && (value.isNumber() || value.isBoolean() || value.isNull())) {
+			_constants.emplace(slot, value);
+		}
+	});
+
+	visit(root);
+	_constants.clear();
+}
+
+// replaces the node with its optimized form, if it has one
+void Optimizer::visit(ASTNode*& node) {
+	if (!node) {
+		return;
+	}
+
+	auto replacement = node->optimize(*this);
+	if (replacement) {
+		node = replacement;
+	}
+}
+
+// replacement nodes are built in the tree being optimized
+SyntaxTree& Optimizer::tree() {
+	return _tree;
+}
+
+void Optimizer::pushFunction() {
+	++_depth;
+}
+
+void Optimizer::popFunction() {
+	--_depth;
+}
+
+// the value of a constant builtin, or an empty value if the variable isn't one
+Value Optimizer::constant(const SlotAddress& address) const {
+	if (!address.isResolved() || address.depth != _depth) {
+		return Value();
+	}
+
+	auto it = _constants.find(address.slot);
+	if (it == end(_constants)) {
+		return Value();
+	}
+
+	return it->second;
+}
+
+// evaluates a node whose operands are all literals, so the folded value is exactly what running it would
+// give. Operations that fail are left for the program to fail on when it runs
+ASTNode* Optimizer::fold(const ASTNode& node) const {
+	Value value;
+
+	try {
+		value = node.evaluate(Scope::getGlobalFrame());
+	} catch (const exception&) {
+		return nullptr;
+	}
+
+	return literal(node, value);
+}
+
+ASTNode* Optimizer::literal(const ASTNode& node, const Value& value) const {
+	if (value.isNumber()) {
+		return _tree.make<NumberLiteralNode>(node.location(), value.asNumber());
+	}
+
+	if (value.isBoolean()) {
+		return _tree.make<BooleanLiteralNode>(node.location(), value.asBoolean());
+	}
+
+	if (value.isNull()) {
+		return _tree.make<NullLiteralNode>(node.location());
+	}
+
+	return nullptr;
+}
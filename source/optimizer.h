@@ -0,0 +1,35 @@
+#ifndef _OPTIMIZER_H_
+#define _OPTIMIZER_H_
+
+#include <memory>
+#include <unordered_map>
+
+#include "value.h"
+#include "resolver.h"
+
+class ASTNode;
+class SyntaxTree;
+
+// Runs after the Resolver at -O1 and rewrites the tree in place. Operators over literals and constant
+// builtins like PI are folded, if and while statements with constant conditions lose their dead
+// branches, and squaring is turned into a multiply.
+class Optimizer {
+public:
+	Optimizer(SyntaxTree& tree);
+	void optimize(ASTNode*& root);
+	void visit(ASTNode*& node);
+	SyntaxTree& tree();
+
+	void pushFunction();
+	void popFunction();
+
+	Value constant(const SlotAddress& address) const;
+	ASTNode* fold(const ASTNode& node) const;
+	ASTNode* literal(const ASTNode& node, const Value& value) const;
+private:
+	SyntaxTree& _tree;
+	std::unordered_map<int, Value> _constants;
+	int _depth = 0;
+};
+
+#endif
@@ -0,0 +1,176 @@
+#include <iostream>
+#include <streambuf>
+#include <vector>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+
+#include "output.h"
+
+using namespace std;
+
+namespace {
+	const size_t block_size = 64 * 1024;
+
+	class Buffer : public streambuf {
+	public:
+		Buffer()
+			: _policy(output::FlushPolicy::Block), _storage(block_size) {
+				reset();
+			}
+
+		void setPolicy(output::FlushPolicy policy) {
+			_policy = policy;
+		}
+
+		void write(const char* text, size_t size) {
+			if (size > room()) {
+				if (_policy == output::FlushPolicy::None) {
+					grow(size);
+				} else {
+					flush();
+
+					// too big to be worth copying
+					if (size > room()) {
+						writeAll(text, size);
+						return;
+					}
+				}
+			}
+
+			memcpy(pptr(), text, size);
+			advance(size);
+
+			if (_policy == output::FlushPolicy::Line && memchr(text, '\n', size)) {
+				flush();
+			}
+		}
+
+		void flush() {
+			writeAll(pbase(), pptr() - pbase());
+			reset();
+		}
+	protected:
+		int_type overflow(int_type c) override {
+			if (_policy == output::FlushPolicy::None) {
+				grow(1);
+			} else {
+				flush();
+			}
+
+			if (!traits_type::eq_int_type(c, traits_type::eof())) {
+				*pptr() = traits_type::to_char_type(c);
+				pbump(1);
+			}
+
+			return traits_type::not_eof(c);
+		}
+
+		streamsize xsputn(const char* text, streamsize size) override {
+			write(text, size);
+			return size;
+		}
+
+		// cin and cerr flush cout before they're used, which keeps errors in order with the output before them
+		int sync() override {
+			flush();
+			return 0;
+		}
+	private:
+		size_t room() const {
+			return epptr() - pptr();
+		}
+
+		void reset() {
+			setp(_storage.data(), _storage.data() + _storage.size());
+		}
+
+		// pbump only takes an int
+		void advance(size_t size) {
+			for (; size > INT_MAX; size -= INT_MAX) {
+				pbump(INT_MAX);
+			}
+
+			pbump(static_cast<int>(size));
+		}
+
+		void grow(size_t size) {
+			size_t used = pptr() - pbase();
+			_storage.resize(max(_storage.size() * 2, used + size));
+			reset();
+			advance(used);
+		}
+
+		// output that can't be written, like to a closed pipe, is dropped
+		static void writeAll(const char* text, size_t size) {
+			while (size > 0) {
+				auto written = ::write(STDOUT_FILENO, text, size);
+
+				if (written < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+
+					return;
+				}
+
+				text += written;
+				size -= written;
+			}
+		}
+
+		output::FlushPolicy _policy;
+		vector<char> _storage;
+	};
+
+	// never destroyed, since cout keeps using it until after everything else is
+	Buffer& buffer() {
+		static Buffer* buffer = [] {
+			auto buffer = new Buffer();
+			cout.rdbuf(buffer);
+			atexit(output::flush);
+			return buffer;
+		}();
+
+		return *buffer;
+	}
+}
+
+namespace output {
+	bool parseFlushPolicy(string_view name, FlushPolicy& policy) {
+		if (name == "line") {
+			policy = FlushPolicy::Line;
+		} else if (name == "block") {
+			policy = FlushPolicy::Block;
+		} else if (name == "none") {
+			policy = FlushPolicy::None;
+		} else {
+			return false;
+		}
+
+		return true;
+	}
+
+	FlushPolicy defaultFlushPolicy() {
+		return isatty(STDOUT_FILENO) ? FlushPolicy::Line : FlushPolicy::Block;
+	}
+
+	void setup(FlushPolicy policy) {
+		buffer().setPolicy(policy);
+	}
+
+	void write(string_view text) {
+		buffer().write(text.data(), text.size());
+	}
+
+	void write(char c) {
+		buffer().write(&c, 1);
+	}
+
+	void flush() {
+		buffer().flush();
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include <string_view>
+
+// Standard output, buffered in userspace and written with write(2) rather than through a flush after
+// every print. Once set up the buffer also sits under cout, so anything else written to cout stays in
+// order with what scripts print. Whatever is buffered is always written before reading from stdin,
+// before anything is written to cerr, when cout is flushed, and when the program exits; otherwise when
+// it's written depends on the policy:
+//   line:  after every line, the default when stdout is a terminal
+//   block: whenever the buffer fills, the default otherwise
+//   none:  never, the buffer grows until one of the above
+namespace output {
+	enum class FlushPolicy {
+		Line,
+		Block,
+		None
+	};
+
+	// from "line", "block" or "none", returning false for anything else
+	bool parseFlushPolicy(std::string_view name, FlushPolicy& policy);
+	FlushPolicy defaultFlushPolicy();
+
+	void setup(FlushPolicy policy);
+
+	void write(std::string_view text);
+	void write(char c);
+	void flush();
+}
+
+#endif
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <utility>
 #include <boost/optional.hpp>
 
@@ -34,12 +35,12 @@ boost::optional<Token> getTokenWithBuiltin(TokenStream& tokens, Builtin builtin)
 
 struct ParserHelper {
 	// <block> ::= <statement>* | "{" <statement>* "}"
-	static shared_ptr<ASTNode> parseBlock(Parser& p, TokenStream& tokens, bool is_global_block = false) {
+	static ASTNode* parseBlock(Parser& p, TokenStream& tokens, bool is_global_block = false) {
 		if (tokens.empty()) {
 			return nullptr;
 		}
 
-		vector<shared_ptr<ASTNode>> statements;
+		vector<ASTNode*> statements;
 
 		auto token = tokens.get();
 		auto block_meta = token.meta();
@@ -68,7 +69,6 @@ struct ParserHelper {
 		}
 
 		p.pushScope();
-		auto scope = p.scope();
 
 		while (tokens.hasNext()) {
 			token = tokens.get();
@@ -76,7 +76,7 @@ struct ParserHelper {
 				break;
 			}
 
-			shared_ptr<ASTNode> statement = parseBlockOrStatement(p, tokens);
+			ASTNode* statement = parseBlockOrStatement(p, tokens);
 			if (!statement) {
 				break;
 			}
@@ -96,11 +96,11 @@ struct ParserHelper {
 			tokens.eat();
 		}
 
-		return make_shared<BlockNode>(block_meta, scope, has_open_brace, move(statements));
+		return p.make<BlockNode>(block_meta, has_open_brace, move(statements));
 	}
 
 	// <if-statement> ::= "if" "(" <expr> ")" <block-or-statement> ["else" <block-or-statement>]
-	static shared_ptr<ASTNode> parseIfStatement(Parser& p, TokenStream& tokens) {
+	static ASTNode* parseIfStatement(Parser& p, TokenStream& tokens) {
 		auto token = tokens.get();
 		auto if_meta = token.meta();
 
@@ -132,7 +132,7 @@ struct ParserHelper {
 			return nullptr;
 		}
 
-		shared_ptr<ASTNode> then_block = parseBlockOrStatement(p, tokens);
+		ASTNode* then_block = parseBlockOrStatement(p, tokens);
 		if (!then_block) {
 			p.error(tokens.meta(), errors::expected_statement);
 			return nullptr;
@@ -140,22 +140,22 @@ struct ParserHelper {
 
 		token_opt = getTokenWithBuiltin(tokens, Builtin::ElseStatement);
 		if (!token_opt) {
-			return make_shared<IfStatementNode>(if_meta, p.scope(), condition, then_block, nullptr);
+			return p.make<IfStatementNode>(if_meta, condition, then_block, nullptr);
 		}
 
 		tokens.eat();
 
-		shared_ptr<ASTNode> else_block = parseBlockOrStatement(p, tokens);
+		ASTNode* else_block = parseBlockOrStatement(p, tokens);
 		if (!else_block) {
 			p.error(tokens.meta(), errors::expected_statement);
 			return nullptr;
 		}
 
-		return make_shared<IfStatementNode>(if_meta, p.scope(), condition, then_block, else_block);
+		return p.make<IfStatementNode>(if_meta, condition, then_block, else_block);
 	}
 
 	// <while-statement> ::= "while" "(" <expr> ")" <block-or-statement>
-	static shared_ptr<ASTNode> parseWhileStatement(Parser& p, TokenStream& tokens) {
+	static ASTNode* parseWhileStatement(Parser& p, TokenStream& tokens) {
 		auto token = tokens.get();
 		auto while_meta = token.meta();
 
@@ -184,7 +184,7 @@ struct ParserHelper {
 		tokens.eat();
 
 		p.pushLoopState(true);
-		shared_ptr<ASTNode> loop_block = parseBlockOrStatement(p, tokens);
+		ASTNode* loop_block = parseBlockOrStatement(p, tokens);
 		p.popLoopState();
 
 		if (!loop_block) {
@@ -192,10 +192,10 @@ struct ParserHelper {
 			return nullptr;
 		}
 
-		return make_shared<WhileStatementNode>(while_meta, p.scope(), move(condition), move(loop_block));
+		return p.make<WhileStatementNode>(while_meta, move(condition), move(loop_block));
 	}
 
-	static shared_ptr<ASTNode> parseForStatement(Parser& p, TokenStream& tokens) {
+	static ASTNode* parseForStatement(Parser& p, TokenStream& tokens) {
 		auto token_opt = getTokenWithBuiltin(tokens, Builtin::ForStatement);
 		if (!token_opt) {
 			p.error(tokens.meta(), errors::expected_for_statement);
@@ -235,7 +235,7 @@ struct ParserHelper {
 			return nullptr;
 		}
 
-		auto identifier = token_opt->text();
+		auto identifier = string(token_opt->text());
 
 		bool added_variable = p.scope()->add(identifier, { iter_is_const });
 		if (!added_variable) {
@@ -268,7 +268,7 @@ struct ParserHelper {
 		tokens.eat();
 
 		p.pushLoopState(true);
-		shared_ptr<ASTNode> loop_block = parseBlockOrStatement(p, tokens);
+		ASTNode* loop_block = parseBlockOrStatement(p, tokens);
 		p.popLoopState();
 
 		if (!loop_block) {
@@ -276,11 +276,11 @@ struct ParserHelper {
 			return nullptr;
 		}
 
-		return make_shared<ForStatementNode>(for_meta, p.scope(), iter_is_const, move(identifier), move(array_expr), move(loop_block));
+		return p.make<ForStatementNode>(for_meta, iter_is_const, move(identifier), move(array_expr), move(loop_block));
 	}
 
 	// <loop-control> ::= "break" | "continue"
-	static shared_ptr<ASTNode> parseLoopControlStatement(Parser& p, TokenStream& tokens) {
+	static ASTNode* parseLoopControlStatement(Parser& p, TokenStream& tokens) {
 		auto token = tokens.get();
 		auto token_text = token.text();
 
@@ -292,16 +292,16 @@ struct ParserHelper {
 		}
 
 		if (isBuiltin(token_text, Builtin::BreakStatement)) {
-			return make_shared<BreakNode>(token.meta(), p.scope());
+			return p.make<BreakNode>(token.meta());
 		} else if (isBuiltin(token_text, Builtin::ContinueStatement)) {
-			return make_shared<ContinueNode>(token.meta(), p.scope());
+			return p.make<ContinueNode>(token.meta());
 		}
 
 		return nullptr;
 	}
 
 	// <statement> ::= <expr>; | <declaration>; | <assignment>; | (<assignment>); | <control-statement>
-	static shared_ptr<ASTNode> parseStatement(Parser& p, TokenStream& tokens) {
+	static ASTNode* parseStatement(Parser& p, TokenStream& tokens) {
 		if (tokens.empty()) {
 			p.error(tokens.meta(), errors::expected_statement);
 			return nullptr;
@@ -311,7 +311,7 @@ struct ParserHelper {
 		auto token_text = token.text();
 
 		bool require_semicolon = true;
-		shared_ptr<ASTNode> statement = nullptr;
+		ASTNode* statement = nullptr;
 
 		if (isBuiltin(token_text, Builtin::IfStatement)) {
 			require_semicolon = false;
@@ -348,7 +348,7 @@ struct ParserHelper {
 		return statement;
 	}
 
-	static shared_ptr<ASTNode> parseBlockOrStatement(Parser& p, TokenStream& tokens) {
+	static ASTNode* parseBlockOrStatement(Parser& p, TokenStream& tokens) {
 		if (tokens.empty()) {
 			p.error(tokens.meta(), errors::expected_statement);
 			return nullptr;
@@ -363,7 +363,7 @@ struct ParserHelper {
 	}
 
 	// <func-decl> ::= "func" "(" <id>* ")" <block>
-	static shared_ptr<ASTNode> parseFunctionDeclaration(Parser& p, TokenStream& tokens) {
+	static ASTNode* parseFunctionDeclaration(Parser& p, TokenStream& tokens) {
 		// TODO: pass identifiers from declarations into here somehow
 
 		auto token_opt = getTokenWithBuiltin(tokens, Builtin::FunctionDeclaration);
@@ -430,7 +430,7 @@ struct ParserHelper {
 			}
 
 			require_identifier = false;
-			auto&& identifier = token_opt->text();
+			auto identifier = string(token_opt->text());
 
 			arguments.push_back(identifier);
 			scope->add(identifier, { is_const });
@@ -464,11 +464,11 @@ struct ParserHelper {
 		scope->add(return_value_alias, { false });
 		p.popScope();
 
-		return make_shared<FunctionDeclarationNode>(function_decl_meta, move(scope), "", arguments, body);
+		return p.make<FunctionDeclarationNode>(function_decl_meta, "", arguments, body);
 	}
 
 	// <paren-expr> ::= "(" <expr> ")"
-	static shared_ptr<ASTNode> parseParenthesesExpression(Parser& p, TokenStream& tokens) {
+	static ASTNode* parseParenthesesExpression(Parser& p, TokenStream& tokens) {
 		auto token_opt = getTokenWithBuiltin(tokens, Builtin::OpenParen);
 		if (!token_opt) {
 			p.error(tokens.meta(), errors::expected_open_paren);
@@ -494,7 +494,7 @@ struct ParserHelper {
 		return expr;
 	}
 
-	static shared_ptr<ASTNode> parseFunctionCall(Parser& p, TokenStream& tokens, shared_ptr<ASTNode> lhs) {
+	static ASTNode* parseFunctionCall(Parser& p, TokenStream& tokens, ASTNode* lhs) {
 		auto token_opt = getTokenWithBuiltin(tokens, Builtin::OpenFunctionCall);
 		if (!token_opt) {
 			p.error(tokens.meta(), errors::expected_open_func_call);
@@ -509,7 +509,7 @@ struct ParserHelper {
 			return nullptr;
 		}
 
-		vector<shared_ptr<ASTNode>> arguments;
+		vector<ASTNode*> arguments;
 
 		while (true) {
 			auto argument = parseExpression(p, tokens);
@@ -546,11 +546,11 @@ struct ParserHelper {
 		}
 
 		tokens.eat();
-		return make_shared<FunctionCallNode>(call_meta, p.scope(), lhs, arguments);
+		return p.make<FunctionCallNode>(call_meta, lhs, arguments);
 	}
 
 	// <array-literal> ::= "[" <expr>,* "]"
-	static shared_ptr<ASTNode> parseArrayLiteral(Parser& p, TokenStream& tokens) {
+	static ASTNode* parseArrayLiteral(Parser& p, TokenStream& tokens) {
 		auto token_opt = getTokenWithBuiltin(tokens, Builtin::OpenArrayLiteral);
 		if (!token_opt) {
 			p.error(tokens.meta(), errors::expected_open_array_literal);
@@ -560,7 +560,7 @@ struct ParserHelper {
 		p.pushLoopState(false);
 
 		auto array_meta = token_opt->meta();
-		vector<shared_ptr<ASTNode>> elements;
+		vector<ASTNode*> elements;
 
 		tokens.eat();
 
@@ -603,10 +603,10 @@ struct ParserHelper {
 		tokens.eat();
 		p.popLoopState();
 
-		return make_shared<ArrayLiteralNode>(array_meta, p.scope(), move(elements));
+		return p.make<ArrayLiteralNode>(array_meta, move(elements));
 	}
 
-	static shared_ptr<ASTNode> parseObjectLiteral(Parser& p, TokenStream& tokens) {
+	static ASTNode* parseObjectLiteral(Parser& p, TokenStream& tokens) {
 		auto token_opt = getTokenWithBuiltin(tokens, Builtin::OpenObjectLiteral);
 		if (!token_opt) {
 			p.error(tokens.meta(), errors::expected_open_object_literal);
@@ -618,8 +618,7 @@ struct ParserHelper {
 		tokens.eat();
 		p.pushLoopState(false);
 
-		auto scope = p.scope();
-		unordered_map<string, shared_ptr<ASTNode>> members;
+		vector<pair<string, ASTNode*>> members;
 
 		while (tokens.hasNext()) {
 			auto token = tokens.get();
@@ -640,7 +639,8 @@ struct ParserHelper {
 					return nullptr;
 			}
 
-			if (members.find(key) != end(members)) {
+			auto is_key = [&key](const pair<string, ASTNode*>& member) { return member.first == key; };
+			if (find_if(begin(members), end(members), is_key) != end(members)) {
 				p.error(token.meta(), errors::redeclared_object_key + key);
 				return nullptr;
 			}
@@ -663,7 +663,7 @@ struct ParserHelper {
 				return nullptr;
 			}
 
-			members.emplace(move(key), move(expr));
+			members.emplace_back(move(key), move(expr));
 
 			if (tokens.empty()) {
 				p.error(token.meta(), errors::expected_close_object_literal);
@@ -691,11 +691,11 @@ struct ParserHelper {
 
 		p.popLoopState();
 
-		return make_shared<ObjectLiteralNode>(obj_meta, move(scope), move(members));
+		return p.make<ObjectLiteralNode>(obj_meta, move(members));
 	}
 
 	// <subscript-expr> ::= <expr> "[" <expr> "]"
-	static shared_ptr<ASTNode> parseSubscript(Parser& p, TokenStream& tokens, shared_ptr<ASTNode> lhs) {
+	static ASTNode* parseSubscript(Parser& p, TokenStream& tokens, ASTNode* lhs) {
 		auto token_opt = getTokenWithBuiltin(tokens, Builtin::OpenSubscript);
 		if (!token_opt) {
 			p.error(tokens.meta(), errors::expected_open_subscript);
@@ -724,11 +724,11 @@ struct ParserHelper {
 		}
 
 		tokens.eat();
-		return make_shared<SubscriptNode>(subscript_meta, p.scope(), move(lhs), move(index));
+		return p.make<SubscriptNode>(subscript_meta, move(lhs), move(index));
 	}
 
 	// <member-access> ::= <expr> "." <identifier>
-	static shared_ptr<ASTNode> parseAccessMember(Parser& p, TokenStream& tokens, shared_ptr<ASTNode> lhs) {
+	static ASTNode* parseAccessMember(Parser& p, TokenStream& tokens, ASTNode* lhs) {
 		auto token_opt = getTokenWithBuiltin(tokens, Builtin::AccessMember);
 		if (!token_opt) {
 			p.error(tokens.meta(), errors::expected_access_member);
@@ -746,16 +746,16 @@ struct ParserHelper {
 
 		tokens.eat();
 
-		return make_shared<AccessMemberNode>(access_meta, p.scope(), move(lhs), token_opt->text());
+		return p.make<AccessMemberNode>(access_meta, move(lhs), string(token_opt->text()));
 	}
 
 	// <expr-primary> ::= <number-literal> | <string-literal> | <boolean-literal> | <function-decl> | <function-call>
-	static shared_ptr<ASTNode> parseExpressionPrimary(Parser& p, TokenStream& tokens) {
+	static ASTNode* parseExpressionPrimary(Parser& p, TokenStream& tokens) {
 		if (tokens.empty()) {
 			return nullptr;
 		}
 
-		shared_ptr<ASTNode> expr;
+		ASTNode* expr = nullptr;
 		auto token = tokens.get();
 		auto token_text = token.text();
 
@@ -763,13 +763,13 @@ struct ParserHelper {
 			case TokenType::Builtin: {
 				if (isBuiltin(token_text, Builtin::TrueLiteral)) {
 					tokens.eat();
-					expr = make_shared<BooleanLiteralNode>(token.meta(), p.scope(), true);
+					expr = p.make<BooleanLiteralNode>(token.meta(), true);
 				} else if (isBuiltin(token_text, Builtin::FalseLiteral)) {
 					tokens.eat();
-					expr = make_shared<BooleanLiteralNode>(token.meta(), p.scope(), false);
+					expr = p.make<BooleanLiteralNode>(token.meta(), false);
 				} else if (isBuiltin(token_text, Builtin::NullLiteral)) {
 					tokens.eat();
-					expr = make_shared<NullLiteralNode>(token.meta(), p.scope());
+					expr = p.make<NullLiteralNode>(token.meta());
 				} else if (isBuiltin(token_text, Builtin::FunctionDeclaration)) {
 					expr = parseFunctionDeclaration(p, tokens);
 				} else if (isBuiltin(token_text, Builtin::Return)) {
@@ -777,7 +777,7 @@ struct ParserHelper {
 					tokens.eat();
 
 					auto rhs = parseExpression(p, tokens);
-					expr = make_shared<ReturnNode>(return_meta, p.scope(), rhs);
+					expr = p.make<ReturnNode>(return_meta, rhs);
 				} else if (isBuiltin(token_text, Builtin::OpenParen)) {
 					expr = parseParenthesesExpression(p, tokens);
 				} else if (isBuiltin(token_text, Builtin::OpenArrayLiteral)) {
@@ -789,20 +789,21 @@ struct ParserHelper {
 			case TokenType::Identifier: {
 				// TODO: handle closures
 				tokens.eat();
-				if (p.scope()->contains(token_text)) {
-					expr = make_shared<IdentifierNode>(token.meta(), p.scope(), token_text);
+				auto identifier = string(token_text);
+				if (p.scope()->contains(identifier)) {
+					expr = p.make<IdentifierNode>(token.meta(), identifier);
 				} else {
-					p.error(token.meta(), errors::undeclared_identifier + token_text);
+					p.error(token.meta(), errors::undeclared_identifier + identifier);
 					return nullptr;
 				}
 			} break;
 			case TokenType::NumberLiteral: {
 				tokens.eat();
-				expr = make_shared<NumberLiteralNode>(token.meta(), p.scope(), token_text);
+				expr = p.make<NumberLiteralNode>(token.meta(), string(token_text));
 			} break;
 			case TokenType::StringLiteral: {
 				tokens.eat();
-				expr = make_shared<StringLiteralNode>(token.meta(), p.scope(), token_text);
+				expr = p.make<StringLiteralNode>(token.meta(), string(token_text));
 			} break;
 			default:
 				break;
@@ -835,7 +836,7 @@ struct ParserHelper {
 	}
 
 	// <unary-op> ::= "-" <expr> | "not" <expr> | ...
-	static shared_ptr<ASTNode> parseUnaryOperator(Parser& p, TokenStream& tokens, shared_ptr<ASTNode> lhs) {
+	static ASTNode* parseUnaryOperator(Parser& p, TokenStream& tokens, ASTNode* lhs) {
 		if (tokens.empty()) {
 			return lhs;
 		}
@@ -867,7 +868,7 @@ struct ParserHelper {
 			auto expr = parseUnaryOperator(p, tokens, nullptr);
 			expr = parseBinaryOperator(p, tokens, expr, op_info.precedence);
 
-			return make_shared<UnaryOperatorNode>(token.meta(), p.scope(), op, expr);
+			return p.make<UnaryOperatorNode>(token.meta(), op, expr);
 		} else {
 			// TODO: postfix operators
 			return nullptr;
@@ -875,7 +876,7 @@ struct ParserHelper {
 	}
 
 	// <bin-op> ::= <expr> "+" <expr> | <expr> "-" <expr> | ...
-	static shared_ptr<ASTNode> parseBinaryOperator(Parser& p, TokenStream& tokens, shared_ptr<ASTNode> lhs, int min_precedence) {
+	static ASTNode* parseBinaryOperator(Parser& p, TokenStream& tokens, ASTNode* lhs, int min_precedence) {
 		while (true) {
 			if (tokens.empty()) {
 				return lhs;
@@ -898,12 +899,12 @@ struct ParserHelper {
 
 			if (isAssignmentOperator(op_info)) {
 				if (!lhs->isLValue()) {
-					p.error(lhs->meta(), errors::expected_lvalue);
+					p.error(p.meta(*lhs), errors::expected_lvalue);
 					return nullptr;
 				}
 
 				if (lhs->isConst(p.scope())) {
-					p.error(lhs->meta(), errors::assigning_constant);
+					p.error(p.meta(*lhs), errors::assigning_constant);
 					return nullptr;
 				}
 			}
@@ -958,12 +959,12 @@ struct ParserHelper {
 				}
 			}
 
-			lhs = make_shared<BinaryOperatorNode>(token.meta(), p.scope(), op, lhs, rhs);
+			lhs = p.make<BinaryOperatorNode>(token.meta(), op, lhs, rhs);
 		}
 	}
 
 	// <expr> ::= (<expr>) | <identifier> | <number-literal> | <string-literal> | <func-call> | <bin-op-expr> | <unary-op-expr>
-	static shared_ptr<ASTNode> parseExpression(Parser& p, TokenStream& tokens) {
+	static ASTNode* parseExpression(Parser& p, TokenStream& tokens) {
 		if (tokens.empty()) {
 			return nullptr;
 		}
@@ -973,7 +974,7 @@ struct ParserHelper {
 	}
 
 	// <declaration> ::= "var" <identifier> | "var" <identifier> = <expr>
-	static shared_ptr<DeclarationNode> parseDeclaration(Parser& p, TokenStream& tokens) {
+	static DeclarationNode* parseDeclaration(Parser& p, TokenStream& tokens) {
 		if (tokens.empty()) {
 			return nullptr;
 		}
@@ -999,7 +1000,7 @@ struct ParserHelper {
 			return nullptr;
 		}
 
-		auto id = token_opt->text();
+		auto id = string(token_opt->text());
 		auto scope = p.scope();
 
 		bool added_variable = scope->add(id, { is_const });
@@ -1010,7 +1011,7 @@ struct ParserHelper {
 
 		tokens.eat();
 
-		shared_ptr<ASTNode> expr = nullptr;
+		ASTNode* expr = nullptr;
 
 		if (tokens.empty() && is_const) {
 			p.error(tokens.meta(), errors::expected_declaration_expression);
@@ -1035,12 +1036,13 @@ struct ParserHelper {
 			}
 		}
 
-		return make_shared<DeclarationNode>(declaration_meta, move(scope), is_const, id, expr);
+		return p.make<DeclarationNode>(declaration_meta, is_const, id, expr);
 	}
 };
 
 // <top> ::= <block>
-pair<shared_ptr<ASTNode>, int> Parser::parse(TokenStream& tokens) {
+pair<ASTNode*, int> Parser::parse(TokenStream& tokens, SyntaxTree& tree) {
+	_tree = &tree;
 	_error_count = 0;
 
 	if (tokens.empty()) {
@@ -1059,6 +1061,10 @@ void Parser::error(const TokenMetaData& meta, const string& error) {
 	printError(meta, error);
 }
 
+TokenMetaData Parser::meta(const ASTNode& node) const {
+	return _tree->meta(node);
+}
+
 std::shared_ptr<Scope> Parser::scope() {
 	return _scope;
 }
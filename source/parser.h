@@ -8,12 +8,18 @@
 #include "token.h"
 #include "token_stream.h"
 #include "astnode.h"
+#include "syntax_tree.h"
 
 class Parser {
 public:
-	std::pair<std::shared_ptr<ASTNode>, int> parse(TokenStream& tokens);
+	// nodes are built in tree, which owns them
+	std::pair<ASTNode*, int> parse(TokenStream& tokens, SyntaxTree& tree);
 	void error(const TokenMetaData& meta, const std::string& error);
 
+	template <typename Node, typename... Args>
+	Node* make(const TokenMetaData& meta, Args&&... args);
+	TokenMetaData meta(const ASTNode& node) const;
+
 	std::shared_ptr<Scope> scope();
 	void pushScope(bool is_function_scope = false);
 	void popScope();
@@ -22,9 +28,17 @@ public:
 	void pushLoopState(bool in_loop);
 	void popLoopState();
 private:
+	SyntaxTree* _tree;
 	int _error_count;
 	std::shared_ptr<Scope> _scope;
 	std::stack<bool> _in_loop;
 };
 
+/* ===== Parser (inline) ===== */
+
+template <typename Node, typename... Args>
+Node* Parser::make(const TokenMetaData& meta, Args&&... args) {
+	return _tree->make<Node>(meta, std::forward<Args>(args)...);
+}
+
 #endif
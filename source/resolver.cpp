@@ -0,0 +1,76 @@
+#include "resolver.h"
+#include "astnode.h"
+#include "scope.h"
+
+using namespace std;
+
+void Resolver::resolve(ASTNode* root) {
+	_functions.clear();
+
+	// the program itself runs in the global frame, after the builtins
+	auto global_scope = Scope::getGlobalScope();
+	_functions.push_back({ { {} }, global_scope->size() });
+
+	global_scope->forEach([this](const string& identifier, const IdentifierInfo&, unsigned int slot) {
+		_functions.back().blocks.back().emplace(identifier, slot);
+	});
+
+	root->resolve(*this);
+
+	auto& global_frame = Scope::getGlobalFrame();
+	if (global_frame.size() < _functions.back().size) {
+		global_frame.resize(_functions.back().size);
+	}
+
+	_functions.clear();
+}
+
+int Resolver::declare(const string& identifier) {
+	auto& function = _functions.back();
+	int slot = function.size++;
+	function.blocks.back()[identifier] = slot;
+	return slot;
+}
+
+SlotAddress Resolver::lookup(const string& identifier) const {
+	int depth = 0;
+
+	for (auto function = _functions.rbegin(); function != _functions.rend(); ++function, ++depth) {
+		for (auto block = function->blocks.rbegin(); block != function->blocks.rend(); ++block) {
+			auto it = block->find(identifier);
+			if (it != end(*block)) {
+				return { depth, it->second };
+			}
+		}
+	}
+
+	return { -1, -1 };
+}
+
+// the program's own layout is the first one, so anything past it belongs to a function
+bool Resolver::inFunction() const {
+	return _functions.size() > 1;
+}
+
+void Resolver::pushBlock() {
+	_functions.back().blocks.emplace_back();
+}
+
+void Resolver::popBlock() {
+	_functions.back().blocks.pop_back();
+}
+
+// arguments take the first slots of the frame
+void Resolver::pushFunction(const vector<string>& argument_names) {
+	_functions.push_back({ { {} }, 0 });
+
+	for (auto&& argument_name : argument_names) {
+		declare(argument_name);
+	}
+}
+
+unsigned int Resolver::popFunction() {
+	auto size = _functions.back().size;
+	_functions.pop_back();
+	return size;
+}
@@ -0,0 +1,44 @@
+#ifndef _RESOLVER_H_
+#define _RESOLVER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+class ASTNode;
+
+struct SlotAddress {
+	int depth;
+	int slot;
+
+	bool isResolved() const {
+		return slot >= 0;
+	}
+};
+
+// Runs after Parser::parse and binds every variable reference to a (depth, slot) pair, where depth is
+// the number of function boundaries between the reference and the declaration. Block scopes are
+// flattened into the frame of their enclosing function, so each function needs a single frame.
+class Resolver {
+public:
+	void resolve(ASTNode* root);
+
+	int declare(const std::string& identifier);
+	SlotAddress lookup(const std::string& identifier) const;
+	bool inFunction() const;
+
+	void pushBlock();
+	void popBlock();
+	void pushFunction(const std::vector<std::string>& argument_names);
+	unsigned int popFunction();
+private:
+	struct _FunctionLayout {
+		std::vector<std::unordered_map<std::string, int>> blocks;
+		unsigned int size;
+	};
+
+	std::vector<_FunctionLayout> _functions;
+};
+
+#endif
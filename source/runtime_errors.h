@@ -18,6 +18,12 @@ public:
 		: std::runtime_error("Undefined variable name: " + identifier) {}
 };
 
+class FileError : public std::runtime_error {
+public:
+	FileError(const std::string& action, const std::string& path)
+		: std::runtime_error("Couldn't " + action + " file: " + path) {}
+};
+
 class InvalidArgumentsCountError : public std::runtime_error {
 public:
 	InvalidArgumentsCountError(const std::string& identifier, int expected, int passed)
@@ -27,7 +33,11 @@ public:
 class OutOfBoundsError : public std::runtime_error {
 public:
 	OutOfBoundsError(int index, int length)
-		: std::runtime_error("Invalid index: " + std::to_string(index) + " for array of length " + std::to_string(length)) {}
+		: OutOfBoundsError(std::to_string(index), length, "array") {}
+
+	// index as displayed, since it may not be a whole number, like NaN
+	OutOfBoundsError(const std::string& index, std::size_t length, const std::string& sequence)
+		: std::runtime_error("Invalid index: " + index + " for " + sequence + " of length " + std::to_string(length)) {}
 };
 
 class InvalidPropertyType : public std::runtime_error {
@@ -48,4 +58,11 @@ public:
 		: std::runtime_error(error_message) {}
 };
 
+// more registers, constants or jump distance than bytecode operands can hold
+class FunctionTooLargeError : public InterpretorError {
+public:
+	FunctionTooLargeError()
+		: InterpretorError("function too large to compile") {}
+};
+
 #endif
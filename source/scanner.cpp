@@ -0,0 +1,264 @@
+#include <cstdint>
+
+#include "scanner.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(WATER_SCALAR_SCAN)
+#define WATER_SIMD_SCAN 1
+#include <immintrin.h>
+#define WATER_SSE2 __attribute__((target("sse2")))
+#define WATER_AVX2 __attribute__((target("avx2")))
+#endif
+
+using namespace std;
+using namespace scan::_Details;
+
+/* ===== Character classes ===== */
+
+static constexpr array<unsigned char, 256> makeCharClasses() {
+	array<unsigned char, 256> classes {};
+
+	for (unsigned int c = 0; c < 256; ++c) {
+		bool is_letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+		bool is_digit = c >= '0' && c <= '9';
+
+		classes[c] = ((c == ' ' || (c >= '\t' && c <= '\r')) ? Space : 0)
+			| (is_digit ? Digit : 0)
+			| (is_letter ? IdentifierStart : 0)
+			| (is_letter || is_digit ? Identifier : 0);
+	}
+
+	return classes;
+}
+
+const array<unsigned char, 256> scan::_Details::char_classes = makeCharClasses();
+
+/* ===== Scalar scans ===== */
+
+template <CharClass char_class>
+static size_t runScalar(string_view text, size_t position) {
+	while (position < text.size() && hasClass(text[position], char_class)) {
+		++position;
+	}
+
+	return position;
+}
+
+static size_t findScalar(string_view text, size_t position, char a, char b, char c) {
+	while (position < text.size()) {
+		char current = text[position];
+		if (current == a || current == b || current == c) {
+			break;
+		}
+
+		++position;
+	}
+
+	return position;
+}
+
+static size_t countNewlinesScalar(string_view text, size_t from, size_t to) {
+	size_t newlines = 0;
+	for (; from < to; ++from) {
+		newlines += text[from] == '\n';
+	}
+
+	return newlines;
+}
+
+#if WATER_SIMD_SCAN
+
+/* ===== SSE2 scans ===== */
+
+// lo <= c <= hi for each byte, as unsigned bytes
+WATER_SSE2 static inline __m128i inRange16(__m128i c, char lo, char hi) {
+	auto offset = _mm_sub_epi8(c, _mm_set1_epi8(lo));
+	return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(hi - lo)), offset);
+}
+
+template <CharClass char_class>
+WATER_SSE2 static inline __m128i classify16(__m128i c) {
+	auto digits = inRange16(c, '0', '9');
+
+	if (char_class == Space) {
+		return _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')), inRange16(c, '\t', '\r'));
+	} else if (char_class == Digit) {
+		return digits;
+	} else {
+		// setting the case bit folds upper case letters onto lower case ones, and nothing else onto them
+		auto letters = inRange16(_mm_or_si128(c, _mm_set1_epi8(0x20)), 'a', 'z');
+		return _mm_or_si128(_mm_or_si128(letters, digits), _mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+	}
+}
+
+template <CharClass char_class>
+WATER_SSE2 static size_t runSse2(string_view text, size_t position) {
+	auto data = text.data();
+
+	for (; position + 16 <= text.size(); position += 16) {
+		auto chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position));
+		unsigned int outside = ~_mm_movemask_epi8(classify16<char_class>(chars)) & 0xffff;
+
+		if (outside) {
+			return position + __builtin_ctz(outside);
+		}
+	}
+
+	return runScalar<char_class>(text, position);
+}
+
+WATER_SSE2 static size_t findSse2(string_view text, size_t position, char a, char b, char c) {
+	auto data = text.data();
+
+	for (; position + 16 <= text.size(); position += 16) {
+		auto chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position));
+		auto matches = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(a)), _mm_cmpeq_epi8(chars, _mm_set1_epi8(b))),
+			_mm_cmpeq_epi8(chars, _mm_set1_epi8(c)));
+		unsigned int found = _mm_movemask_epi8(matches);
+
+		if (found) {
+			return position + __builtin_ctz(found);
+		}
+	}
+
+	return findScalar(text, position, a, b, c);
+}
+
+WATER_SSE2 static size_t countNewlinesSse2(string_view text, size_t from, size_t to) {
+	auto data = text.data();
+	size_t newlines = 0;
+
+	for (; from + 16 <= to; from += 16) {
+		auto chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + from));
+		newlines += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n'))));
+	}
+
+	return newlines + countNewlinesScalar(text, from, to);
+}
+
+/* ===== AVX2 scans ===== */
+
+WATER_AVX2 static inline __m256i inRange32(__m256i c, char lo, char hi) {
+	auto offset = _mm256_sub_epi8(c, _mm256_set1_epi8(lo));
+	return _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8(hi - lo)), offset);
+}
+
+template <CharClass char_class>
+WATER_AVX2 static inline __m256i classify32(__m256i c) {
+	auto digits = inRange32(c, '0', '9');
+
+	if (char_class == Space) {
+		return _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')), inRange32(c, '\t', '\r'));
+	} else if (char_class == Digit) {
+		return digits;
+	} else {
+		auto letters = inRange32(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), 'a', 'z');
+		return _mm256_or_si256(_mm256_or_si256(letters, digits), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_')));
+	}
+}
+
+template <CharClass char_class>
+WATER_AVX2 static size_t runAvx2(string_view text, size_t position) {
+	auto data = text.data();
+
+	for (; position + 32 <= text.size(); position += 32) {
+		auto chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + position));
+		uint32_t outside = ~static_cast<uint32_t>(_mm256_movemask_epi8(classify32<char_class>(chars)));
+
+		if (outside) {
+			return position + __builtin_ctz(outside);
+		}
+	}
+
+	return runSse2<char_class>(text, position);
+}
+
+WATER_AVX2 static size_t findAvx2(string_view text, size_t position, char a, char b, char c) {
+	auto data = text.data();
+
+	for (; position + 32 <= text.size(); position += 32) {
+		auto chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + position));
+		auto matches = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(a)), _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(b))),
+			_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(c)));
+		uint32_t found = _mm256_movemask_epi8(matches);
+
+		if (found) {
+			return position + __builtin_ctz(found);
+		}
+	}
+
+	return findSse2(text, position, a, b, c);
+}
+
+WATER_AVX2 static size_t countNewlinesAvx2(string_view text, size_t from, size_t to) {
+	auto data = text.data();
+	size_t newlines = 0;
+
+	for (; from + 32 <= to; from += 32) {
+		auto chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + from));
+		newlines += __builtin_popcount(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\n')))));
+	}
+
+	return newlines + countNewlinesSse2(text, from, to);
+}
+
+#endif
+
+/* ===== scan ===== */
+
+namespace {
+	struct Scanner {
+		const char* name;
+		size_t (*spaces)(string_view, size_t);
+		size_t (*digits)(string_view, size_t);
+		size_t (*identifier)(string_view, size_t);
+		size_t (*find)(string_view, size_t, char, char, char);
+		size_t (*count_newlines)(string_view, size_t, size_t);
+	};
+}
+
+// picked once, the first time the lexer runs
+static const Scanner& scanner() {
+	static const Scanner selected = [] () -> Scanner {
+#if WATER_SIMD_SCAN
+		__builtin_cpu_init();
+
+		if (__builtin_cpu_supports("avx2")) {
+			return { "avx2", runAvx2<Space>, runAvx2<Digit>, runAvx2<Identifier>, findAvx2, countNewlinesAvx2 };
+		}
+
+		if (__builtin_cpu_supports("sse2")) {
+			return { "sse2", runSse2<Space>, runSse2<Digit>, runSse2<Identifier>, findSse2, countNewlinesSse2 };
+		}
+#endif
+
+		return { "scalar", runScalar<Space>, runScalar<Digit>, runScalar<Identifier>, findScalar, countNewlinesScalar };
+	}();
+
+	return selected;
+}
+
+size_t scan::spaces(string_view text, size_t position) {
+	return scanner().spaces(text, position);
+}
+
+size_t scan::digits(string_view text, size_t position) {
+	return scanner().digits(text, position);
+}
+
+size_t scan::identifier(string_view text, size_t position) {
+	return scanner().identifier(text, position);
+}
+
+size_t scan::find(string_view text, size_t position, char a, char b, char c) {
+	return scanner().find(text, position, a, b, c);
+}
+
+size_t scan::countNewlines(string_view text, size_t from, size_t to) {
+	return scanner().count_newlines(text, from, to);
+}
+
+const char* scan::implementation() {
+	return scanner().name;
+}
@@ -0,0 +1,65 @@
+#ifndef _SCANNER_H_
+#define _SCANNER_H_
+
+#include <array>
+#include <string_view>
+#include <cstddef>
+
+// Character classes and bulk scans for the lexer. Classes come from a table rather than the locale
+// aware <cctype> functions. Runs of a class are scanned 32 or 16 bytes at a time with AVX2 or SSE2,
+// whichever the processor has, or a byte at a time elsewhere. Every scan returns the position of the
+// first character at or after position that ends the run, or the size of the text if none does.
+namespace scan {
+	namespace _Details {
+		enum CharClass : unsigned char {
+			Space = 1,
+			Digit = 2,
+			IdentifierStart = 4,
+			Identifier = 8
+		};
+
+		extern const std::array<unsigned char, 256> char_classes;
+
+		bool hasClass(char c, CharClass char_class);
+	}
+
+	bool isSpace(char c);
+	bool isDigit(char c);
+	bool isIdentifierStart(char c);
+	bool isIdentifier(char c);
+
+	std::size_t spaces(std::string_view text, std::size_t position);
+	std::size_t digits(std::string_view text, std::size_t position);
+	std::size_t identifier(std::string_view text, std::size_t position);
+
+	// the first of a, b or c, which can repeat each other to look for fewer characters
+	std::size_t find(std::string_view text, std::size_t position, char a, char b, char c);
+	std::size_t countNewlines(std::string_view text, std::size_t from, std::size_t to);
+
+	// "avx2", "sse2" or "scalar"
+	const char* implementation();
+}
+
+/* ===== scan (inline) ===== */
+
+inline bool scan::_Details::hasClass(char c, CharClass char_class) {
+	return char_classes[static_cast<unsigned char>(c)] & char_class;
+}
+
+inline bool scan::isSpace(char c) {
+	return _Details::hasClass(c, _Details::Space);
+}
+
+inline bool scan::isDigit(char c) {
+	return _Details::hasClass(c, _Details::Digit);
+}
+
+inline bool scan::isIdentifierStart(char c) {
+	return _Details::hasClass(c, _Details::IdentifierStart);
+}
+
+inline bool scan::isIdentifier(char c) {
+	return _Details::hasClass(c, _Details::Identifier);
+}
+
+#endif
@@ -26,7 +26,8 @@ bool Scope::add(string identifier, IdentifierInfo info) {
 	};
 
 	if (can_add(this)) {
-		_vars.emplace(move(identifier), info);
+		unsigned int slot = _vars.size();
+		_vars.emplace(move(identifier), make_tuple(info, slot));
 		return true;
 	}
 
@@ -41,43 +42,30 @@ bool Scope::isFunctionScope() const {
 	return _is_function_scope;
 }
 
-tuple<IdentifierInfo, shared_ptr<Value>> Scope::get(const string& identifier) const {
+unsigned int Scope::size() const {
+	return _vars.size();
+}
+
+boost::optional<IdentifierInfo> Scope::getInfo(const string& identifier) const {
 	auto it = _vars.find(identifier);
 	if (it != end(_vars)) {
-		return it->second;
+		return std::get<0>(it->second);
 	}
 
 	if (_parent) {
-		return _parent->get(identifier);
+		return _parent->getInfo(identifier);
 	}
 
-	return {};
-}
-
-boost::optional<IdentifierInfo> Scope::getInfo(const string& identifier) const {
-	return std::get<0>(get(identifier));
-}
-
-shared_ptr<Value> Scope::getValue(const string& identifier) const {
-	return std::get<1>(get(identifier));
+	return boost::none;
 }
 
-void Scope::setValue(const string& identifier, shared_ptr<Value> val) {
+boost::optional<unsigned int> Scope::getSlot(const string& identifier) const {
 	auto it = _vars.find(identifier);
 	if (it == end(_vars)) {
-		if (_parent) {
-			_parent->setValue(identifier, move(val));
-			return;
-		}
-
-		throw UndefinedVariableError(identifier);
+		return boost::none;
 	}
 
-	if (val->isReferenceType()) {
-		std::get<1>(it->second) = move(val);
-	} else {
-		std::get<1>(it->second) = val->copy();
-	}
+	return std::get<1>(it->second);
 }
 
 bool Scope::contains(const string& identifier) const {
@@ -92,17 +80,30 @@ bool Scope::contains(const string& identifier) const {
 	return false;
 }
 
-void Scope::clearValues() {
-	for (auto&& var : _vars) {
-		std::get<1>(var.second) = nullptr;
-	}
-}
-
 shared_ptr<Scope>& Scope::getGlobalScope() {
 	return global_scope;
 }
 
-void Scope::addToGlobalScope(string identifier, IdentifierInfo info, shared_ptr<Value> val) {
-	global_scope->add(identifier, info);
-	global_scope->setValue(identifier, val);
+Frame& Scope::getGlobalFrame() {
+	static FramePtr global_frame = Frame::create(nullptr, 0);
+	return *global_frame;
+}
+
+Value Scope::getGlobalValue(const string& identifier) {
+	auto slot = global_scope->getSlot(identifier);
+	if (!slot) {
+		throw UndefinedVariableError(identifier);
+	}
+
+	return getGlobalFrame()[*slot];
+}
+
+void Scope::addToGlobalScope(string identifier, IdentifierInfo info, Value val) {
+	if (!global_scope->add(identifier, info)) {
+		throw InterpretorError("redeclaration of global: " + identifier);
+	}
+
+	auto& frame = getGlobalFrame();
+	frame.resize(global_scope->size());
+	frame[*global_scope->getSlot(identifier)] = move(val);
 }
@@ -7,30 +7,40 @@
 
 #include "table.h"
 #include "value.h"
+#include "frame.h"
 
 struct IdentifierInfo {
 	bool is_const;
 };
 
+// Scopes are the parser's symbol tables. Each identifier is numbered in declaration order; for the
+// global scope that number is its slot in the global frame, which holds the values of the builtins.
 class Scope {
 public:
 	Scope(std::shared_ptr<Scope> parent, bool is_function_scope = false);
-	std::tuple<IdentifierInfo, std::shared_ptr<Value>> get(const std::string& identifier) const;
 	boost::optional<IdentifierInfo> getInfo(const std::string& identifier) const;
-	std::shared_ptr<Value> getValue(const std::string& identifier) const;
-	void setValue(const std::string& identifier, std::shared_ptr<Value> val);
+	boost::optional<unsigned int> getSlot(const std::string& identifier) const;
 	bool contains(const std::string& identifier) const;
 	bool add(std::string identifier, IdentifierInfo info);
 	std::shared_ptr<Scope> parent();
 	bool isFunctionScope() const;
-	void clearValues();
+	unsigned int size() const;
+
+	template <typename Func>
+	void forEach(Func&& func) const {
+		for (auto&& var : _vars) {
+			func(var.first, std::get<0>(var.second), std::get<1>(var.second));
+		}
+	}
 
 	static std::shared_ptr<Scope>& getGlobalScope();
-	static void addToGlobalScope(std::string identifier, IdentifierInfo info, std::shared_ptr<Value> val);
+	static Frame& getGlobalFrame();
+	static Value getGlobalValue(const std::string& identifier);
+	static void addToGlobalScope(std::string identifier, IdentifierInfo info, Value val);
 private:
 	bool _is_function_scope = false;
 	std::shared_ptr<Scope> _parent = nullptr;
-	table<std::string, IdentifierInfo, std::shared_ptr<Value>> _vars;
+	table<std::string, IdentifierInfo, unsigned int> _vars;
 	static std::shared_ptr<Scope> global_scope;
 };
 
@@ -0,0 +1,530 @@
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "script_cache.h"
+#include "scope.h"
+
+using namespace std;
+
+namespace {
+	const char magic[4] = { 'H', '2', 'O', 'C' };
+
+	enum class ConstantTag : uint8_t {
+		Number,
+		String
+	};
+
+	struct Header {
+		char magic[4];
+		uint32_t format_version;
+		uint32_t opcode_count;
+		uint32_t global_slots;
+		uint64_t build_hash;
+		uint64_t source_size;
+		uint64_t source_hash;
+	};
+
+	// FNV-1a
+	uint64_t hashText(string_view text, uint64_t hash = 14695981039346656037ull) {
+		for (char c : text) {
+			hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+		}
+
+		return hash;
+	}
+
+	// the rest of what bytecode depends on besides the script: the opcodes, how instructions are laid
+	// out, and which builtin is in which global slot. Has to be called before the script's globals are declared
+	uint64_t hashBuild() {
+		auto hash = hashText(to_string(sizeof(Instruction)) + " " + to_string(offsetof(Instruction, a)) + " "
+			+ to_string(offsetof(Instruction, b)) + " " + to_string(offsetof(Instruction, c)) + " "
+			+ to_string(Instruction::constant_flag) + "\n");
+
+		for (unsigned int op = 0; op < opcode_count; ++op) {
+			hash = hashText(getOpcodeString(static_cast<Opcode>(op)) + "\n", hash);
+		}
+
+		auto global_scope = Scope::getGlobalScope();
+		vector<string> builtins(global_scope->size());
+
+		global_scope->forEach([&builtins](const string& identifier, const IdentifierInfo&, unsigned int slot) {
+			builtins[slot] = identifier;
+		});
+
+		for (auto&& builtin : builtins) {
+			hash = hashText(builtin + "\n", hash);
+		}
+
+		return hash;
+	}
+
+	class Writer {
+	public:
+		template <typename Type>
+		void write(const Type& value) {
+			_bytes.append(reinterpret_cast<const char*>(&value), sizeof(Type));
+		}
+
+		void write(string_view str) {
+			write(static_cast<uint32_t>(str.size()));
+			_bytes.append(str);
+		}
+
+		void write(const Chunk& chunk) {
+			write(string_view(chunk.identifier));
+			write(static_cast<uint32_t>(chunk.arity));
+			write(static_cast<uint32_t>(chunk.frame_size));
+
+			write(static_cast<uint32_t>(chunk.code.size()));
+			_bytes.append(reinterpret_cast<const char*>(chunk.code.data()), chunk.code.size() * sizeof(Instruction));
+
+			write(static_cast<uint32_t>(chunk.constants.size()));
+			for (auto&& constant : chunk.constants) {
+				if (constant.isNumber()) {
+					write(ConstantTag::Number);
+					write(constant.asNumber());
+				} else {
+					write(ConstantTag::String);
+					write(string_view(constant.as<StringValue>()->valueOf()));
+				}
+			}
+
+			write(static_cast<uint32_t>(chunk.members.size()));
+			for (auto&& member : chunk.members) {
+				write(member.name);
+			}
+
+			write(static_cast<uint32_t>(chunk.functions.size()));
+			for (auto&& function : chunk.functions) {
+				write(*function);
+			}
+		}
+
+		const string& bytes() const {
+			return _bytes;
+		}
+	private:
+		string _bytes;
+	};
+
+	// every read checks it stays inside the file, and a failed read leaves the reader failed for good
+	class Reader {
+	public:
+		Reader(const char* begin, const char* end)
+			: _position(begin), _end(end), _failed(false) {}
+
+		template <typename Type>
+		bool read(Type& value) {
+			if (!has(sizeof(Type))) {
+				return false;
+			}
+
+			memcpy(&value, _position, sizeof(Type));
+			_position += sizeof(Type);
+			return true;
+		}
+
+		bool read(string& str) {
+			uint32_t size;
+			if (!read(size) || !has(size)) {
+				return false;
+			}
+
+			str.assign(_position, size);
+			_position += size;
+			return true;
+		}
+
+		// enclosing holds the frame sizes of the functions the chunk is nested in, outermost first
+		shared_ptr<const Chunk> readChunk(vector<unsigned int>& enclosing) {
+			auto chunk = make_shared<Chunk>();
+			uint32_t arity, frame_size, code_size;
+
+			if (!read(chunk->identifier) || !read(arity) || !read(frame_size) || !read(code_size)) {
+				return nullptr;
+			}
+
+			chunk->arity = arity;
+			chunk->frame_size = frame_size;
+
+			if (!has(static_cast<size_t>(code_size) * sizeof(Instruction))) {
+				return nullptr;
+			}
+
+			chunk->code.resize(code_size);
+			memcpy(chunk->code.data(), _position, code_size * sizeof(Instruction));
+			_position += code_size * sizeof(Instruction);
+
+			for (auto&& instruction : chunk->code) {
+				if (static_cast<unsigned int>(instruction.op) >= opcode_count) {
+					return fail();
+				}
+			}
+
+			uint32_t constants_size;
+			if (!read(constants_size)) {
+				return nullptr;
+			}
+
+			chunk->constants.reserve(min<size_t>(constants_size, _end - _position));
+			for (uint32_t i = 0; i < constants_size; ++i) {
+				ConstantTag tag;
+				if (!read(tag)) {
+					return nullptr;
+				}
+
+				if (tag == ConstantTag::Number) {
+					double number;
+					if (!read(number)) {
+						return nullptr;
+					}
+
+					chunk->constants.push_back(Value::number(number));
+				} else if (tag == ConstantTag::String) {
+					string str;
+					if (!read(str)) {
+						return nullptr;
+					}
+
+					chunk->constants.push_back(StringValue::intern(move(str)));
+				} else {
+					return fail();
+				}
+			}
+
+			uint32_t members_size;
+			if (!read(members_size)) {
+				return nullptr;
+			}
+
+			chunk->members.reserve(min<size_t>(members_size, _end - _position));
+			for (uint32_t i = 0; i < members_size; ++i) {
+				uint16_t name;
+				if (!read(name)) {
+					return nullptr;
+				}
+
+				if (name >= chunk->constants.size() || chunk->constants[name].type() != ValueType::String) {
+					return fail();
+				}
+
+				chunk->members.push_back({ name, {} });
+			}
+
+			uint32_t functions_size;
+			if (!read(functions_size)) {
+				return nullptr;
+			}
+
+			enclosing.push_back(chunk->frame_size);
+
+			for (uint32_t i = 0; i < functions_size; ++i) {
+				auto function = readChunk(enclosing);
+				if (!function) {
+					return nullptr;
+				}
+
+				chunk->functions.push_back(move(function));
+			}
+
+			enclosing.pop_back();
+
+			if (!isValid(*chunk, enclosing)) {
+				return fail();
+			}
+
+			return chunk;
+		}
+
+		bool atEnd() const {
+			return !_failed && _position == _end;
+		}
+	private:
+		// the virtual machine trusts every operand, so any that points outside the chunk, its frame or the
+		// frames around it means the file is corrupt
+		static bool isValid(const Chunk& chunk, const vector<unsigned int>& enclosing) {
+			auto& code = chunk.code;
+
+			if (chunk.frame_size > Instruction::constant_flag || chunk.arity > chunk.frame_size || code.empty()) {
+				return false;
+			}
+
+			// running off the end has to be impossible
+			auto last = code.back().op;
+			if (last != Opcode::Return && last != Opcode::ReturnNull && last != Opcode::Halt) {
+				return false;
+			}
+
+			auto isRegister = [&](unsigned int operand) {
+				return operand < chunk.frame_size;
+			};
+
+			auto isRegisterOrConstant = [&](uint16_t operand) {
+				if (operand & Instruction::constant_flag) {
+					return static_cast<unsigned int>(operand & ~Instruction::constant_flag) < chunk.constants.size();
+				}
+
+				return isRegister(operand);
+			};
+
+			auto isOuterSlot = [&](unsigned int depth, unsigned int slot) {
+				if (depth > enclosing.size()) {
+					return false;
+				}
+
+				return slot < (depth == 0 ? chunk.frame_size : enclosing[enclosing.size() - depth]);
+			};
+
+			// fused tests and ForNext take or skip the jump after them
+			auto isFollowedByJump = [&](size_t i) {
+				return i + 1 < code.size() && code[i + 1].op == Opcode::Jump;
+			};
+
+			for (size_t i = 0; i < code.size(); ++i) {
+				auto& instruction = code[i];
+				bool valid = false;
+
+				switch (instruction.op) {
+					case Opcode::Move:
+					case Opcode::Negate:
+					case Opcode::Not:
+					case Opcode::ToBoolean:
+						valid = isRegister(instruction.a) && isRegister(instruction.b);
+						break;
+					case Opcode::LoadConstant:
+						valid = isRegister(instruction.a) && instruction.b < chunk.constants.size();
+						break;
+					case Opcode::LoadNull:
+					case Opcode::LoadBoolean:
+					case Opcode::NewObject:
+					case Opcode::Return:
+						valid = isRegister(instruction.a);
+						break;
+					case Opcode::GetOuter:
+					case Opcode::SetOuter:
+						valid = isRegister(instruction.a) && isOuterSlot(instruction.b, instruction.c);
+						break;
+					case Opcode::Add:
+					case Opcode::Subtract:
+					case Opcode::Multiply:
+					case Opcode::Divide:
+					case Opcode::Modulus:
+					case Opcode::Exponent:
+					case Opcode::LessThan:
+					case Opcode::LessThanOrEqual:
+					case Opcode::GreaterThan:
+					case Opcode::GreaterThanOrEqual:
+					case Opcode::EqualTo:
+					case Opcode::NotEqualTo:
+						valid = isRegister(instruction.a) && isRegisterOrConstant(instruction.b) && isRegisterOrConstant(instruction.c);
+						break;
+					case Opcode::Jump:
+						valid = instruction.target() < code.size();
+						break;
+					case Opcode::JumpIfFalse:
+					case Opcode::JumpIfTrue:
+						valid = isRegister(instruction.a) && instruction.target() < code.size();
+						break;
+					case Opcode::TestLessThan:
+					case Opcode::TestLessThanOrEqual:
+					case Opcode::TestGreaterThan:
+					case Opcode::TestGreaterThanOrEqual:
+					case Opcode::TestEqualTo:
+					case Opcode::TestNotEqualTo:
+						valid = isRegisterOrConstant(instruction.b) && isRegisterOrConstant(instruction.c) && isFollowedByJump(i);
+						break;
+					case Opcode::NewArray:
+						valid = isRegister(instruction.a) && instruction.b + instruction.c <= chunk.frame_size;
+						break;
+					case Opcode::GetIndex:
+					case Opcode::SetIndex:
+						valid = isRegister(instruction.a) && isRegister(instruction.b) && isRegister(instruction.c);
+						break;
+					case Opcode::GetMember:
+						valid = isRegister(instruction.a) && isRegister(instruction.b) && instruction.c < chunk.members.size();
+						break;
+					case Opcode::SetMember:
+						valid = isRegister(instruction.a) && instruction.b < chunk.members.size() && isRegister(instruction.c);
+						break;
+					case Opcode::Call:
+						valid = isRegister(instruction.a) && isRegister(instruction.b + instruction.c);
+						break;
+					case Opcode::Closure:
+						valid = isRegister(instruction.a) && instruction.b < chunk.functions.size();
+						break;
+					case Opcode::ForPrepare:
+						valid = isRegister(instruction.a + 2);
+						break;
+					case Opcode::ForNext:
+						valid = isRegister(instruction.a + 2) && isRegister(instruction.b) && isFollowedByJump(i);
+						break;
+					case Opcode::ThrowUndefined:
+						valid = instruction.a < chunk.constants.size() && chunk.constants[instruction.a].type() == ValueType::String;
+						break;
+					case Opcode::ReturnNull:
+					case Opcode::Halt:
+						valid = true;
+						break;
+				}
+
+				if (!valid) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		bool has(size_t size) {
+			if (_failed || static_cast<size_t>(_end - _position) < size) {
+				_failed = true;
+			}
+
+			return !_failed;
+		}
+
+		shared_ptr<const Chunk> fail() {
+			_failed = true;
+			return nullptr;
+		}
+
+		const char* _position;
+		const char* _end;
+		bool _failed;
+	};
+
+	bool makeDirectories(const string& path) {
+		for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+			auto directory = path.substr(0, slash);
+
+			if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+				return false;
+			}
+
+			if (slash == string::npos) {
+				return true;
+			}
+		}
+	}
+}
+
+/* ===== ScriptCache ===== */
+
+ScriptCache::ScriptCache(string directory, string_view source, const string& options)
+	: _directory(move(directory)), _global_slots(Scope::getGlobalScope()->size()), _build_hash(hashBuild()), _source_size(source.size()), _source_hash(hashText(source)) {
+		char name[17];
+		snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hashText(options, _source_hash)));
+		_path = _directory + "/" + name + ".h2oc";
+	}
+
+shared_ptr<const Chunk> ScriptCache::load() const {
+	int fd = open(_path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return nullptr;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(Header)) {
+		close(fd);
+		return nullptr;
+	}
+
+	auto size = static_cast<size_t>(info.st_size);
+	auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (mapping == MAP_FAILED) {
+		return nullptr;
+	}
+
+	auto bytes = static_cast<const char*>(mapping);
+	Reader reader { bytes, bytes + size };
+	shared_ptr<const Chunk> chunk;
+
+	Header header;
+	reader.read(header);
+
+	if (memcmp(header.magic, magic, sizeof(magic)) == 0
+		&& header.format_version == format_version
+		&& header.opcode_count == opcode_count
+		&& header.global_slots == _global_slots
+		&& header.build_hash == _build_hash
+		&& header.source_size == _source_size
+		&& header.source_hash == _source_hash) {
+		vector<unsigned int> enclosing;
+		chunk = reader.readChunk(enclosing);
+
+		if (!reader.atEnd()) {
+			chunk = nullptr;
+		}
+	}
+
+	munmap(mapping, size);
+	return chunk;
+}
+
+// written to a temporary file that's renamed over the old one, so a concurrent load sees one or the other
+bool ScriptCache::store(const Chunk& chunk) const {
+	if (!makeDirectories(_directory)) {
+		return false;
+	}
+
+	Writer writer;
+
+	Header header {};
+	memcpy(header.magic, magic, sizeof(magic));
+	header.format_version = format_version;
+	header.opcode_count = opcode_count;
+	header.global_slots = _global_slots;
+	header.build_hash = _build_hash;
+	header.source_size = _source_size;
+	header.source_hash = _source_hash;
+
+	writer.write(header);
+	writer.write(chunk);
+
+	auto temporary = _path + "." + to_string(getpid());
+	int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+
+	auto& bytes = writer.bytes();
+	bool written = write(fd, bytes.data(), bytes.size()) == static_cast<ssize_t>(bytes.size());
+	close(fd);
+
+	if (!written || rename(temporary.c_str(), _path.c_str()) != 0) {
+		unlink(temporary.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+const string& ScriptCache::path() const {
+	return _path;
+}
+
+string ScriptCache::defaultDirectory() {
+	if (auto directory = getenv("WATER_CACHE_DIR")) {
+		return directory;
+	}
+
+	if (auto cache_home = getenv("XDG_CACHE_HOME")) {
+		return string(cache_home) + "/water";
+	}
+
+	if (auto home = getenv("HOME")) {
+		return string(home) + "/.cache/water";
+	}
+
+	return "";
+}
@@ -0,0 +1,46 @@
+#ifndef _SCRIPT_CACHE_H_
+#define _SCRIPT_CACHE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "chunk.h"
+
+// Compiled programs saved as .h2oc files, so an unchanged script can skip lexing, parsing and compiling
+// and go straight to running. A file is named for a hash of the script's source and the options it was
+// compiled with, and starts with a header that's checked against the running interpreter, since the
+// bytecode refers to opcodes and global slots by number, and every operand is checked against the chunk
+// it's in. Anything that doesn't match is a miss, and is overwritten the next time the script is compiled.
+//
+// File layout, in native byte order:
+//   header:   "H2OC", format version, opcode count, global slot count, a hash of the opcodes, the
+//             instruction layout and the builtins' global slots, source size, source hash
+//   chunk:    identifier, arity, frame size, instructions, constants, the constant naming each member
+//             access, then each function's chunk
+//   constant: a tag byte, followed by a double for numbers or a length and bytes for strings
+class ScriptCache {
+public:
+	static const uint32_t format_version = 3;
+
+	// has to be created after the builtins are set up, but before the script declares its own globals
+	ScriptCache(std::string directory, std::string_view source, const std::string& options);
+
+	// nullptr when nothing usable is cached for the source
+	std::shared_ptr<const Chunk> load() const;
+	bool store(const Chunk& chunk) const;
+	const std::string& path() const;
+
+	// $WATER_CACHE_DIR, or water under $XDG_CACHE_HOME or ~/.cache. Empty if none of them are set.
+	static std::string defaultDirectory();
+private:
+	std::string _directory;
+	std::string _path;
+	uint32_t _global_slots;
+	uint64_t _build_hash;
+	uint64_t _source_size;
+	uint64_t _source_hash;
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include "serializer.h"
+#include "shape.h"
+#include "number_format.h"
+
+using namespace std;
+
+/* ===== Serializer ===== */
+
+const size_t Serializer::searched_depth;
+
+Serializer::Serializer(string& out, Sink sink, size_t max_depth)
+	: _out(out), _sink(sink), _max_depth(max_depth) {}
+
+void Serializer::write(const Value& value) {
+	if (value.isHeapValue()) {
+		write(*value.heapValue());
+	} else {
+		value.output(_out);
+		spill();
+	}
+}
+
+void Serializer::write(const HeapValue& value) {
+	if (value.type() != ValueType::Array && value.type() != ValueType::Object) {
+		value.output(_out);
+		spill();
+		return;
+	}
+
+	open(value);
+
+	while (!_stack.empty()) {
+		auto& container = _stack.back();
+
+		if (container.index == container.size) {
+			close();
+		} else {
+			writeNext(container);
+		}
+
+		spill();
+	}
+}
+
+void Serializer::open(const HeapValue& container) {
+	bool is_array = container.type() == ValueType::Array;
+
+	if ((_max_depth != unlimited_depth && _stack.size() >= _max_depth) || isOpen(container)) {
+		_out += is_array ? "[...]" : "{...}";
+		return;
+	}
+
+	unsigned int size = is_array
+		? static_cast<const ArrayValue&>(container).length()
+		: static_cast<const ObjectValue&>(container)._shape->members().size();
+
+	if (_stack.size() >= searched_depth) {
+		_deeply_open.insert(&container);
+	}
+
+	_stack.push_back({ &container, 0, size });
+	_out += is_array ? '[' : '{';
+}
+
+// writes the element or member at the container's index, opening it if it's a container itself
+void Serializer::writeNext(_Container& container) {
+	auto index = container.index++;
+
+	if (index > 0) {
+		_out += ", ";
+	}
+
+	const Value* element;
+
+	if (container.value->type() == ValueType::Array) {
+		auto array = static_cast<const ArrayValue*>(container.value);
+
+		if (array->kind() == ArrayValue::ElementKind::Numbers) {
+			number_format::append(_out, array->_numbers[index]);
+			return;
+		}
+
+		element = &array->_elements[index];
+	} else {
+		// members are always interned strings
+		auto object = static_cast<const ObjectValue*>(container.value);
+		_out += static_cast<const StringValue*>(object->_shape->members()[index].heapValue())->valueOf();
+		_out += ": ";
+		element = &object->_slots[index];
+	}
+
+	// container is invalidated when this opens another one
+	auto type = element->type();
+	if (type == ValueType::Array || type == ValueType::Object) {
+		open(*element->heapValue());
+	} else {
+		element->output(_out);
+	}
+}
+
+void Serializer::close() {
+	auto container = _stack.back().value;
+	_out += container->type() == ValueType::Array ? ']' : '}';
+	if (_stack.size() > searched_depth) {
+		_deeply_open.erase(container);
+	}
+
+	_stack.pop_back();
+}
+
+bool Serializer::isOpen(const HeapValue& container) const {
+	auto searched = min(_stack.size(), searched_depth);
+	for (size_t i = 0; i < searched; ++i) {
+		if (_stack[i].value == &container) {
+			return true;
+		}
+	}
+
+	return _stack.size() > searched_depth && _deeply_open.count(&container);
+}
+
+void Serializer::spill() {
+	if (_sink && _out.size() >= chunk_size) {
+		_sink(_out);
+		_out.clear();
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef _SERIALIZER_H_
+#define _SERIALIZER_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "value.h"
+
+// Writes values as text the way print shows them, walking arrays and objects with a stack of its own
+// rather than recursing, so how deeply they nest is limited by memory instead of the C++ stack. An array
+// or object that contains itself is written as [...] or {...} where it repeats, and so is anything
+// nested deeper than max_depth, if there is one. The text is appended to out, which is handed to the
+// sink and emptied whenever it grows past chunk_size, so dumping a big structure needn't hold all of it.
+class Serializer {
+public:
+	typedef void (*Sink)(std::string_view chunk);
+
+	static const std::size_t chunk_size = 64 * 1024;
+	static const std::size_t unlimited_depth = 0;
+
+	Serializer(std::string& out, Sink sink = nullptr, std::size_t max_depth = unlimited_depth);
+
+	void write(const Value& value);
+	void write(const HeapValue& value);
+private:
+	struct _Container {
+		const HeapValue* value;
+		unsigned int index;
+		unsigned int size;
+	};
+
+	void open(const HeapValue& container);
+	void writeNext(_Container& container);
+	void close();
+	void spill();
+
+	std::string& _out;
+	Sink _sink;
+	std::size_t _max_depth;
+
+	// containers being written are found by searching the stack, and past the first few by a set of the rest
+	static const std::size_t searched_depth = 16;
+	bool isOpen(const HeapValue& container) const;
+
+	std::vector<_Container> _stack;
+	std::unordered_set<const HeapValue*> _deeply_open;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "shape.h"
+
+using namespace std;
+
+/* ===== Shape ===== */
+
+unsigned int Shape::_shared_count = 0;
+
+Shape::Shape(bool is_dictionary)
+	: _is_dictionary(is_dictionary) {}
+
+const vector<Value>& Shape::members() const {
+	return _members;
+}
+
+unsigned int Shape::size() const {
+	return _members.size();
+}
+
+bool Shape::isDictionary() const {
+	return _is_dictionary;
+}
+
+// the shared shape for this one's members followed by member, created the first time it's needed
+const Shape* Shape::withMember(const Value& member) const {
+	auto it = _transitions.find(static_cast<const StringValue*>(member.heapValue()));
+	if (it != end(_transitions)) {
+		return it->second.get();
+	}
+
+	unique_ptr<Shape> shape { new Shape(false) };
+	shape->_members = _members;
+	shape->_slots = _slots;
+	shape->addMember(member);
+	++_shared_count;
+
+	auto result = shape.get();
+	_transitions.emplace(static_cast<const StringValue*>(member.heapValue()), move(shape));
+	return result;
+}
+
+const Shape* Shape::findWithMember(const Value& member) const {
+	auto it = _transitions.find(static_cast<const StringValue*>(member.heapValue()));
+	return it == end(_transitions) ? nullptr : it->second.get();
+}
+
+// a private copy of this shape for one object to add members to, keeping their slots
+unique_ptr<Shape> Shape::toDictionary() const {
+	unique_ptr<Shape> shape { new Shape(true) };
+	shape->_members = _members;
+	shape->_slots = _slots;
+	return shape;
+}
+
+// members are kept as values, which keeps their interned strings alive as long as the shape is
+void Shape::addMember(Value member) {
+	_slots.emplace(static_cast<const StringValue*>(member.heapValue()), _members.size());
+	_members.push_back(move(member));
+}
+
+const Shape* Shape::empty() {
+	static Shape empty_shape { false };
+	return &empty_shape;
+}
+
+unsigned int Shape::sharedCount() {
+	return _shared_count;
+}
+
+/* ===== InlineCache ===== */
+
+InlineCache::InlineCache()
+	: _size(0) {}
+
+void InlineCache::update(const Shape* shape, int slot) {
+	// dictionary shapes belong to a single object and can be freed with it, so they're never remembered
+	if (shape->isDictionary() || _size == max_entries) {
+		return;
+	}
+
+	_entries[_size++] = { shape, slot };
+}
+
+void InlineCache::clear() {
+	_size = 0;
+}
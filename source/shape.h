@@ -0,0 +1,87 @@
+#ifndef _SHAPE_H_
+#define _SHAPE_H_
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+#include "value.h"
+
+// Objects that were given the same members in the same order share a Shape, which maps each member to
+// its slot in the object. Members are interned strings, so they're looked up by pointer. Shapes form a
+// tree of transitions hanging off the empty shape and live for the whole run, so a shape pointer is a
+// stable key for inline caches. An object that outgrows max_shared_members, or is given a key worked out
+// while running that no shape has yet, switches to a dictionary shape of its own, so objects used as
+// maps don't fill up the tree; dictionary shapes change in place and are never cached.
+class Shape {
+public:
+	static const unsigned int max_shared_members = 64;
+
+	Shape(const Shape&) = delete;
+	Shape& operator=(const Shape&) = delete;
+
+	int slot(const StringValue* member) const;
+	const std::vector<Value>& members() const;
+	unsigned int size() const;
+	bool isDictionary() const;
+
+	const Shape* withMember(const Value& member) const;
+	// like withMember, but nullptr rather than a new shape when there isn't one yet
+	const Shape* findWithMember(const Value& member) const;
+	std::unique_ptr<Shape> toDictionary() const;
+	void addMember(Value member);
+
+	static const Shape* empty();
+	// how many shared shapes have been created, all of which are still alive
+	static unsigned int sharedCount();
+private:
+	Shape(bool is_dictionary);
+
+	bool _is_dictionary;
+	std::vector<Value> _members;
+	std::unordered_map<const StringValue*, unsigned int> _slots;
+	mutable std::unordered_map<const StringValue*, std::unique_ptr<Shape>> _transitions;
+
+	static unsigned int _shared_count;
+};
+
+// Remembers the slot a member was found in for the last few shapes seen at one access site. A site that
+// sees more shapes than that keeps the ones it has and looks the others up.
+class InlineCache {
+public:
+	static const unsigned int max_entries = 4;
+
+	InlineCache();
+	int lookup(const Shape* shape) const;
+	void update(const Shape* shape, int slot);
+	void clear();
+private:
+	struct _Entry {
+		const Shape* shape;
+		int slot;
+	};
+
+	_Entry _entries[max_entries];
+	unsigned int _size;
+};
+
+/* ===== Shape (inline) ===== */
+
+inline int Shape::slot(const StringValue* member) const {
+	auto it = _slots.find(member);
+	return it == _slots.end() ? -1 : static_cast<int>(it->second);
+}
+
+/* ===== InlineCache (inline) ===== */
+
+inline int InlineCache::lookup(const Shape* shape) const {
+	for (unsigned int i = 0; i < _size; ++i) {
+		if (_entries[i].shape == shape) {
+			return _entries[i].slot;
+		}
+	}
+
+	return -1;
+}
+
+#endif
@@ -0,0 +1,75 @@
+#include <fstream>
+#include <iterator>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source_buffer.h"
+
+using namespace std;
+
+/* ===== SourceBuffer ===== */
+
+SourceBuffer::SourceBuffer(string name)
+	: _name(move(name)), _mapping(nullptr), _mapping_size(0) {}
+
+SourceBuffer::~SourceBuffer() {
+	if (_mapping) {
+		munmap(_mapping, _mapping_size);
+	}
+}
+
+string_view SourceBuffer::store(string text) {
+	_stored.push_back(move(text));
+	return _stored.back();
+}
+
+unique_ptr<SourceBuffer> SourceBuffer::fromFile(const string& filename) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return nullptr;
+	}
+
+	unique_ptr<SourceBuffer> buffer { new SourceBuffer(filename) };
+
+	struct stat info;
+	if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+		auto size = static_cast<size_t>(info.st_size);
+		auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (mapping != MAP_FAILED) {
+			madvise(mapping, size, MADV_SEQUENTIAL);
+			buffer->_mapping = mapping;
+			buffer->_mapping_size = size;
+			buffer->_text = string_view(static_cast<const char*>(mapping), size);
+			close(fd);
+			return buffer;
+		}
+	}
+
+	close(fd);
+
+	// empty files, pipes and anything else that can't be mapped are read instead
+	ifstream file { filename, ios::binary };
+	if (!file.is_open()) {
+		return nullptr;
+	}
+
+	buffer->_contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+	buffer->_text = buffer->_contents;
+	return buffer;
+}
+
+unique_ptr<SourceBuffer> SourceBuffer::fromString(string text, string name) {
+	unique_ptr<SourceBuffer> buffer { new SourceBuffer(move(name)) };
+	buffer->_contents = move(text);
+	buffer->_text = buffer->_contents;
+	return buffer;
+}
+
+unique_ptr<SourceBuffer> SourceBuffer::fromStream(istream& input, string name) {
+	string text { istreambuf_iterator<char>(input), istreambuf_iterator<char>() };
+	return fromString(move(text), move(name));
+}
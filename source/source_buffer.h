@@ -0,0 +1,49 @@
+#ifndef _SOURCE_BUFFER_H_
+#define _SOURCE_BUFFER_H_
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <deque>
+
+// The whole text of a script in one contiguous buffer. Files are mapped into memory rather than read,
+// and tokens are views into the buffer, so it has to outlive the tokens and everything parsed from
+// them, including the filename in their metadata. String literals with escapes in them don't match
+// their source text, so the lexer stores the unescaped copies here as well.
+class SourceBuffer {
+public:
+	SourceBuffer(const SourceBuffer&) = delete;
+	SourceBuffer& operator=(const SourceBuffer&) = delete;
+	~SourceBuffer();
+
+	std::string_view text() const;
+	std::string_view name() const;
+	std::string_view store(std::string text);
+
+	// returns nullptr if the file can't be opened
+	static std::unique_ptr<SourceBuffer> fromFile(const std::string& filename);
+	static std::unique_ptr<SourceBuffer> fromString(std::string text, std::string name);
+	static std::unique_ptr<SourceBuffer> fromStream(std::istream& input, std::string name);
+private:
+	SourceBuffer(std::string name);
+
+	std::string _name;
+	std::string _contents;
+	void* _mapping;
+	std::size_t _mapping_size;
+	std::string_view _text;
+	std::deque<std::string> _stored;
+};
+
+/* ===== SourceBuffer (inline) ===== */
+
+inline std::string_view SourceBuffer::text() const {
+	return _text;
+}
+
+inline std::string_view SourceBuffer::name() const {
+	return _name;
+}
+
+#endif
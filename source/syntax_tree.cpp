@@ -0,0 +1,58 @@
+#include "syntax_tree.h"
+#include "astnode.h"
+
+using namespace std;
+
+/* ===== SyntaxTree ===== */
+
+const size_t SyntaxTree::block_size;
+
+SyntaxTree::SyntaxTree()
+	: _next(nullptr), _end(nullptr), _bytes_allocated(0) {}
+
+SyntaxTree::~SyntaxTree() {
+	for (auto it = _nodes.rbegin(); it != _nodes.rend(); ++it) {
+		(*it)->~ASTNode();
+	}
+}
+
+void* SyntaxTree::allocate(size_t size, size_t alignment) {
+	auto offset = (alignment - reinterpret_cast<uintptr_t>(_next) % alignment) % alignment;
+
+	if (!_next || static_cast<size_t>(_end - _next) < offset + size) {
+		auto capacity = max(block_size, size + alignment);
+		_blocks.emplace_back(new char[capacity]);
+		_next = _blocks.back().get();
+		_end = _next + capacity;
+		offset = (alignment - reinterpret_cast<uintptr_t>(_next) % alignment) % alignment;
+	}
+
+	auto memory = _next + offset;
+	_next = memory + size;
+	_bytes_allocated += size;
+	return memory;
+}
+
+// nodes built from the same token, like a folded operator and its literal, share a location
+uint32_t SyntaxTree::locate(const TokenMetaData& meta) {
+	if (_files.empty() || _files.back() != meta.filename) {
+		_files.push_back(meta.filename);
+	}
+
+	_SourceLocation location = { static_cast<uint32_t>(_files.size() - 1), meta.line, meta.column };
+
+	if (!_locations.empty()) {
+		auto& last = _locations.back();
+		if (last.file == location.file && last.line == location.line && last.column == location.column) {
+			return _locations.size() - 1;
+		}
+	}
+
+	_locations.push_back(location);
+	return _locations.size() - 1;
+}
+
+TokenMetaData SyntaxTree::meta(const ASTNode& node) const {
+	auto& location = _locations[node.location()];
+	return { _files[location.file], location.line, location.column };
+}
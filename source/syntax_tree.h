@@ -0,0 +1,83 @@
+#ifndef _SYNTAX_TREE_H_
+#define _SYNTAX_TREE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "token.h"
+
+class ASTNode;
+
+// Owns every node parsed from a program, and the ones the optimizer replaces them with. Nodes are bump
+// allocated from large blocks and point at their children directly, since they all live exactly as long
+// as the tree, which has to outlive anything run from it. Each node keeps a 32 bit index into a side
+// table of (file, line, column) rather than its own copy of the token's metadata.
+class SyntaxTree {
+public:
+	SyntaxTree();
+	SyntaxTree(const SyntaxTree&) = delete;
+	SyntaxTree& operator=(const SyntaxTree&) = delete;
+	~SyntaxTree();
+
+	// nodes are built from a location, followed by their own constructor's arguments
+	template <typename Node, typename... Args>
+	Node* make(const TokenMetaData& meta, Args&&... args);
+	template <typename Node, typename... Args>
+	Node* make(uint32_t location, Args&&... args);
+
+	uint32_t locate(const TokenMetaData& meta);
+	TokenMetaData meta(const ASTNode& node) const;
+
+	std::size_t nodeCount() const;
+	std::size_t bytesAllocated() const;
+private:
+	static const std::size_t block_size = 64 * 1024;
+
+	struct _SourceLocation {
+		uint32_t file;
+		int line;
+		int column;
+	};
+
+	void* allocate(std::size_t size, std::size_t alignment);
+
+	std::vector<std::unique_ptr<char[]>> _blocks;
+	char* _next;
+	char* _end;
+	std::size_t _bytes_allocated;
+
+	// destroyed in reverse when the tree is
+	std::vector<ASTNode*> _nodes;
+
+	std::vector<std::string_view> _files;
+	std::vector<_SourceLocation> _locations;
+};
+
+/* ===== SyntaxTree (inline) ===== */
+
+template <typename Node, typename... Args>
+Node* SyntaxTree::make(const TokenMetaData& meta, Args&&... args) {
+	return make<Node>(locate(meta), std::forward<Args>(args)...);
+}
+
+template <typename Node, typename... Args>
+Node* SyntaxTree::make(uint32_t location, Args&&... args) {
+	auto node = new (allocate(sizeof(Node), alignof(Node))) Node(location, std::forward<Args>(args)...);
+	_nodes.push_back(node);
+	return node;
+}
+
+inline std::size_t SyntaxTree::nodeCount() const {
+	return _nodes.size();
+}
+
+inline std::size_t SyntaxTree::bytesAllocated() const {
+	return _bytes_allocated;
+}
+
+#endif
@@ -22,8 +22,11 @@ ostream& operator<<(ostream& out, const TokenMetaData& meta) {
 	return out << meta.filename << ":" << meta.line << ":" << meta.column;
 }
 
-Token::Token(TokenType type, TokenMetaData meta, string text)
-	: _meta(meta), _type(type), _text(move(text)) {}
+Token::Token()
+	: _meta({ {}, 0, 0 }), _type(TokenType::UnknownToken) {}
+
+Token::Token(TokenType type, TokenMetaData meta, string_view text)
+	: _meta(meta), _type(type), _text(text) {}
 
 TokenType Token::type() const {
 	return _type;
@@ -33,6 +36,6 @@ const TokenMetaData& Token::meta() const {
 	return _meta;
 }
 
-const string& Token::text() const {
+string_view Token::text() const {
 	return _text;
 }
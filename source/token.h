@@ -2,6 +2,7 @@
 #define _TOKEN_H_
 
 #include <string>
+#include <string_view>
 #include <iostream>
 
 enum class TokenType {
@@ -16,8 +17,9 @@ enum class TokenType {
 
 std::ostream& operator<<(std::ostream& out, TokenType type);
 
+// the filename is a view of the name of the SourceBuffer the token came from
 struct TokenMetaData {
-	std::string filename;
+	std::string_view filename;
 	int line;
 	int column;
 };
@@ -26,14 +28,15 @@ std::ostream& operator<<(std::ostream& out, const TokenMetaData& meta);
 
 class Token {
 public:
-	Token(TokenType token_type, TokenMetaData meta, std::string text);
+	Token();
+	Token(TokenType token_type, TokenMetaData meta, std::string_view text);
 	TokenType type() const;
-	const std::string& text() const;
+	std::string_view text() const;
 	const TokenMetaData& meta() const;
 private:
 	TokenMetaData _meta;
 	TokenType _type;
-	std::string _text;
+	std::string_view _text;
 };
 
 #endif
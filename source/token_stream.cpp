@@ -1,57 +1,50 @@
 #include "token_stream.h"
-#include <algorithm>
 
 using namespace std;
 
-TokenStream::TokenStream(TokenIter begin, TokenIter end, bool ignore_comments)
-	: _current(begin), _end(end), _ignore_comments(ignore_comments) {
-		if (ignore_comments && _current->type() == TokenType::Comment) {
-			eat();
+static_assert((TokenStream::max_lookahead & (TokenStream::max_lookahead - 1)) == 0, "the lookahead wraps with a mask");
+
+TokenStream::TokenStream(Lexer& lexer, bool ignore_comments)
+	: _lexer(lexer), _first(0), _count(0), _exhausted(false), _meta({ {}, 0, 0 }), _ignore_comments(ignore_comments) {
+		if (fill(1)) {
+			_meta = _buffer[_first].meta();
 		}
+	}
 
-		if (_current != _end) {
-			_meta = _current->meta();
+// lexes until count tokens are buffered, or the source runs out
+bool TokenStream::fill(size_t count) {
+	while (_count < count && !_exhausted) {
+		auto& token = _buffer[(_first + _count) & (max_lookahead - 1)];
+
+		if (!_lexer.next(token)) {
+			_exhausted = true;
+		} else if (!_ignore_comments || token.type() != TokenType::Comment) {
+			++_count;
 		}
 	}
 
+	return _count >= count;
+}
+
 bool TokenStream::hasNext() const {
 	return !empty();
 }
 
+// the next token is always buffered if there is one, so this never has to lex
 bool TokenStream::empty() const {
-	if (_current == _end) {
-		return true;
-	}
-
-	if (!_ignore_comments) {
-		return false;
-	}
-
-	return all_of(_current, _end, [](const Token& token) {
-		return token.type() == TokenType::Comment;
-	});
-
-	return true;
+	return _count == 0;
 }
 
-Token TokenStream::get() const {
-	return *_current;
+const Token& TokenStream::get(size_t ahead) {
+	fill(ahead + 1);
+	return _buffer[(_first + ahead) & (max_lookahead - 1)];
 }
 
 void TokenStream::eat() {
-	++_current;
-
-	while (_ignore_comments && _current != _end) {
-		if (_current->type() == TokenType::Comment) {
-			++_current;
-		} else {
-			break;
-		}
-	}
+	_first = (_first + 1) & (max_lookahead - 1);
+	--_count;
 
-	// if (hasNext()) {
-	// 	_meta = _current->meta();
-	// }
+	fill(1);
 }
 
 TokenMetaData TokenStream::meta() const {
@@ -1,23 +1,33 @@
 #ifndef _TOKEN_STREAM_H_
 #define _TOKEN_STREAM_H_
 
-#include <vector>
+#include <array>
+#include <cstddef>
 #include "token.h"
+#include "lexer.h"
 
-typedef std::vector<Token>::const_iterator TokenIter;
-
+// Pulls tokens from the lexer as the parser asks for them, holding only the few it's looked ahead at
+// in a ring buffer, so the whole source is never lexed up front. Tokens returned by get are only
+// valid until the next eat.
 class TokenStream {
 public:
-	TokenStream(TokenIter begin, TokenIter end, bool ignore_comments = true);
+	static constexpr std::size_t max_lookahead = 4;
+
+	TokenStream(Lexer& lexer, bool ignore_comments = true);
 	bool hasNext() const;
 	bool empty() const;
-	Token get() const;
+	const Token& get(std::size_t ahead = 0);
 	void eat();
 	TokenMetaData meta() const;
 private:
+	bool fill(std::size_t count);
+
+	Lexer& _lexer;
+	std::array<Token, max_lookahead> _buffer;
+	std::size_t _first;
+	std::size_t _count;
+	bool _exhausted;
 	TokenMetaData _meta;
-	TokenIter _current;
-	const TokenIter _end;
 	bool _ignore_comments;
 };
 
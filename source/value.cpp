@@ -1,235 +1,449 @@
 #include <sstream>
 #include <cmath>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "value.h"
-#include "scope.h"
+#include "shape.h"
+#include "frame.h"
 #include "astnode.h"
+#include "chunk.h"
+#include "virtual_machine.h"
+#include "number_format.h"
+#include "serializer.h"
+#include "scanner.h"
 
 using namespace std;
 
-/* ===== Conversions ===== */
+/* ===== Value ===== */
 
-double toNumber(const shared_ptr<Value>& var) {
-	return var->valueAs<NumberValue>();
+void Value::output(string& out) const {
+	if (isNumber()) {
+		number_format::append(out, asNumber());
+	} else if (isHeapValue()) {
+		heapValue()->output(out);
+	} else if (isNull()) {
+		out += "(null)";
+	} else if (isBoolean()) {
+		out += asBoolean() ? "true" : "false";
+	} else {
+		out += "(empty)";
+	}
 }
 
-string toString(const shared_ptr<Value>& var) {
-	return var->valueAs<StringValue>();
+void Value::output(ostream& out) const {
+	string text;
+	output(text);
+	out << text;
 }
 
-bool toBoolean(const shared_ptr<Value>& var) {
-	return var->valueAs<BooleanValue>();
-}
+Value Value::get(const Value& index) const {
+	if (!isHeapValue()) {
+		throw InterpretorError("(get not implemented)");
+	}
 
-/* ===== Value ===== */
+	return heapValue()->get(index);
+}
 
-Value::Value(ValueType type)
-	: _type(type) {}
+void Value::set(const Value& index, Value new_value) const {
+	if (!isHeapValue()) {
+		throw InterpretorError("(set not implemented)");
+	}
 
-ValueType Value::type() const {
-	return _type;
+	heapValue()->set(index, move(new_value));
 }
 
-shared_ptr<Value> Value::get(const shared_ptr<Value>& index) const {
-	throw InterpretorError("(get not implemented)");
-}
+bool Value::referenceEquals(const Value& other) const {
+	// numbers and booleans are copied on assignment, so they never share an identity
+	if (isHeapValue() || isNull()) {
+		return _bits == other._bits;
+	}
 
-void Value::set(const shared_ptr<Value>& index, shared_ptr<Value> new_value) {
-	throw InterpretorError("(set not implemented)");
+	return false;
 }
 
-shared_ptr<Value> Value::copy() const {
-	throw InterpretorError("(copy not implemented)");
+namespace {
+	// cells freed while another one is being deleted wait here, so freeing a deeply nested structure
+	// deletes one level at a time instead of recursing through every level of it. It's never destroyed,
+	// since values held by statics, like the global frame, can be freed after it would have been
+	struct PendingCells {
+		bool deleting = false;
+		vector<HeapValue*> cells;
+	};
+
+	PendingCells& pending_cells() {
+		thread_local auto pending = new PendingCells();
+		return *pending;
+	}
 }
 
-/* ===== SentinelValue ===== */
+void Value::releaseHeapValue(HeapValue* cell) {
+	if (!cell->release()) {
+		return;
+	}
 
-const shared_ptr<SentinelValue> SentinelValue::Return { new SentinelValue(_SentinelType::Return) };
-const shared_ptr<SentinelValue> SentinelValue::Break { new SentinelValue(_SentinelType::Break) };
-const shared_ptr<SentinelValue> SentinelValue::Continue { new SentinelValue(_SentinelType::Continue) };
+	auto& pending = pending_cells();
+	if (pending.deleting) {
+		pending.cells.push_back(cell);
+		return;
+	}
 
-SentinelValue::SentinelValue(_SentinelType type)
-	: Value(value_type), _type(type) {}
+	pending.deleting = true;
+	delete cell;
 
-void SentinelValue::output(ostream& out) const {
-	out << "(sentinel)";
-}
+	while (!pending.cells.empty()) {
+		auto next = pending.cells.back();
+		pending.cells.pop_back();
+		delete next;
+	}
 
-bool SentinelValue::isReturn() const {
-	return _type == _SentinelType::Return;
+	pending.deleting = false;
 }
 
-bool SentinelValue::isBreak() const {
-	return _type == _SentinelType::Break;
+/* ===== Conversions ===== */
+
+void throwTypeError() {
+	throw TypeError();
 }
 
-bool SentinelValue::isContinue() const {
-	return _type == _SentinelType::Continue;
+string toDisplayString(const Value& var) {
+	if (var.type() == ValueType::String) {
+		return static_cast<const StringValue*>(var.heapValue())->valueOf();
+	}
+
+	string text;
+	var.output(text);
+	return text;
 }
 
-bool SentinelValue::isReferenceType() const {
-	return false;
+/* ===== HeapValue ===== */
+
+HeapValue::HeapValue(ValueType type)
+	: _type(type), _ref_count(0) {}
+
+unsigned int HeapValue::referenceCount() const {
+	return _ref_count;
 }
 
-/* ===== NullValue ===== */
+void HeapValue::traverse(const Visitor& visit) const {}
 
-const shared_ptr<NullValue> NullValue::_null_value {new NullValue()};
+void HeapValue::clear() {}
 
-NullValue::NullValue()
-	: Value(value_type) {}
+void HeapValue::pin() {
+	retain();
+}
 
-const shared_ptr<NullValue>& NullValue::get() {
-	return _null_value;
+void HeapValue::unpin() {
+	if (release()) {
+		delete this;
+	}
 }
 
-void NullValue::output(ostream& out) const {
-	out << "(null)";
+Value HeapValue::get(const Value& index) const {
+	throw InterpretorError("(get not implemented)");
 }
 
-nullptr_t NullValue::valueOf() const {
-	return nullptr;
+void HeapValue::set(const Value& index, Value new_value) {
+	throw InterpretorError("(set not implemented)");
 }
 
-bool NullValue::isReferenceType() const {
-	return true;
+/* ===== StringValue ===== */
+
+namespace {
+	// interned strings by hash. The table doesn't keep them alive, they take themselves out when freed.
+	// It's never destroyed, since strings can outlive any static
+	unordered_multimap<size_t, StringValue*>& interned_strings() {
+		static auto table = new unordered_multimap<size_t, StringValue*>();
+		return *table;
+	}
 }
 
-/* ===== NumberValue ===== */
+StringValue::StringValue(string str)
+	: StringValue(str, std::hash<string>()(str)) {}
 
-NumberValue::NumberValue(double number)
-	: Value(value_type), _number(number) {}
+StringValue::StringValue(string str, size_t hash)
+	: HeapValue(value_type), _str(move(str)), _hash(hash), _view(nullptr), _length(_str.size()), _is_interned(false) {}
 
-void NumberValue::output(ostream& out) const {
-	out << valueOf();
+StringValue::StringValue(Value left, Value right)
+	: HeapValue(value_type), _hash(0), _left(move(left)), _right(move(right)), _view(nullptr), _is_interned(false) {
+	_length = static_cast<const StringValue*>(_left.heapValue())->_length + static_cast<const StringValue*>(_right.heapValue())->_length;
 }
 
-bool NumberValue::isReferenceType() const {
-	return false;
-}
+StringValue::StringValue(Value owner, string_view text)
+	: HeapValue(value_type), _hash(0), _left(move(owner)), _view(text.data()), _length(text.size()), _is_interned(false) {}
+
+StringValue::~StringValue() {
+	if (isRope()) {
+		releaseRope(move(_left), move(_right));
+	}
 
-shared_ptr<Value> NumberValue::copy() const {
-	return NumberValue::create(valueOf());
+	if (!_is_interned) {
+		return;
+	}
+
+	auto& table = interned_strings();
+	auto range = table.equal_range(_hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second == this) {
+			table.erase(it);
+			break;
+		}
+	}
 }
 
-double NumberValue::valueOf() const {
-	return _number;
+void StringValue::output(string& out) const {
+	out += view();
 }
 
-void NumberValue::update(double new_value) {
-	_number = new_value;
+Value StringValue::get(const Value& index) const {
+	switch (index.type()) {
+		case ValueType::Number: {
+			// checked before converting, since NaN and numbers out of range don't convert to size_t
+			auto number = floor(index.asNumber());
+			if (!(number >= 0 && number < _length)) {
+				string displayed;
+				number_format::append(displayed, index.asNumber());
+				throw OutOfBoundsError(displayed, _length, "string");
+			}
+
+			return create(string(1, view()[static_cast<size_t>(number)]));
+		}
+		case ValueType::String:
+			if (static_cast<const StringValue*>(index.heapValue())->valueOf() == "length") {
+				return Value::number(_length);
+			}
+
+			return Value::null();
+		default:
+			throw InvalidPropertyType();
+	}
 }
 
-shared_ptr<NumberValue> NumberValue::create(double number) {
-	return make_shared<NumberValue>(number);
+const string& StringValue::valueOf() const {
+	flatten();
+	return _str;
 }
 
-/* ===== StringValue ===== */
+string_view StringValue::view() const {
+	if (_view) {
+		return { _view, _length };
+	}
 
-StringValue::StringValue(string str)
-	: Value(value_type), _str(move(str)) {}
+	return valueOf();
+}
 
-void StringValue::output(ostream& out) const {
-	out << valueOf();
+size_t StringValue::length() const {
+	return _length;
 }
 
-bool StringValue::isReferenceType() const {
-	return true;
+size_t StringValue::hash() const {
+	flatten();
+	return _hash;
 }
 
-string StringValue::valueOf() const {
-	return _str;
+bool StringValue::isInterned() const {
+	return _is_interned;
 }
 
-void StringValue::update(string new_value) {
-	_str = move(new_value);
+Value StringValue::create(string str) {
+	return Value(new StringValue(move(str)));
 }
 
-shared_ptr<StringValue> StringValue::create(string str) {
-	return make_shared<StringValue>(move(str));
+Value StringValue::createView(Value owner, string_view text) {
+	return Value(new StringValue(move(owner), text));
 }
 
-/* ===== BooleanValue ===== */
+// either side can be any value, which is joined on as it would be printed
+Value StringValue::concatenate(const Value& lhs, const Value& rhs) {
+	if (lhs.type() != ValueType::String && rhs.type() != ValueType::String) {
+		throwTypeError();
+	}
+
+	auto left = lhs.type() == ValueType::String ? lhs : create(toDisplayString(lhs));
+	auto right = rhs.type() == ValueType::String ? rhs : create(toDisplayString(rhs));
+	auto left_string = static_cast<const StringValue*>(left.heapValue());
+	auto right_string = static_cast<const StringValue*>(right.heapValue());
 
-BooleanValue::BooleanValue(bool boolean)
-	: Value(value_type), _value(boolean) {}
+	if (right_string->_length == 0) {
+		return left;
+	} else if (left_string->_length == 0) {
+		return right;
+	}
 
-void BooleanValue::output(ostream& out) const {
-	out << (valueOf() ? "true" : "false");
+	if (left_string->_length + right_string->_length < min_rope_length) {
+		return create(left_string->valueOf() + right_string->valueOf());
+	}
+
+	return Value(new StringValue(move(left), move(right)));
 }
 
-bool BooleanValue::isReferenceType() const {
-	return false;
+bool StringValue::isRope() const {
+	return !_right.empty();
+}
+
+// copies the leaves into one buffer, walking the rope with a stack of its own, since a rope built by
+// appending in a loop is as deep as the number of appends
+void StringValue::flatten() const {
+	if (_view) {
+		_str.assign(_view, _length);
+		_hash = std::hash<string>()(_str);
+		_view = nullptr;
+		_left = Value();
+		return;
+	}
+
+	if (!isRope()) {
+		return;
+	}
+
+	string str;
+	str.reserve(_length);
+
+	vector<const StringValue*> pending { this };
+	while (!pending.empty()) {
+		auto node = pending.back();
+		pending.pop_back();
+
+		if (node->isRope()) {
+			pending.push_back(static_cast<const StringValue*>(node->_right.heapValue()));
+			pending.push_back(static_cast<const StringValue*>(node->_left.heapValue()));
+		} else {
+			str += node->view();
+		}
+	}
+
+	_str = move(str);
+	_hash = std::hash<string>()(_str);
+	releaseRope(move(_left), move(_right));
 }
 
-shared_ptr<Value> BooleanValue::copy() const {
-	return BooleanValue::create(valueOf());
+// freeing a deep rope one destructor inside another would overflow the stack, so ropes nothing else
+// refers to are taken apart here, and each is freed with no halves left to release
+void StringValue::releaseRope(Value left, Value right) {
+	vector<Value> pending;
+	pending.push_back(move(left));
+	pending.push_back(move(right));
+
+	while (!pending.empty()) {
+		auto value = move(pending.back());
+		pending.pop_back();
+
+		auto str = static_cast<const StringValue*>(value.heapValue());
+		if (str->isRope() && str->referenceCount() == 1) {
+			pending.push_back(move(str->_left));
+			pending.push_back(move(str->_right));
+		}
+	}
 }
 
-bool BooleanValue::valueOf() const {
-	return _value;
+Value StringValue::intern(string str) {
+	auto hash = std::hash<string>()(str);
+	if (auto interned = findInterned(str, hash)) {
+		return Value(const_cast<StringValue*>(interned));
+	}
+
+	auto interned = new StringValue(move(str), hash);
+	interned->_is_interned = true;
+	interned_strings().emplace(hash, interned);
+	return Value(interned);
 }
 
-void BooleanValue::update(bool new_value) {
-	_value = new_value;
+// a string that isn't interned yet becomes the interned one, rather than being copied
+Value StringValue::intern(const Value& str) {
+	auto string_value = str.as<StringValue>();
+	if (string_value->_is_interned) {
+		return str;
+	}
+
+	if (auto interned = findInterned(string_value->valueOf(), string_value->hash())) {
+		return Value(const_cast<StringValue*>(interned));
+	}
+
+	string_value->_is_interned = true;
+	interned_strings().emplace(string_value->hash(), string_value);
+	return str;
 }
 
-shared_ptr<BooleanValue> BooleanValue::create(bool boolean) {
-	return make_shared<BooleanValue>(boolean);
+// the interned string with these contents, or nullptr if there isn't one, without interning it
+const StringValue* StringValue::findInterned(const string& str) {
+	return findInterned(str, std::hash<string>()(str));
 }
 
-/* ===== ArrayValue ===== */
+const StringValue* StringValue::findInterned(const string& str, size_t hash) {
+	auto range = interned_strings().equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second->_str == str) {
+			return it->second;
+		}
+	}
 
-ArrayValue::ArrayValue(std::vector<std::shared_ptr<Value>> elements)
-	: Value(value_type), _elements(move(elements)) {}
+	return nullptr;
+}
 
-void ArrayValue::output(std::ostream& out) const {
-	out << "[";
+/* ===== ArrayValue ===== */
 
-	for (int i = 0; i < _elements.size(); ++i) {
-		_elements[i]->output(out);
+ArrayValue::ArrayValue(vector<Value> elements)
+	: HeapValue(value_type), _kind(ElementKind::Numbers) {
+	track();
 
-		if (i + 1 < _elements.size()) {
-			out << ", ";
+	for (auto&& element : elements) {
+		if (!element.isNumber()) {
+			_kind = ElementKind::Generic;
+			_elements = move(elements);
+			return;
 		}
 	}
 
-	out << "]";
+	_numbers.reserve(elements.size());
+	for (auto&& element : elements) {
+		_numbers.push_back(element.asNumber());
+	}
+}
+
+ArrayValue::ArrayValue(vector<double> numbers)
+	: HeapValue(value_type), _kind(ElementKind::Numbers), _numbers(move(numbers)) {
+	track();
 }
 
-shared_ptr<Value> ArrayValue::get(const shared_ptr<Value>& index) const {
-	switch (index->type()) {
+void ArrayValue::output(string& out) const {
+	Serializer(out).write(*this);
+}
+
+Value ArrayValue::get(const Value& index) const {
+	switch (index.type()) {
 		case ValueType::Number:
-			return getIndex(toNumber(index));
+			return getIndex(index.asNumber());
 		case ValueType::String:
-			return getMember(toString(index));
+			return getMember(static_cast<const StringValue*>(index.heapValue())->valueOf());
 		default:
 			throw InvalidPropertyType();
 	}
 }
 
-shared_ptr<Value> ArrayValue::get(unsigned int index) const {
-	return _elements[index];
-}
-
-void ArrayValue::set(const shared_ptr<Value>& index, shared_ptr<Value> new_value) {
-	if (index->type() != ValueType::Number) {
+void ArrayValue::set(const Value& index, Value new_value) {
+	if (!index.isNumber()) {
 		throw TypeError("Expression is not of type Number");
 	}
 
-	int i = toNumber(index);
-	if (i >= _elements.size()) {
-		throw OutOfBoundsError(i, _elements.size());
+	int i = index.asNumber();
+	if (i >= length()) {
+		throw OutOfBoundsError(i, length());
 	}
 
-	_elements[i] = move(new_value);
+	setIndex(i, move(new_value));
 }
 
-bool ArrayValue::isReferenceType() const {
-	return true;
+Value ArrayValue::create(vector<Value> elements) {
+	Collector::allocated();
+	return Value(new ArrayValue(move(elements)));
 }
 
-unsigned int ArrayValue::length() const {
-	return _elements.size();
+Value ArrayValue::create(vector<double> numbers) {
+	Collector::allocated();
+	return Value(new ArrayValue(move(numbers)));
 }
 
 unsigned int ArrayValue::convertIndex(double index) const {
@@ -237,93 +451,143 @@ unsigned int ArrayValue::convertIndex(double index) const {
 	return static_cast<unsigned int>(floor(index));
 }
 
-shared_ptr<Value> ArrayValue::getIndex(double index) const {
+Value ArrayValue::getIndex(double index) const {
 	auto i = convertIndex(index);
-	if (i >= _elements.size()) {
-		throw OutOfBoundsError(i, _elements.size());
+	if (i >= length()) {
+		throw OutOfBoundsError(i, length());
 	}
 
-	return _elements[i];
+	return get(i);
 }
 
-shared_ptr<Value> ArrayValue::getMember(const string& member) const {
+Value ArrayValue::getMember(const string& member) const {
 	if (member == "length") {
-		return NumberValue::create(length());
+		return Value::number(length());
 	} else if (member == "push") {
-		return BuiltinFunctionValue::create("push", [this](const vector<shared_ptr<Value>>& arguments) mutable -> shared_ptr<Value> {
-			for (auto argument : arguments) {
-				// TODO: this is an awful hack that should be removed when values have actual prototypes
-				const_cast<ArrayValue*>(this)->_elements.push_back(argument);
+		// TODO: this is an awful hack that should be removed when values have actual prototypes
+		Value self { const_cast<ArrayValue*>(this) };
+
+		return BuiltinFunctionValue::create("push", { self }, [](const vector<Value>& captured, const vector<Value>& arguments) -> Value {
+			auto array = captured[0].as<ArrayValue>();
+
+			for (auto&& argument : arguments) {
+				array->push(argument);
 			}
 
-			return NullValue::get();
+			return Value::null();
 		});
 	}
 
-	return NullValue::get();
+	return Value::null();
 }
 
-void ArrayValue::setIndex(double index, shared_ptr<Value> new_value) {
+void ArrayValue::setIndex(double index, Value new_value) {
 	auto i = convertIndex(index);
-	if (i >= _elements.size()) {
-		throw OutOfBoundsError(i, _elements.size());
+	if (i >= length()) {
+		throw OutOfBoundsError(i, length());
+	}
+
+	if (_kind == ElementKind::Numbers) {
+		if (new_value.isNumber()) {
+			_numbers[i] = new_value.asNumber();
+			return;
+		}
+
+		toGeneric();
 	}
 
 	_elements[i] = move(new_value);
 }
 
-void ArrayValue::setMember(const string& member, shared_ptr<Value> new_value) {
+void ArrayValue::setMember(const string& member, Value new_value) {
 	throw ImmutableError(member);
 }
 
-/* ===== ObjectValue ===== */
+void ArrayValue::push(Value element) {
+	if (_kind == ElementKind::Numbers) {
+		if (element.isNumber()) {
+			_numbers.push_back(element.asNumber());
+			return;
+		}
 
-ObjectValue::ObjectValue(unordered_map<string, shared_ptr<Value>> members)
-	: Value(value_type), _members(move(members)) {}
+		toGeneric();
+	}
 
-void ObjectValue::output(ostream& out) const {
-	out << "{";
+	_elements.push_back(move(element));
+}
 
-	// TODO: this isn't really deterministic
-	auto end_it = end(_members);
-	for (auto it = begin(_members); it != end_it; ++it) {
-		out << it->first << ": ";
-		it->second->output(out);
+// packed arrays hold no references, but an array stays tracked in case it becomes generic
+void ArrayValue::traverse(const Visitor& visit) const {
+	for (auto&& element : _elements) {
+		element.traverse(visit);
+	}
+}
 
-		if (next(it) != end_it) {
-			out << ", ";
-		}
+void ArrayValue::clear() {
+	for (auto&& element : _elements) {
+		element = Value::null();
+	}
+}
+
+void ArrayValue::toGeneric() {
+	_elements.reserve(_numbers.size());
+	for (auto number : _numbers) {
+		_elements.push_back(Value::number(number));
 	}
 
-	out << "}";
+	_numbers = vector<double>();
+	_kind = ElementKind::Generic;
 }
 
-shared_ptr<Value> ObjectValue::get(const shared_ptr<Value>& index) const {
-	switch (index->type()) {
+/* ===== ObjectValue ===== */
+
+ObjectValue::ObjectValue()
+	: HeapValue(value_type), _shape(Shape::empty()) {
+	track();
+}
+
+// the shape has to be a shared one, with a slot for each value
+ObjectValue::ObjectValue(const Shape* shape, vector<Value> slots)
+	: HeapValue(value_type), _shape(shape), _slots(move(slots)) {
+	track();
+}
+
+void ObjectValue::output(string& out) const {
+	Serializer(out).write(*this);
+}
+
+Value ObjectValue::get(const Value& index) const {
+	switch (index.type()) {
 		case ValueType::Number:
-			return getIndex(toNumber(index));
+			return getIndex(index.asNumber());
 		case ValueType::String:
-			return getMember(toString(index));
+			return getMember(index);
 		default:
 			throw InvalidPropertyType();
 	}
 }
 
-void ObjectValue::set(const shared_ptr<Value>& index, shared_ptr<Value> new_value) {
-	switch (index->type()) {
+void ObjectValue::set(const Value& index, Value new_value) {
+	switch (index.type()) {
 		case ValueType::Number:
-			setIndex(toNumber(index), move(new_value));
+			setIndex(index.asNumber(), move(new_value));
 			break;
 		case ValueType::String:
-			setMember(toString(index), move(new_value));
+			setComputedMember(StringValue::intern(index), move(new_value));
 			break;
 		default:
 			throw InvalidPropertyType();
 	}
 }
 
-bool ObjectValue::isReferenceType() const {
-	return true;
+Value ObjectValue::create() {
+	Collector::allocated();
+	return Value(new ObjectValue());
+}
+
+Value ObjectValue::create(const Shape* shape, vector<Value> slots) {
+	Collector::allocated();
+	return Value(new ObjectValue(shape, move(slots)));
 }
 
 string ObjectValue::convertIndex(double index) const {
@@ -331,51 +595,146 @@ string ObjectValue::convertIndex(double index) const {
 	return to_string(index);
 }
 
-shared_ptr<Value> ObjectValue::getIndex(double index) const {
+Value ObjectValue::getIndex(double index) const {
 	return getMember(convertIndex(index));
 }
 
-shared_ptr<Value> ObjectValue::getMember(const string& member) const {
-	auto it = _members.find(member);
-	if (it == end(_members)) {
-		return NullValue::get();
+// every member is an interned string, so a string that was never interned can't be one
+Value ObjectValue::getMember(const string& member) const {
+	auto key = StringValue::findInterned(member);
+	int slot = key ? _shape->slot(key) : -1;
+	if (slot < 0) {
+		return Value::null();
 	}
 
-	return it->second;
+	return _slots[slot];
 }
 
-void ObjectValue::setIndex(double index, shared_ptr<Value> new_value) {
-	setMember(convertIndex(index), move(new_value));
+Value ObjectValue::getMember(const Value& member) const {
+	auto key = static_cast<const StringValue*>(member.heapValue());
+	if (!key->isInterned()) {
+		return getMember(key->valueOf());
+	}
+
+	int slot = _shape->slot(key);
+	if (slot < 0) {
+		return Value::null();
+	}
+
+	return _slots[slot];
+}
+
+// the member has to be interned. The cache belongs to the access site, and skips the shape's lookup for
+// the shapes it has seen there
+Value ObjectValue::getMember(const Value& member, InlineCache& cache) const {
+	int slot = cache.lookup(_shape);
+	if (slot < 0) {
+		slot = _shape->slot(static_cast<const StringValue*>(member.heapValue()));
+		if (slot < 0) {
+			return Value::null();
+		}
+
+		cache.update(_shape, slot);
+	}
+
+	return _slots[slot];
+}
+
+void ObjectValue::setIndex(double index, Value new_value) {
+	setComputedMember(StringValue::intern(convertIndex(index)), move(new_value));
 }
 
-void ObjectValue::setMember(const string& member, shared_ptr<Value> new_value) {
-	_members[member] = move(new_value);
+void ObjectValue::setMember(const string& member, Value new_value) {
+	setMember(StringValue::intern(member), move(new_value));
 }
 
-vector<string> ObjectValue::keys() const {
-	vector<string> keys;
-	for (auto&& member : _members) {
-		keys.push_back(member.first);
+void ObjectValue::setMember(const Value& member, Value new_value) {
+	auto key = StringValue::intern(member);
+	int slot = _shape->slot(static_cast<const StringValue*>(key.heapValue()));
+	if (slot < 0) {
+		addMember(key, move(new_value), true);
+		return;
 	}
-	return keys;
+
+	_slots[slot] = move(new_value);
 }
 
-/* ===== FunctionValue ===== */
+// the member has to be interned
+void ObjectValue::setMember(const Value& member, Value new_value, InlineCache& cache) {
+	int slot = cache.lookup(_shape);
+	if (slot < 0) {
+		slot = _shape->slot(static_cast<const StringValue*>(member.heapValue()));
+		if (slot < 0) {
+			addMember(member, move(new_value), true);
+			return;
+		}
 
-FunctionValue::FunctionValue(string identifier)
-	: Value(value_type), _identifier(move(identifier)) {}
+		cache.update(_shape, slot);
+	}
 
-void FunctionValue::output(ostream& out) const {
-	out << _identifier;
+	_slots[slot] = move(new_value);
 }
 
-bool FunctionValue::isReferenceType() const {
-	return false;
+// keys worked out while running, like o["k" + i], only follow shapes the program's member names have
+// already made, since shared shapes are never freed. A key that's kept as a member is interned, but
+// only for as long as something holds it
+void ObjectValue::setComputedMember(const Value& member, Value new_value) {
+	int slot = _shape->slot(static_cast<const StringValue*>(member.heapValue()));
+	if (slot < 0) {
+		addMember(member, move(new_value), false);
+		return;
+	}
+
+	_slots[slot] = move(new_value);
+}
+
+void ObjectValue::addMember(const Value& member, Value new_value, bool may_add_shape) {
+	const Shape* shared = nullptr;
+	if (!_dictionary && _shape->size() < Shape::max_shared_members) {
+		shared = may_add_shape ? _shape->withMember(member) : _shape->findWithMember(member);
+	}
+
+	if (shared) {
+		_shape = shared;
+	} else {
+		if (!_dictionary) {
+			_dictionary = _shape->toDictionary();
+			_shape = _dictionary.get();
+		}
+
+		_dictionary->addMember(member);
+	}
+
+	_slots.push_back(move(new_value));
+}
+
+vector<Value> ObjectValue::keys() const {
+	return _shape->members();
+}
+
+void ObjectValue::traverse(const Visitor& visit) const {
+	for (auto&& slot : _slots) {
+		slot.traverse(visit);
+	}
+}
+
+void ObjectValue::clear() {
+	for (auto&& slot : _slots) {
+		slot = Value::null();
+	}
+}
+
+/* ===== FunctionValue ===== */
+
+FunctionValue::FunctionValue(string identifier)
+	: HeapValue(value_type), _identifier(move(identifier)) {}
+
+void FunctionValue::output(string& out) const {
+	out += _identifier;
 }
 
-shared_ptr<Value> FunctionValue::copy() const {
-	// TODO: this is hacky, not sure how to void a const_cast in this case though
-	return const_cast<FunctionValue*>(this)->shared_from_this();
+const CompiledFunctionValue* FunctionValue::compiled() const {
+	return nullptr;
 }
 
 const string& FunctionValue::id() const {
@@ -384,14 +743,16 @@ const string& FunctionValue::id() const {
 
 /* ===== UserDefinedFunctionValue ===== */
 
-UserDefinedFunctionValue::UserDefinedFunctionValue(string identifier, vector<string> argument_names, shared_ptr<ASTNode> body)
-	: FunctionValue(move(identifier)), _argument_names(move(argument_names)), _body(move(body)) {
+UserDefinedFunctionValue::UserDefinedFunctionValue(string identifier, vector<string> argument_names, ASTNode* body, unsigned int frame_size, FramePtr environment)
+	: FunctionValue(move(identifier)), _argument_names(move(argument_names)), _body(move(body)), _frame_size(frame_size), _environment(move(environment)) {
+	track();
+
 	if (_identifier.empty()) {
-		_identifier = (ostringstream() << (void*)_body.get()).str();
+		_identifier = (ostringstream() << (void*)_body).str();
 	}
 }
 
-shared_ptr<Value> UserDefinedFunctionValue::call(const vector<shared_ptr<Value>>& arguments) const {
+Value UserDefinedFunctionValue::call(const vector<Value>& arguments) const {
 	int arguments_passed_size = arguments.size();
 	int arguments_expected_size = _argument_names.size();
 
@@ -399,20 +760,92 @@ shared_ptr<Value> UserDefinedFunctionValue::call(const vector<shared_ptr<Value>>
 		throw InvalidArgumentsCountError(id(), arguments_expected_size, arguments_passed_size);
 	}
 
-	auto scope = _body->scope();
+	// each call gets a fresh frame, so recursive and reentrant calls don't clobber each other's locals.
+	// the resolver lays out the arguments first
+	auto activation = Frame::create(_environment, _frame_size);
+	auto& frame = *activation;
 
 	for (int i = 0; i < arguments_passed_size; ++i) {
-		scope->setValue(_argument_names[i], arguments[i]);
+		frame[i] = arguments[i];
 	}
 
-	scope->setValue(return_value_alias, NullValue::get());
-	_body->evaluate();
+	// falling off the end of the body, or a bare return, gives null
+	auto completion = _body->execute(frame);
+	if (completion.type == CompletionType::Return && !completion.value.empty()) {
+		return move(completion.value);
+	}
+
+	return Value::null();
+}
+
+Value UserDefinedFunctionValue::create(string identifier, vector<string> argument_names, ASTNode* body, unsigned int frame_size, FramePtr environment) {
+	Collector::allocated();
+	return Value(new UserDefinedFunctionValue(move(identifier), move(argument_names), move(body), frame_size, move(environment)));
+}
+
+void UserDefinedFunctionValue::traverse(const Visitor& visit) const {
+	if (_environment) {
+		visit(_environment.get());
+	}
+}
 
-	return scope->getValue(return_value_alias);
+void UserDefinedFunctionValue::clear() {
+	_environment = nullptr;
 }
 
-shared_ptr<UserDefinedFunctionValue> UserDefinedFunctionValue::create(string identifier, vector<string> argument_names, shared_ptr<ASTNode> body) {
-	return make_shared<UserDefinedFunctionValue>(move(identifier), move(argument_names), move(body));
+/* ===== CompiledFunctionValue ===== */
+
+CompiledFunctionValue::CompiledFunctionValue(shared_ptr<const Chunk> chunk, FramePtr environment)
+	: FunctionValue(chunk->identifier), _chunk(move(chunk)), _environment(move(environment)) {
+	track();
+
+	if (_identifier.empty()) {
+		_identifier = (ostringstream() << (void*)_chunk.get()).str();
+	}
+}
+
+Value CompiledFunctionValue::call(const vector<Value>& arguments) const {
+	int arguments_passed_size = arguments.size();
+	int arguments_expected_size = _chunk->arity;
+
+	if (arguments_passed_size != arguments_expected_size) {
+		throw InvalidArgumentsCountError(id(), arguments_expected_size, arguments_passed_size);
+	}
+
+	auto frame = Frame::create(_environment, _chunk->frame_size);
+
+	for (int i = 0; i < arguments_passed_size; ++i) {
+		(*frame)[i] = arguments[i];
+	}
+
+	return VirtualMachine::execute(*_chunk, move(frame));
+}
+
+const CompiledFunctionValue* CompiledFunctionValue::compiled() const {
+	return this;
+}
+
+const Chunk& CompiledFunctionValue::chunk() const {
+	return *_chunk;
+}
+
+const FramePtr& CompiledFunctionValue::environment() const {
+	return _environment;
+}
+
+Value CompiledFunctionValue::create(shared_ptr<const Chunk> chunk, FramePtr environment) {
+	Collector::allocated();
+	return Value(new CompiledFunctionValue(move(chunk), move(environment)));
+}
+
+void CompiledFunctionValue::traverse(const Visitor& visit) const {
+	if (_environment) {
+		visit(_environment.get());
+	}
+}
+
+void CompiledFunctionValue::clear() {
+	_environment = nullptr;
 }
 
 /* ===== BuiltinFunctionValue ===== */
@@ -420,10 +853,118 @@ shared_ptr<UserDefinedFunctionValue> UserDefinedFunctionValue::create(string ide
 BuiltinFunctionValue::BuiltinFunctionValue(string identifier, const BuiltinFunctionValue::_FuncType& func)
 	: FunctionValue(move(identifier)), _func(move(func)) {}
 
-shared_ptr<Value> BuiltinFunctionValue::call(const vector<shared_ptr<Value>>& arguments) const {
+BuiltinFunctionValue::BuiltinFunctionValue(string identifier, vector<Value> captured, const BuiltinFunctionValue::_CapturingFuncType& func)
+	: FunctionValue(move(identifier)), _capturing_func(func), _captured(move(captured)) {
+	track();
+}
+
+Value BuiltinFunctionValue::call(const vector<Value>& arguments) const {
+	if (_capturing_func) {
+		return _capturing_func(_captured, arguments);
+	}
+
 	return _func(arguments);
 }
 
-shared_ptr<BuiltinFunctionValue> BuiltinFunctionValue::create(string identifier, const BuiltinFunctionValue::_FuncType& func) {
-	return make_shared<BuiltinFunctionValue>(move(identifier), func);
+Value BuiltinFunctionValue::create(string identifier, const BuiltinFunctionValue::_FuncType& func) {
+	return Value(new BuiltinFunctionValue(move(identifier), func));
+}
+
+// whatever is captured is itself counted by the collector if it's part of a cycle, so this doesn't
+// need to count towards a collection
+Value BuiltinFunctionValue::create(string identifier, vector<Value> captured, const BuiltinFunctionValue::_CapturingFuncType& func) {
+	return Value(new BuiltinFunctionValue(move(identifier), move(captured), func));
+}
+
+void BuiltinFunctionValue::traverse(const Visitor& visit) const {
+	for (auto&& value : _captured) {
+		value.traverse(visit);
+	}
+}
+
+void BuiltinFunctionValue::clear() {
+	for (auto& value : _captured) {
+		value = Value::null();
+	}
+}
+
+/* ===== BufferValue ===== */
+
+BufferValue::BufferValue(void* mapping, size_t size)
+	: HeapValue(value_type), _mapping(mapping), _size(size) {}
+
+BufferValue::~BufferValue() {
+	if (_mapping) {
+		munmap(_mapping, _size);
+	}
+}
+
+void BufferValue::output(string& out) const {
+	out += text();
+}
+
+string_view BufferValue::text() const {
+	return { static_cast<const char*>(_mapping), _size };
+}
+
+// an empty file has nothing to map, so it's left unmapped
+Value BufferValue::map(const string& path) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw FileError("open", path);
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		throw FileError("open", path);
+	}
+
+	auto size = static_cast<size_t>(info.st_size);
+	void* mapping = nullptr;
+
+	if (size > 0) {
+		mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (mapping == MAP_FAILED) {
+			close(fd);
+			throw FileError("map", path);
+		}
+
+		// lines are read front to back
+		madvise(mapping, size, MADV_SEQUENTIAL);
+	}
+
+	close(fd);
+	return Value(new BufferValue(mapping, size));
+}
+
+/* ===== LinesValue ===== */
+
+LinesValue::LinesValue(Value buffer)
+	: HeapValue(value_type), _buffer(move(buffer)) {}
+
+void LinesValue::output(string& out) const {
+	buffer().output(out);
+}
+
+const BufferValue& LinesValue::buffer() const {
+	return *_buffer.as<BufferValue>();
+}
+
+Value LinesValue::line(size_t& position) const {
+	auto contents = buffer().text();
+	auto end = scan::find(contents, position, '\n', '\n', '\n');
+	auto line = contents.substr(position, end - position);
+
+	if (!line.empty() && line.back() == '\r') {
+		line.remove_suffix(1);
+	}
+
+	position = min(end + 1, contents.size());
+	return StringValue::createView(_buffer, line);
+}
+
+Value LinesValue::create(Value buffer) {
+	return Value(new LinesValue(move(buffer)));
 }
@@ -3,186 +3,281 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <utility>
 #include <vector>
 #include <unordered_map>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
 #include "runtime_errors.h"
+#include "frame_ptr.h"
+#include "collector.h"
 
 enum class ValueType {
-	Sentinel,
+	Empty,
 	Null,
 	Number,
 	String,
 	Boolean,
 	Array,
 	Object,
-	Function
+	Function,
+	Buffer,
+	Lines
 };
 
 class ASTNode;
-class Scope;
-class Value;
-
-double toNumber(const std::shared_ptr<Value>& var);
-std::string toString(const std::shared_ptr<Value>& var);
-bool toBoolean(const std::shared_ptr<Value>& var);
+class HeapValue;
+class StringValue;
+class Shape;
+class InlineCache;
+class CompiledFunctionValue;
+struct Chunk;
 
+// A Value is a single NaN-boxed 64 bit word. Numbers are stored as plain doubles, while null
+// and booleans are quiet NaNs with a small tag in the payload. Strings, arrays, objects,
+// functions and buffers are quiet NaNs with the sign bit set, carrying a pointer to a reference
+// counted HeapValue. A default constructed Value is empty, which statements use to mean "no result".
 class Value {
 public:
+	Value();
+	Value(HeapValue* cell);
+	Value(const Value& other);
+	Value(Value&& other) noexcept;
+	~Value();
+	Value& operator=(const Value& other);
+	Value& operator=(Value&& other) noexcept;
+
+	static Value null();
+	static Value number(double number);
+	static Value boolean(bool boolean);
+
 	ValueType type() const;
-	virtual void output(std::ostream& out) const = 0;
-	virtual std::shared_ptr<Value> get(const std::shared_ptr<Value>& index) const;
-	virtual void set(const std::shared_ptr<Value>& index, std::shared_ptr<Value> new_value);
-	virtual bool isReferenceType() const = 0;
-	virtual std::shared_ptr<Value> copy() const;
+	bool empty() const;
+	bool isNull() const;
+	bool isNumber() const;
+	bool isBoolean() const;
+	bool isHeapValue() const;
+
+	// unchecked accessors, only valid after checking the matching is*() predicate
+	double asNumber() const;
+	bool asBoolean() const;
+	HeapValue* heapValue() const;
 
 	template <typename Type>
-	auto valueAs() -> decltype(std::declval<Type>().valueOf()) {
-		if (type() != Type::value_type)	{
+	Type* as() const {
+		if (type() != Type::value_type) {
 			throw TypeError();
 		}
 
-		return static_cast<Type*>(this)->valueOf();
+		return static_cast<Type*>(heapValue());
 	}
 
-protected:
-	Value(ValueType type);
+	// appended to out, which is cheaper than formatting through a stream
+	void output(std::string& out) const;
+	void output(std::ostream& out) const;
+	Value get(const Value& index) const;
+	void set(const Value& index, Value new_value) const;
+	bool referenceEquals(const Value& other) const;
+	void traverse(const Collectable::Visitor& visit) const;
 private:
-	ValueType _type;
-};
-
-class SentinelValue : public Value {
-public:
-	static const ValueType value_type = ValueType::Sentinel;
-	static const std::shared_ptr<SentinelValue> Return;
-	static const std::shared_ptr<SentinelValue> Break;
-	static const std::shared_ptr<SentinelValue> Continue;
+	static const uint64_t _quiet_nan = 0x7ffc000000000000ull;
+	static const uint64_t _canonical_nan = 0x7ff8000000000000ull;
+	static const uint64_t _heap_tag = 0x8000000000000000ull | _quiet_nan;
 
-	virtual void output(std::ostream& out) const override;
-	virtual bool isReferenceType() const override;
-	bool isReturn() const;
-	bool isBreak() const;
-	bool isContinue() const;
+	static const uint64_t _empty_bits = _quiet_nan | 1;
+	static const uint64_t _null_bits = _quiet_nan | 2;
+	static const uint64_t _false_bits = _quiet_nan | 3;
+	static const uint64_t _true_bits = _quiet_nan | 4;
 
-protected:
-	enum class _SentinelType {
-		Return,
-		Break,
-		Continue
-	} _type;
+	explicit Value(uint64_t bits);
+	void retain() const;
+	void release() const;
+	static void releaseHeapValue(HeapValue* cell);
 
-	SentinelValue(_SentinelType);
+	uint64_t _bits;
 };
 
-class NullValue : public Value {
-private:
-	static const std::shared_ptr<NullValue> _null_value;
-	NullValue();
-public:
-	static const ValueType value_type = ValueType::Null;
-	static const std::shared_ptr<NullValue>& get();
-	virtual void output(std::ostream& out) const override;
-	virtual bool isReferenceType() const override;
-	std::nullptr_t valueOf() const;
-};
+double toNumber(const Value& var);
+std::string toString(const Value& var);
+std::string toDisplayString(const Value& var);
+bool toBoolean(const Value& var);
+double numberModulus(double lhs, double rhs);
+
+// kept out of line so the conversions stay small enough to inline
+[[noreturn]] void throwTypeError();
 
-class NumberValue : public Value {
+class HeapValue : public Collectable {
 public:
-	static const ValueType value_type = ValueType::Number;
-	NumberValue(double number);
-	virtual void output(std::ostream& out) const override;
-	virtual bool isReferenceType() const override;
-	virtual std::shared_ptr<Value> copy() const override;
-	double valueOf() const;
-	void update(double new_value);
-
-	static std::shared_ptr<NumberValue> create(double number);
-
-	template <typename Op>
-	static std::shared_ptr<NumberValue> applyOperator(const std::shared_ptr<Value>& lhs, const std::shared_ptr<Value>& rhs, Op op) {
-		return std::make_shared<NumberValue>(op(toNumber(lhs), toNumber(rhs)));
-	}
+	HeapValue(const HeapValue&) = delete;
+	HeapValue& operator=(const HeapValue&) = delete;
+	virtual ~HeapValue() {}
+
+	ValueType type() const;
+	virtual void output(std::string& out) const = 0;
+	virtual Value get(const Value& index) const;
+	virtual void set(const Value& index, Value new_value);
+
+	void retain() const;
+	bool release() const;
+protected:
+	HeapValue(ValueType type);
+
+	// values that can hold other values override traverse and clear, and track themselves
+	virtual unsigned int referenceCount() const override;
+	virtual void traverse(const Visitor& visit) const override;
+	virtual void clear() override;
+	virtual void pin() override;
+	virtual void unpin() override;
 private:
-	double _number;
+	ValueType _type;
+	// the interpreter is single threaded, so counts are plain integers unless a multi-threaded host
+	// builds with WATER_ATOMIC_REFCOUNT
+#ifdef WATER_ATOMIC_REFCOUNT
+	mutable std::atomic<unsigned int> _ref_count;
+#else
+	mutable unsigned int _ref_count;
+#endif
 };
 
-class StringValue : public Value {
+// Strings never change once made, so every value referring to one shares its buffer. Literals and member
+// names are interned: there's only ever one live StringValue with their contents, so they can be
+// compared and looked up by pointer. Joining long strings makes a rope, which keeps the two halves and
+// is only flattened into one buffer when its contents are needed, so appending in a loop is linear.
+// A view is a string inside some other value's memory, like a line of a mapped file, which it keeps
+// alive instead of copying, until it's needed as a std::string.
+class StringValue : public HeapValue {
 public:
 	static const ValueType value_type = ValueType::String;
+	// joins shorter than this are copied straight into a new flat string
+	static const size_t min_rope_length = 64;
+
 	StringValue(std::string str);
-	virtual void output(std::ostream& out) const override;
-	virtual bool isReferenceType() const override;
-	std::string valueOf() const;
-	void update(std::string new_value);
+	virtual ~StringValue();
+	virtual void output(std::string& out) const override;
+	virtual Value get(const Value& index) const override;
+	const std::string& valueOf() const;
+	// the contents without copying a view, which is only valid while the string is
+	std::string_view view() const;
+	size_t length() const;
+	size_t hash() const;
+	bool isInterned() const;
 
-	static std::shared_ptr<StringValue> create(std::string str);
+	static Value create(std::string str);
+	static Value createView(Value owner, std::string_view text);
+	static Value concatenate(const Value& lhs, const Value& rhs);
+	static Value intern(std::string str);
+	static Value intern(const Value& str);
+	static const StringValue* findInterned(const std::string& str);
 private:
-	std::string _str;
-};
+	StringValue(std::string str, size_t hash);
+	StringValue(Value left, Value right);
+	StringValue(Value owner, std::string_view text);
+	static const StringValue* findInterned(const std::string& str, size_t hash);
+	static void releaseRope(Value left, Value right);
 
-class BooleanValue : public Value {
-public:
-	static const ValueType value_type = ValueType::Boolean;
-	BooleanValue(bool boolean);
-	virtual void output(std::ostream& out) const override;
-	virtual bool isReferenceType() const override;
-	virtual std::shared_ptr<Value> copy() const override;
-	bool valueOf() const;
-	void update(bool new_value);
-
-	static std::shared_ptr<BooleanValue> create(bool boolean);
-private:
-	bool _value;
+	bool isRope() const;
+	void flatten() const;
+
+	// a rope has both halves until it's flattened into _str, and a view keeps its owner in _left
+	mutable std::string _str;
+	mutable size_t _hash;
+	mutable Value _left;
+	mutable Value _right;
+	mutable const char* _view;
+	size_t _length;
+	bool _is_interned;
 };
 
-class ArrayValue : public Value {
+// Arrays that only ever held numbers keep them packed as plain doubles, which take no reference
+// counting to copy, fill or free. Storing anything else moves the array to generic storage for good.
+class ArrayValue : public HeapValue {
 public:
 	static const ValueType value_type = ValueType::Array;
-	ArrayValue(std::vector<std::shared_ptr<Value>> elements);
-	virtual void output(std::ostream& out) const override;
-	virtual std::shared_ptr<Value> get(const std::shared_ptr<Value>& index) const override;
-	virtual std::shared_ptr<Value> get(unsigned int index) const;
-	virtual void set(const std::shared_ptr<Value>& index, std::shared_ptr<Value> new_value);
-	virtual bool isReferenceType() const override;
+
+	enum class ElementKind : uint8_t {
+		Numbers,
+		Generic
+	};
+
+	ArrayValue(std::vector<Value> elements);
+	ArrayValue(std::vector<double> numbers);
+	virtual void output(std::string& out) const override;
+	virtual Value get(const Value& index) const override;
+	Value get(unsigned int index) const;
+	virtual void set(const Value& index, Value new_value) override;
 	unsigned int length() const;
+	ElementKind kind() const;
+	double numberAt(unsigned int index) const;
+	Value getIndex(double index) const;
+	void setIndex(double index, Value new_value);
+	Value getMember(const std::string& member) const;
+	void push(Value element);
+
+	static Value create(std::vector<Value> elements);
+	static Value create(std::vector<double> numbers);
 protected:
 	unsigned int convertIndex(double index) const;
-	std::shared_ptr<Value> getIndex(double index) const;
-	std::shared_ptr<Value> getMember(const std::string& member) const;
-	void setIndex(double index, std::shared_ptr<Value> new_value);
-	void setMember(const std::string& member, std::shared_ptr<Value> new_value);
+	void setMember(const std::string& member, Value new_value);
+	virtual void traverse(const Visitor& visit) const override;
+	virtual void clear() override;
 private:
-	std::vector<std::shared_ptr<Value>> _elements;
+	friend class Serializer;
+
+	void toGeneric();
+
+	ElementKind _kind;
+	std::vector<double> _numbers;
+	std::vector<Value> _elements;
 };
 
-class ObjectValue : public Value {
+class ObjectValue : public HeapValue {
 public:
 	static const ValueType value_type = ValueType::Object;
-	ObjectValue(std::unordered_map<std::string, std::shared_ptr<Value>> members);
-	virtual void output(std::ostream& out) const override;
-	virtual std::shared_ptr<Value> get(const std::shared_ptr<Value>& index) const override;
-	virtual void set(const std::shared_ptr<Value>& index, std::shared_ptr<Value> new_value);
-	virtual bool isReferenceType() const override;
-	std::vector<std::string> keys() const;
+	ObjectValue();
+	ObjectValue(const Shape* shape, std::vector<Value> slots);
+	virtual void output(std::string& out) const override;
+	virtual Value get(const Value& index) const override;
+	virtual void set(const Value& index, Value new_value) override;
+	std::vector<Value> keys() const;
+	Value getMember(const std::string& member) const;
+	Value getMember(const Value& member) const;
+	Value getMember(const Value& member, InlineCache& cache) const;
+	void setMember(const std::string& member, Value new_value);
+	void setMember(const Value& member, Value new_value);
+	void setMember(const Value& member, Value new_value, InlineCache& cache);
+
+	static Value create();
+	static Value create(const Shape* shape, std::vector<Value> slots);
 protected:
 	std::string convertIndex(double index) const;
-	std::shared_ptr<Value> getIndex(double index) const;
-	std::shared_ptr<Value> getMember(const std::string& member) const;
-	void setIndex(double index, std::shared_ptr<Value> new_value);
-	void setMember(const std::string& member, std::shared_ptr<Value> new_value);
+	Value getIndex(double index) const;
+	void setIndex(double index, Value new_value);
+	virtual void traverse(const Visitor& visit) const override;
+	virtual void clear() override;
 private:
-	std::unordered_map<std::string, std::shared_ptr<Value>> _members;
+	friend class Serializer;
+
+	void setComputedMember(const Value& member, Value new_value);
+	void addMember(const Value& member, Value new_value, bool may_add_shape);
+
+	// members live in _slots, at the positions _shape gives them
+	const Shape* _shape;
+	std::unique_ptr<Shape> _dictionary;
+	std::vector<Value> _slots;
 };
 
-class FunctionValue : public Value, public std::enable_shared_from_this<FunctionValue> {
+class FunctionValue : public HeapValue {
 public:
 	static const ValueType value_type = ValueType::Function;
 	FunctionValue(std::string identifier);
-	virtual void output(std::ostream& out) const override;
-	virtual bool isReferenceType() const override;
-	virtual std::shared_ptr<Value> copy() const override;
-	virtual std::shared_ptr<Value> call(const std::vector<std::shared_ptr<Value>>& arguments) const = 0;
+	virtual void output(std::string& out) const override;
+	virtual Value call(const std::vector<Value>& arguments) const = 0;
+	virtual const CompiledFunctionValue* compiled() const;
 	const std::string& id() const;
 protected:
 	std::string _identifier;
@@ -190,24 +285,319 @@ protected:
 
 class UserDefinedFunctionValue : public FunctionValue {
 public:
-	UserDefinedFunctionValue(std::string identifier, std::vector<std::string> argument_names, std::shared_ptr<ASTNode> body);
-	virtual std::shared_ptr<Value> call(const std::vector<std::shared_ptr<Value>>& arguments) const;
+	UserDefinedFunctionValue(std::string identifier, std::vector<std::string> argument_names, ASTNode* body, unsigned int frame_size, FramePtr environment);
+	virtual Value call(const std::vector<Value>& arguments) const override;
 
-	static std::shared_ptr<UserDefinedFunctionValue> create(std::string identifier, std::vector<std::string> argument_names, std::shared_ptr<ASTNode> body);
+	static Value create(std::string identifier, std::vector<std::string> argument_names, ASTNode* body, unsigned int frame_size, FramePtr environment);
+protected:
+	virtual void traverse(const Visitor& visit) const override;
+	virtual void clear() override;
 private:
 	std::vector<std::string> _argument_names;
-	std::shared_ptr<ASTNode> _body;
+	ASTNode* _body;
+	unsigned int _frame_size;
+	FramePtr _environment;
+};
+
+class CompiledFunctionValue : public FunctionValue {
+public:
+	CompiledFunctionValue(std::shared_ptr<const Chunk> chunk, FramePtr environment);
+	virtual Value call(const std::vector<Value>& arguments) const override;
+	virtual const CompiledFunctionValue* compiled() const override;
+	const Chunk& chunk() const;
+	const FramePtr& environment() const;
+
+	static Value create(std::shared_ptr<const Chunk> chunk, FramePtr environment);
+protected:
+	virtual void traverse(const Visitor& visit) const override;
+	virtual void clear() override;
+private:
+	std::shared_ptr<const Chunk> _chunk;
+	FramePtr _environment;
 };
 
+// Builtins that close over script values, like bind's, hold them as captures and get them with each
+// call rather than capturing them in the C++ function, so the collector can see them
 class BuiltinFunctionValue : public FunctionValue {
 public:
-	typedef std::function<std::shared_ptr<Value>(const std::vector<std::shared_ptr<Value>>&)> _FuncType;
+	typedef std::function<Value(const std::vector<Value>&)> _FuncType;
+	typedef std::function<Value(const std::vector<Value>& captured, const std::vector<Value>& arguments)> _CapturingFuncType;
 	BuiltinFunctionValue(std::string identifier, const _FuncType& func);
-	virtual std::shared_ptr<Value> call(const std::vector<std::shared_ptr<Value>>& arguments) const override;
+	BuiltinFunctionValue(std::string identifier, std::vector<Value> captured, const _CapturingFuncType& func);
+	virtual Value call(const std::vector<Value>& arguments) const override;
 
-	static std::shared_ptr<BuiltinFunctionValue> create(std::string identifier, const _FuncType& func);
+	static Value create(std::string identifier, const _FuncType& func);
+	static Value create(std::string identifier, std::vector<Value> captured, const _CapturingFuncType& func);
+protected:
+	virtual void traverse(const Visitor& visit) const override;
+	virtual void clear() override;
 private:
 	const _FuncType _func;
+	const _CapturingFuncType _capturing_func;
+	std::vector<Value> _captured;
 };
 
+// A file mapped read only into memory, from open_mapped(). Iterating one in a for statement goes
+// through its bytes, each a number from 0 to 255; lines(buffer) goes through its lines instead.
+class BufferValue : public HeapValue {
+public:
+	static const ValueType value_type = ValueType::Buffer;
+
+	virtual ~BufferValue();
+	virtual void output(std::string& out) const override;
+	std::string_view text() const;
+
+	// throws a FileError if path can't be mapped
+	static Value map(const std::string& path);
+private:
+	BufferValue(void* mapping, std::size_t size);
+
+	void* _mapping;
+	std::size_t _size;
+};
+
+// The lines of a buffer, from lines(buffer). Iterating one in a for statement goes through them,
+// each a view into the mapping rather than a copy, without the '\n' or "\r\n" ending them, so a
+// file of any size can be read a line at a time.
+class LinesValue : public HeapValue {
+public:
+	static const ValueType value_type = ValueType::Lines;
+
+	virtual void output(std::string& out) const override;
+	const BufferValue& buffer() const;
+
+	// the line starting at the byte position, moving position past the end of it
+	Value line(std::size_t& position) const;
+
+	static Value create(Value buffer);
+private:
+	LinesValue(Value buffer);
+
+	Value _buffer;
+};
+
+/* ===== Value (inline) ===== */
+
+inline Value::Value()
+	: _bits(_empty_bits) {}
+
+inline Value::Value(uint64_t bits)
+	: _bits(bits) {}
+
+inline Value::Value(HeapValue* cell)
+	: _bits(_heap_tag | reinterpret_cast<uintptr_t>(cell)) {
+	cell->retain();
+}
+
+inline Value::Value(const Value& other)
+	: _bits(other._bits) {
+	retain();
+}
+
+inline Value::Value(Value&& other) noexcept
+	: _bits(other._bits) {
+	other._bits = _empty_bits;
+}
+
+inline Value::~Value() {
+	release();
+}
+
+inline Value& Value::operator=(const Value& other) {
+	other.retain();
+	release();
+	_bits = other._bits;
+	return *this;
+}
+
+inline Value& Value::operator=(Value&& other) noexcept {
+	// safe for self assignment without a branch, since the emptied value releases nothing
+	uint64_t bits = other._bits;
+	other._bits = _empty_bits;
+	release();
+	_bits = bits;
+	return *this;
+}
+
+inline Value Value::null() {
+	return Value(_null_bits);
+}
+
+inline Value Value::number(double number) {
+	// arithmetic can produce NaNs with arbitrary payloads, which must not be mistaken for tags
+	if (number != number) {
+		return Value(_canonical_nan);
+	}
+
+	uint64_t bits;
+	std::memcpy(&bits, &number, sizeof(bits));
+	return Value(bits);
+}
+
+inline Value Value::boolean(bool boolean) {
+	return Value(boolean ? _true_bits : _false_bits);
+}
+
+inline bool Value::empty() const {
+	return _bits == _empty_bits;
+}
+
+inline bool Value::isNull() const {
+	return _bits == _null_bits;
+}
+
+inline bool Value::isNumber() const {
+	return (_bits & _quiet_nan) != _quiet_nan;
+}
+
+inline bool Value::isBoolean() const {
+	return _bits == _true_bits || _bits == _false_bits;
+}
+
+inline bool Value::isHeapValue() const {
+	return (_bits & _heap_tag) == _heap_tag;
+}
+
+inline double Value::asNumber() const {
+	double number;
+	std::memcpy(&number, &_bits, sizeof(number));
+	return number;
+}
+
+inline bool Value::asBoolean() const {
+	return _bits == _true_bits;
+}
+
+inline HeapValue* Value::heapValue() const {
+	return reinterpret_cast<HeapValue*>(static_cast<uintptr_t>(_bits & ~_heap_tag));
+}
+
+inline ValueType Value::type() const {
+	if (isNumber()) {
+		return ValueType::Number;
+	}
+
+	if (isHeapValue()) {
+		return heapValue()->type();
+	}
+
+	if (isNull()) {
+		return ValueType::Null;
+	}
+
+	if (isBoolean()) {
+		return ValueType::Boolean;
+	}
+
+	return ValueType::Empty;
+}
+
+inline void Value::retain() const {
+	if (isHeapValue()) {
+		heapValue()->retain();
+	}
+}
+
+inline void Value::release() const {
+	if (isHeapValue()) {
+		releaseHeapValue(heapValue());
+	}
+}
+
+inline void Value::traverse(const Collectable::Visitor& visit) const {
+	if (isHeapValue()) {
+		visit(heapValue());
+	}
+}
+
+/* ===== HeapValue (inline) ===== */
+
+inline ValueType HeapValue::type() const {
+	return _type;
+}
+
+inline void HeapValue::retain() const {
+#ifdef WATER_ATOMIC_REFCOUNT
+	_ref_count.fetch_add(1, std::memory_order_relaxed);
+#else
+	++_ref_count;
+#endif
+}
+
+// returns true when the last reference was dropped
+inline bool HeapValue::release() const {
+#ifdef WATER_ATOMIC_REFCOUNT
+	return _ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+#else
+	return --_ref_count == 0;
+#endif
+}
+
+/* ===== ArrayValue (inline) ===== */
+
+inline Value ArrayValue::get(unsigned int index) const {
+	return _kind == ElementKind::Numbers ? Value::number(_numbers[index]) : _elements[index];
+}
+
+inline unsigned int ArrayValue::length() const {
+	return _kind == ElementKind::Numbers ? _numbers.size() : _elements.size();
+}
+
+inline ArrayValue::ElementKind ArrayValue::kind() const {
+	return _kind;
+}
+
+// only valid while the array is packed
+inline double ArrayValue::numberAt(unsigned int index) const {
+	return _numbers[index];
+}
+
+/* ===== Conversions (inline) ===== */
+
+inline double toNumber(const Value& var) {
+	if (!var.isNumber()) {
+		throwTypeError();
+	}
+
+	return var.asNumber();
+}
+
+inline std::string toString(const Value& var) {
+	return var.as<StringValue>()->valueOf();
+}
+
+inline bool toBoolean(const Value& var) {
+	if (!var.isBoolean()) {
+		throwTypeError();
+	}
+
+	return var.asBoolean();
+}
+
+/* ===== Arithmetic (inline) ===== */
+
+// + adds numbers, and joins anything onto a string
+inline Value addValues(const Value& lhs, const Value& rhs) {
+	if (lhs.isNumber() && rhs.isNumber()) {
+		return Value::number(lhs.asNumber() + rhs.asNumber());
+	}
+
+	return StringValue::concatenate(lhs, rhs);
+}
+
+// the % operator. Whole numbers that fit in 32 bits take an integer remainder instead of fmodl, which
+// gives the same result for them. -0 is left to fmodl, which keeps its sign
+inline double numberModulus(double lhs, double rhs) {
+	if ((lhs > 0 || (lhs == 0 && !std::signbit(lhs))) && lhs <= UINT32_MAX && rhs >= 1 && rhs <= UINT32_MAX) {
+		auto x = static_cast<uint32_t>(lhs);
+		auto y = static_cast<uint32_t>(rhs);
+
+		if (x == lhs && y == rhs) {
+			return x % y;
+		}
+	}
+
+	return fmodl(lhs, rhs);
+}
+
 #endif
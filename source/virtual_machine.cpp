@@ -0,0 +1,359 @@
+#include <cmath>
+#include <vector>
+#include "virtual_machine.h"
+
+// GCC and Clang can jump straight from one instruction's handler to the next through a table of label
+// addresses, which gives every handler its own indirect branch to predict. Anything else uses a switch
+#if defined(__GNUC__) && !defined(WATER_SWITCH_DISPATCH)
+#define WATER_THREADED_DISPATCH 1
+#endif
+
+#if WATER_THREADED_DISPATCH
+#define DISPATCH_LOOP DISPATCH();
+#define END_DISPATCH_LOOP
+#define TARGET(name) op_##name
+#define DISPATCH() goto *dispatch_table[static_cast<unsigned int>((instruction = pc++)->op)]
+#else
+#define DISPATCH_LOOP while (true) { instruction = pc++; switch (instruction->op) {
+#define END_DISPATCH_LOOP } }
+#define TARGET(name) case Opcode::name
+#define DISPATCH() continue
+#endif
+
+using namespace std;
+
+template <typename Op>
+static inline Value applyNumberOperator(const Value& lhs, const Value& rhs, Op op) {
+	return Value::number(op(toNumber(lhs), toNumber(rhs)));
+}
+
+template <typename Op>
+static inline Value applyComparison(const Value& lhs, const Value& rhs, Op op) {
+	return Value::boolean(op(toNumber(lhs), toNumber(rhs)));
+}
+
+// fused tests and ForNext are followed by the jump they take, and skip over it otherwise
+static inline const Instruction* branch(const Instruction* code, const Instruction* pc, bool taken) {
+	return taken ? code + pc->target() : pc + 1;
+}
+
+static inline bool toCondition(const Value& condition) {
+	if (!condition.isBoolean()) {
+		throw TypeError("Condition is not of type Boolean");
+	}
+
+	return condition.asBoolean();
+}
+
+static inline const Value& operand(const Value* registers, const Value* constants, uint16_t rk) {
+	if (rk & Instruction::constant_flag) {
+		return constants[rk & ~Instruction::constant_flag];
+	}
+
+	return registers[rk];
+}
+
+Value VirtualMachine::execute(const Chunk& entry, FramePtr frame) {
+	// the caller's state, saved while a compiled function it called runs. The callee's code stays alive
+	// through the caller's register holding the function, which nothing else can write
+	struct CallRecord {
+		const Chunk* chunk;
+		const Instruction* pc;
+		FramePtr frame;
+		uint16_t result;
+	};
+
+#if WATER_THREADED_DISPATCH
+	// in the same order as Opcode
+	static void* const dispatch_table[] = {
+		&&op_Move, &&op_LoadConstant, &&op_LoadNull, &&op_LoadBoolean, &&op_GetOuter, &&op_SetOuter,
+		&&op_Add, &&op_Subtract, &&op_Multiply, &&op_Divide, &&op_Modulus, &&op_Exponent,
+		&&op_LessThan, &&op_LessThanOrEqual, &&op_GreaterThan, &&op_GreaterThanOrEqual, &&op_EqualTo, &&op_NotEqualTo,
+		&&op_Negate, &&op_Not, &&op_ToBoolean,
+		&&op_Jump, &&op_JumpIfFalse, &&op_JumpIfTrue,
+		&&op_TestLessThan, &&op_TestLessThanOrEqual, &&op_TestGreaterThan, &&op_TestGreaterThanOrEqual, &&op_TestEqualTo, &&op_TestNotEqualTo,
+		&&op_NewArray, &&op_NewObject, &&op_GetIndex, &&op_SetIndex, &&op_GetMember, &&op_SetMember,
+		&&op_Call, &&op_Closure, &&op_ForPrepare, &&op_ForNext, &&op_ThrowUndefined, &&op_Return, &&op_ReturnNull, &&op_Halt
+	};
+
+	static_assert(sizeof(dispatch_table) / sizeof(*dispatch_table) == opcode_count, "every opcode needs a handler");
+#endif
+
+	vector<CallRecord> calls;
+
+	const Chunk* chunk = &entry;
+	const Instruction* code = chunk->code.data();
+	const Instruction* pc = code;
+	const Instruction* instruction;
+	const Value* constants = chunk->constants.data();
+	Value* registers = frame->data();
+
+#define RK(operand_index) operand(registers, constants, instruction->operand_index)
+
+	DISPATCH_LOOP
+		TARGET(Move):
+			registers[instruction->a] = registers[instruction->b];
+			DISPATCH();
+		TARGET(LoadConstant):
+			registers[instruction->a] = constants[instruction->b];
+			DISPATCH();
+		TARGET(LoadNull):
+			registers[instruction->a] = Value::null();
+			DISPATCH();
+		TARGET(LoadBoolean):
+			registers[instruction->a] = Value::boolean(instruction->b != 0);
+			DISPATCH();
+		TARGET(GetOuter):
+			registers[instruction->a] = (*frame->ancestor(instruction->b))[instruction->c];
+			DISPATCH();
+		TARGET(SetOuter):
+			(*frame->ancestor(instruction->b))[instruction->c] = registers[instruction->a];
+			DISPATCH();
+
+		// Arithmetic
+		TARGET(Add):
+			registers[instruction->a] = addValues(RK(b), RK(c));
+			DISPATCH();
+		TARGET(Subtract):
+			registers[instruction->a] = applyNumberOperator(RK(b), RK(c), [](double x, double y) { return x - y; });
+			DISPATCH();
+		TARGET(Multiply):
+			registers[instruction->a] = applyNumberOperator(RK(b), RK(c), [](double x, double y) { return x * y; });
+			DISPATCH();
+		TARGET(Divide):
+			registers[instruction->a] = applyNumberOperator(RK(b), RK(c), [](double x, double y) { return x / y; });
+			DISPATCH();
+		TARGET(Modulus):
+			registers[instruction->a] = applyNumberOperator(RK(b), RK(c), numberModulus);
+			DISPATCH();
+		TARGET(Exponent):
+			registers[instruction->a] = applyNumberOperator(RK(b), RK(c), powl);
+			DISPATCH();
+		TARGET(Negate):
+			registers[instruction->a] = Value::number(-toNumber(registers[instruction->b]));
+			DISPATCH();
+
+		// Comparisons
+		TARGET(LessThan):
+			registers[instruction->a] = applyComparison(RK(b), RK(c), [](double x, double y) { return x < y; });
+			DISPATCH();
+		TARGET(LessThanOrEqual):
+			registers[instruction->a] = applyComparison(RK(b), RK(c), [](double x, double y) { return x <= y; });
+			DISPATCH();
+		TARGET(GreaterThan):
+			registers[instruction->a] = applyComparison(RK(b), RK(c), [](double x, double y) { return x > y; });
+			DISPATCH();
+		TARGET(GreaterThanOrEqual):
+			registers[instruction->a] = applyComparison(RK(b), RK(c), [](double x, double y) { return x >= y; });
+			DISPATCH();
+		TARGET(EqualTo):
+			registers[instruction->a] = applyComparison(RK(b), RK(c), [](double x, double y) { return x == y; });
+			DISPATCH();
+		TARGET(NotEqualTo):
+			registers[instruction->a] = applyComparison(RK(b), RK(c), [](double x, double y) { return x != y; });
+			DISPATCH();
+
+		// Logical
+		TARGET(Not):
+			registers[instruction->a] = Value::boolean(!toBoolean(registers[instruction->b]));
+			DISPATCH();
+		TARGET(ToBoolean):
+			registers[instruction->a] = Value::boolean(toBoolean(registers[instruction->b]));
+			DISPATCH();
+
+		// Control flow
+		TARGET(Jump):
+			pc = code + instruction->target();
+			DISPATCH();
+		TARGET(JumpIfFalse):
+			if (!toCondition(registers[instruction->a])) {
+				pc = code + instruction->target();
+			}
+			DISPATCH();
+		TARGET(JumpIfTrue):
+			if (toCondition(registers[instruction->a])) {
+				pc = code + instruction->target();
+			}
+			DISPATCH();
+		TARGET(TestLessThan):
+			pc = branch(code, pc, (toNumber(RK(b)) < toNumber(RK(c))) == (instruction->a != 0));
+			DISPATCH();
+		TARGET(TestLessThanOrEqual):
+			pc = branch(code, pc, (toNumber(RK(b)) <= toNumber(RK(c))) == (instruction->a != 0));
+			DISPATCH();
+		TARGET(TestGreaterThan):
+			pc = branch(code, pc, (toNumber(RK(b)) > toNumber(RK(c))) == (instruction->a != 0));
+			DISPATCH();
+		TARGET(TestGreaterThanOrEqual):
+			pc = branch(code, pc, (toNumber(RK(b)) >= toNumber(RK(c))) == (instruction->a != 0));
+			DISPATCH();
+		TARGET(TestEqualTo):
+			pc = branch(code, pc, (toNumber(RK(b)) == toNumber(RK(c))) == (instruction->a != 0));
+			DISPATCH();
+		TARGET(TestNotEqualTo):
+			pc = branch(code, pc, (toNumber(RK(b)) != toNumber(RK(c))) == (instruction->a != 0));
+			DISPATCH();
+
+		// Arrays and objects
+		TARGET(NewArray):
+			registers[instruction->a] = ArrayValue::create(vector<Value>(registers + instruction->b, registers + instruction->b + instruction->c));
+			DISPATCH();
+		TARGET(NewObject):
+			registers[instruction->a] = ObjectValue::create();
+			DISPATCH();
+		TARGET(GetIndex): {
+			auto& array = registers[instruction->b];
+			auto& index = registers[instruction->c];
+
+			if (array.type() == ValueType::Array && index.isNumber()) {
+				registers[instruction->a] = static_cast<const ArrayValue*>(array.heapValue())->getIndex(index.asNumber());
+			} else {
+				registers[instruction->a] = array.get(index);
+			}
+		} DISPATCH();
+		TARGET(SetIndex): {
+			auto& array = registers[instruction->a];
+			auto& index = registers[instruction->b];
+
+			if (array.type() == ValueType::Array && index.isNumber()) {
+				static_cast<ArrayValue*>(array.heapValue())->setIndex(index.asNumber(), registers[instruction->c]);
+			} else {
+				array.set(index, registers[instruction->c]);
+			}
+		} DISPATCH();
+		TARGET(GetMember): {
+			auto& object = registers[instruction->b];
+			auto& access = chunk->members[instruction->c];
+			auto& member = constants[access.name];
+
+			if (object.type() == ValueType::Object) {
+				registers[instruction->a] = static_cast<const ObjectValue*>(object.heapValue())->getMember(member, access.cache);
+			} else {
+				registers[instruction->a] = object.get(member);
+			}
+		} DISPATCH();
+		TARGET(SetMember): {
+			auto& object = registers[instruction->a];
+			auto& access = chunk->members[instruction->b];
+			auto& member = constants[access.name];
+
+			if (object.type() == ValueType::Object) {
+				static_cast<ObjectValue*>(object.heapValue())->setMember(member, registers[instruction->c], access.cache);
+			} else {
+				object.set(member, registers[instruction->c]);
+			}
+		} DISPATCH();
+
+		// Functions
+		TARGET(Call): {
+			auto& callee = registers[instruction->b];
+			if (callee.type() != ValueType::Function) {
+				throw TypeError("Expression is not of type Function");
+			}
+
+			auto function = static_cast<const FunctionValue*>(callee.heapValue());
+			auto arguments = registers + instruction->b + 1;
+			auto compiled = function->compiled();
+
+			if (!compiled) {
+				auto result = function->call(vector<Value>(arguments, arguments + instruction->c));
+				registers[instruction->a] = move(result);
+				DISPATCH();
+			}
+
+			auto& callee_chunk = compiled->chunk();
+			if (callee_chunk.arity != instruction->c) {
+				throw InvalidArgumentsCountError(function->id(), callee_chunk.arity, instruction->c);
+			}
+
+			auto callee_frame = Frame::create(compiled->environment(), callee_chunk.frame_size);
+			auto callee_registers = callee_frame->data();
+
+			for (unsigned int i = 0; i < instruction->c; ++i) {
+				callee_registers[i] = arguments[i];
+			}
+
+			calls.push_back({ chunk, pc, move(frame), instruction->a });
+
+			chunk = &callee_chunk;
+			code = chunk->code.data();
+			pc = code;
+			constants = chunk->constants.data();
+			frame = move(callee_frame);
+			registers = callee_registers;
+		} DISPATCH();
+		TARGET(Closure):
+			registers[instruction->a] = CompiledFunctionValue::create(chunk->functions[instruction->b], frame);
+			DISPATCH();
+		TARGET(ThrowUndefined):
+			throw UndefinedVariableError(constants[instruction->a].as<StringValue>()->valueOf());
+		TARGET(Return):
+		TARGET(ReturnNull): {
+			Value result = instruction->op == Opcode::Return ? registers[instruction->a] : Value::null();
+
+			if (calls.empty()) {
+				return result;
+			}
+
+			auto& caller = calls.back();
+			auto result_register = caller.result;
+
+			chunk = caller.chunk;
+			code = chunk->code.data();
+			pc = caller.pc;
+			constants = chunk->constants.data();
+			frame = move(caller.frame);
+			registers = frame->data();
+
+			calls.pop_back();
+			registers[result_register] = move(result);
+		} DISPATCH();
+		TARGET(Halt):
+			return Value();
+
+		// Loops
+		TARGET(ForPrepare): {
+			auto& array = registers[instruction->a];
+			double length;
+
+			if (array.type() == ValueType::Array) {
+				length = array.as<ArrayValue>()->length();
+			} else if (array.type() == ValueType::Buffer) {
+				length = array.as<BufferValue>()->text().size();
+			} else if (array.type() == ValueType::Lines) {
+				length = array.as<LinesValue>()->buffer().text().size();
+			} else {
+				throw TypeError("Expression not of type Array");
+			}
+
+			registers[instruction->a + 1] = Value::number(0);
+			registers[instruction->a + 2] = Value::number(length);
+		} DISPATCH();
+		TARGET(ForNext): {
+			double index = registers[instruction->a + 1].asNumber();
+			bool more = index < registers[instruction->a + 2].asNumber();
+
+			if (more) {
+				auto sequence = registers[instruction->a].heapValue();
+
+				if (sequence->type() == ValueType::Array) {
+					registers[instruction->b] = static_cast<const ArrayValue*>(sequence)->get(static_cast<unsigned int>(index));
+					registers[instruction->a + 1] = Value::number(index + 1);
+				} else if (sequence->type() == ValueType::Buffer) {
+					auto byte = static_cast<const BufferValue*>(sequence)->text()[static_cast<size_t>(index)];
+					registers[instruction->b] = Value::number(static_cast<unsigned char>(byte));
+					registers[instruction->a + 1] = Value::number(index + 1);
+				} else {
+					// lines are counted in bytes, and move on by a line at a time
+					auto position = static_cast<size_t>(index);
+					registers[instruction->b] = static_cast<const LinesValue*>(sequence)->line(position);
+					registers[instruction->a + 1] = Value::number(position);
+				}
+			}
+
+			pc = branch(code, pc, more);
+		} DISPATCH();
+	END_DISPATCH_LOOP
+
+#undef RK
+}
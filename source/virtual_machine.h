@@ -0,0 +1,15 @@
+#ifndef _VIRTUAL_MACHINE_H_
+#define _VIRTUAL_MACHINE_H_
+
+#include "chunk.h"
+#include "frame.h"
+
+// Runs compiled chunks. Calls between compiled functions push a record onto the machine's own call
+// stack instead of recursing, so recursion depth is bounded by memory rather than the native stack.
+// Builtins that call back into compiled functions start a nested run.
+class VirtualMachine {
+public:
+	static Value execute(const Chunk& chunk, FramePtr frame);
+};
+
+#endif